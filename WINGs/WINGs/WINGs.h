@@ -816,6 +816,10 @@ void WMDrawImageString(WMScreen *scr, Drawable d, WMColor *color,
 
 int WMWidthOfString(WMFont *font, const char *text, int length);
 
+/* Returns the length, in bytes, of the longest prefix of text that is
+ * not wider than width pixels */
+int WMFitStringInWidth(WMFont *font, const char *text, int length, int width);
+
 /* ---[ WINGs/wpixmap.c ]------------------------------------------------- */
 
 WMPixmap* WMRetainPixmap(WMPixmap *pixmap);
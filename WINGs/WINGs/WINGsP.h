@@ -380,6 +380,8 @@ void W_InitNotificationCenter(void);
 
 void W_ReleaseNotificationCenter(void);
 
+void W_PrintNotificationStatistics(void);
+
 void W_FlushASAPNotificationQueue(void);
 
 void W_FlushIdleNotificationQueue(void);
@@ -449,6 +451,9 @@ void W_CallDestroyHandlers(W_View *view);
 
 /* ---[ wfont.c ]--------------------------------------------------------- */
 
+#define W_FONT_LATIN_GLYPHS	256
+#define W_FONT_RECENT_STRINGS	8
+
 typedef struct W_Font {
     struct W_Screen *screen;
 
@@ -461,6 +466,18 @@ typedef struct W_Font {
 
 #ifdef USE_PANGO
     PangoLayout *layout;
+
+    /* width of the last measured strings, shaping is too slow to redo */
+    struct {
+        char *text;
+        int length;
+        int width;
+    } recent[W_FONT_RECENT_STRINGS];
+    int nextRecent;
+#else
+    /* advance of the glyphs already measured, -1 if not known yet */
+    short latinAdvance[W_FONT_LATIN_GLYPHS];
+    WMHashTable *advances;     /* the same for the other characters */
 #endif
 } W_Font;
 
@@ -207,6 +207,28 @@ typedef void waborthandler(int);
 
 waborthandler* wsetabort(waborthandler* handler);
 
+/* Arenas are for short lived data freed all at once, the memory they
+ * return is not cleared. Use WMArenaPromote() to get a wmalloc()ed copy
+ * of what must be kept after the arena is reset or freed. */
+typedef struct W_Arena WMArena;
+
+typedef struct {
+    unsigned long allocations;  /* since the arena was created */
+    unsigned long promoted;
+    size_t bytes;               /* allocated since the arena was created */
+    size_t inUse;               /* allocated since the last reset */
+    size_t peak;                /* highest inUse */
+    size_t reserved;            /* size of the blocks held */
+} WMArenaStatistics;
+
+WMArena* WMCreateArena(size_t blockSize);
+void* WMArenaAlloc(WMArena *arena, size_t size);
+char* WMArenaStrndup(WMArena *arena, const char *str, size_t len);
+void* WMArenaPromote(WMArena *arena, const void *ptr, size_t size);
+void WMResetArena(WMArena *arena);
+void WMFreeArena(WMArena *arena);
+void WMGetArenaStatistics(WMArena *arena, WMArenaStatistics *stats);
+
 /* ---[ WINGs/error.c ]--------------------------------------------------- */
 
 enum {
@@ -910,6 +932,11 @@ void WMSetUDSearchList(WMUserDefaults *database, WMPropList *list);
 
 extern char *WMUserDefaultsDidChangeNotification;
 
+/* Posted for every key whose value was changed by a reload of the
+ * application domain, before WMUserDefaultsDidChangeNotification.
+ * The object is the database, the client data the name of the key. */
+extern char *WMUserDefaultsKeyDidChangeNotification;
+
 
 /* ---[ WINGs/menuparser.c ]---------------------------------------------- */
 
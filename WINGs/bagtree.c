@@ -12,6 +12,8 @@ typedef struct W_Node {
 
 	void *data;
 	int index;
+
+	struct W_Node *sameData;	/* next node holding the same data */
 } W_Node;
 
 typedef struct W_Bag {
@@ -21,12 +23,39 @@ typedef struct W_Bag {
 
 	int count;
 
+	/* data -> a node holding it, the others are chained by sameData */
+	WMHashTable *dataIndex;
+
 	void (*destructor) (void *item);
 } W_Bag;
 
 #define IS_LEFT(node) (node == node->parent->left)
 #define IS_RIGHT(node) (node == node->parent->right)
 
+static void indexNode(W_Bag * tree, W_Node * node)
+{
+	node->sameData = WMHashGet(tree->dataIndex, node->data);
+	WMHashInsert(tree->dataIndex, node->data, node);
+}
+
+static void unindexNode(W_Bag * tree, W_Node * node)
+{
+	W_Node *tmp;
+
+	tmp = WMHashGet(tree->dataIndex, node->data);
+	if (tmp == node) {
+		if (node->sameData)
+			WMHashInsert(tree->dataIndex, node->data, node->sameData);
+		else
+			WMHashRemove(tree->dataIndex, node->data);
+	} else {
+		while (tmp->sameData != node)
+			tmp = tmp->sameData;
+		tmp->sameData = node->sameData;
+	}
+	node->sameData = NULL;
+}
+
 static void leftRotate(W_Bag * tree, W_Node * node)
 {
 	W_Node *node2;
@@ -34,7 +63,8 @@ static void leftRotate(W_Bag * tree, W_Node * node)
 	node2 = node->right;
 	node->right = node2->left;
 
-	node2->left->parent = node;
+	if (node2->left != tree->nil)
+		node2->left->parent = node;
 
 	node2->parent = node->parent;
 
@@ -58,7 +88,8 @@ static void rightRotate(W_Bag * tree, W_Node * node)
 	node2 = node->left;
 	node->left = node2->right;
 
-	node2->right->parent = node;
+	if (node2->right != tree->nil)
+		node2->right->parent = node;
 
 	node2->parent = node->parent;
 
@@ -101,6 +132,7 @@ static void rbTreeInsert(W_Bag * tree, W_Node * node)
 	W_Node *y;
 
 	treeInsert(tree, node);
+	indexNode(tree, node);
 
 	node->color = 'R';
 
@@ -251,72 +283,92 @@ static W_Node *treePredecessor(W_Node * node, W_Node * nil)
 	return y;
 }
 
+/* puts node2 in the place of node in the tree */
+static void treeTransplant(W_Bag * tree, W_Node * node, W_Node * node2)
+{
+	if (node->parent == tree->nil)
+		tree->root = node2;
+	else if (IS_LEFT(node))
+		node->parent->left = node2;
+	else
+		node->parent->right = node2;
+
+	node2->parent = node->parent;
+}
+
+/*
+ * Takes the node out of the tree and returns it. The other nodes are
+ * relinked rather than having their contents moved, so iterators on
+ * them stay valid.
+ */
 static W_Node *rbTreeDelete(W_Bag * tree, W_Node * node)
 {
 	W_Node *nil = tree->nil;
 	W_Node *x, *y;
+	int color;
 
-	if (node->left == nil || node->right == nil) {
-		y = node;
-	} else {
-		y = treeSuccessor(node, nil);
-	}
+	unindexNode(tree, node);
+
+	color = node->color;
 
-	if (y->left != nil) {
-		x = y->left;
+	if (node->left == nil) {
+		x = node->right;
+		treeTransplant(tree, node, x);
+	} else if (node->right == nil) {
+		x = node->left;
+		treeTransplant(tree, node, x);
 	} else {
+		y = treeMinimum(node->right, nil);
+		color = y->color;
 		x = y->right;
-	}
-
-	x->parent = y->parent;
 
-	if (y->parent == nil) {
-		tree->root = x;
-	} else {
-		if (IS_LEFT(y)) {
-			y->parent->left = x;
+		if (y->parent == node) {
+			x->parent = y;
 		} else {
-			y->parent->right = x;
+			treeTransplant(tree, y, x);
+			y->right = node->right;
+			y->right->parent = y;
 		}
+		treeTransplant(tree, node, y);
+		y->left = node->left;
+		y->left->parent = y;
+		y->color = node->color;
 	}
-	if (y != node) {
-		node->index = y->index;
-		node->data = y->data;
-	}
-	if (y->color == 'B') {
+
+	if (color == 'B') {
 		rbDeleteFixup(tree, x);
 	}
 
-	return y;
+	return node;
 }
 
 static W_Node *treeSearch(W_Node * root, W_Node * nil, int index)
 {
-	if (root == nil || root->index == index) {
-		return root;
+	while (root != nil && root->index != index) {
+		if (index < root->index)
+			root = root->left;
+		else
+			root = root->right;
 	}
 
-	if (index < root->index) {
-		return treeSearch(root->left, nil, index);
-	} else {
-		return treeSearch(root->right, nil, index);
-	}
+	return root;
 }
 
-static W_Node *treeFind(W_Node * root, W_Node * nil, void *data)
+/* Returns the node with the lowest index holding data */
+static W_Node *treeFind(W_Bag * tree, void *data)
 {
-	W_Node *tmp;
-
-	if (root == nil || root->data == data)
-		return root;
+	W_Node *node, *first;
 
-	tmp = treeFind(root->left, nil, data);
-	if (tmp != nil)
-		return tmp;
+	first = WMHashGet(tree->dataIndex, data);
+	if (!first)
+		return tree->nil;
 
-	tmp = treeFind(root->right, nil, data);
+	for (node = first->sameData; node != NULL; node = node->sameData) {
+		if (node->index < first->index)
+			first = node;
+	}
 
-	return tmp;
+	return first;
 }
 
 #if 0
@@ -361,7 +413,9 @@ WMBag *WMCreateTreeBagWithDestructor(WMFreeDataProc * destructor)
 	bag->nil = wmalloc(sizeof(W_Node));
 	bag->nil->left = bag->nil->right = bag->nil->parent = bag->nil;
 	bag->nil->index = WBNotFound;
+	bag->nil->color = 'B';
 	bag->root = bag->nil;
+	bag->dataIndex = WMCreateHashTable(WMIntHashCallbacks);
 	bag->destructor = destructor;
 
 	return bag;
@@ -444,7 +498,7 @@ static int treeDeleteNode(WMBag * self, W_Node *ptr)
 
 int WMRemoveFromBag(WMBag * self, void *item)
 {
-	W_Node *ptr = treeFind(self->root, self->nil, item);
+	W_Node *ptr = treeFind(self, item);
 	return treeDeleteNode(self, ptr);
 }
 
@@ -490,43 +544,32 @@ int WMGetFirstInBag(WMBag * self, void *item)
 {
 	W_Node *node;
 
-	node = treeFind(self->root, self->nil, item);
+	node = treeFind(self, item);
 	if (node != self->nil)
 		return node->index;
 	else
 		return WBNotFound;
 }
 
-static int treeCount(W_Node * root, W_Node * nil, void *item)
+int WMCountInBag(WMBag * self, void *item)
 {
+	W_Node *node;
 	int count = 0;
 
-	if (root == nil)
-		return 0;
-
-	if (root->data == item)
+	for (node = WMHashGet(self->dataIndex, item); node != NULL; node = node->sameData)
 		count++;
 
-	if (root->left != nil)
-		count += treeCount(root->left, nil, item);
-
-	if (root->right != nil)
-		count += treeCount(root->right, nil, item);
-
 	return count;
 }
 
-int WMCountInBag(WMBag * self, void *item)
-{
-	return treeCount(self->root, self->nil, item);
-}
-
 void *WMReplaceInBag(WMBag * self, int index, void *item)
 {
 	W_Node *ptr = treeSearch(self->root, self->nil, index);
 	void *old = NULL;
 
 	if (item == NULL) {
+		if (ptr == self->nil)
+			return NULL;
 		self->count--;
 		ptr = rbTreeDelete(self, ptr);
 		if (self->destructor)
@@ -534,7 +577,9 @@ void *WMReplaceInBag(WMBag * self, int index, void *item)
 		wfree(ptr);
 	} else if (ptr != self->nil) {
 		old = ptr->data;
+		unindexNode(self, ptr);
 		ptr->data = item;
+		indexNode(self, ptr);
 	} else {
 		W_Node *ptr;
 
@@ -574,11 +619,14 @@ void WMSortBag(WMBag * self, WMCompareDataProc * comparer)
 
 	qsort(&items[0], self->count, sizeof(void *), comparer);
 
+	WMResetHashTable(self->dataIndex);
+
 	i = 0;
 	tmp = treeMinimum(self->root, self->nil);
 	while (tmp != self->nil) {
 		tmp->index = i;
 		tmp->data = items[i++];
+		indexNode(self, tmp);
 		tmp = treeSuccessor(tmp, self->nil);
 	}
 
@@ -603,6 +651,7 @@ static void deleteTree(WMBag * self, W_Node * node)
 void WMEmptyBag(WMBag * self)
 {
 	deleteTree(self, self->root);
+	WMResetHashTable(self->dataIndex);
 	self->root = self->nil;
 	self->count = 0;
 }
@@ -610,6 +659,7 @@ void WMEmptyBag(WMBag * self)
 void WMFreeBag(WMBag * self)
 {
 	WMEmptyBag(self);
+	WMFreeHashTable(self->dataIndex);
 	wfree(self->nil);
 	wfree(self);
 }
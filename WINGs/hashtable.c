@@ -1,33 +1,51 @@
 #include <config.h>
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "WUtil.h"
 
-#define INITIAL_CAPACITY	23
+/*
+ * The table uses open addressing with linear probing, in robin hood order:
+ * an item being inserted takes the slot of an item that is closer to its
+ * own home slot. This keeps probe sequences short, lets a lookup stop as
+ * soon as it meets an item closer to home than the key would be, and lets
+ * removal shift the following items back instead of leaving tombstones.
+ *
+ * When the table grows the items are not all moved at once. The old slots
+ * are kept and a few of them are moved to the new table on each insertion,
+ * and lookups check both tables until the move is complete.
+ */
+
+#define INITIAL_CAPACITY	16	/* must be a power of 2 */
+#define MIGRATE_STEP		8	/* old slots moved per insertion while growing */
 
 
 typedef struct HashItem {
 	const void *key;
 	const void *data;
-
-	struct HashItem *next;	/* collided item list */
+	unsigned hash;		/* 0 marks an empty slot */
 } HashItem;
 
 typedef struct W_HashTable {
 	WMHashTableCallbacks callbacks;
 
 	unsigned itemCount;
-	unsigned size;		/* table size */
+	unsigned size;		/* table size, a power of 2 */
 
-	HashItem **table;
+	HashItem *table;
+
+	/* previous slots while growing, only those from 'migrated' on are in use */
+	HashItem *oldTable;
+	unsigned oldSize;
+	unsigned migrated;
 } HashTable;
 
-#define HASH(table, key)  (((table)->callbacks.hash ? \
-    (*(table)->callbacks.hash)(key) : hashPtr(key)) % (table)->size)
+#define KEYEQUAL(table, key1, key2) ((table)->callbacks.keyIsEqual ? \
+    (*(table)->callbacks.keyIsEqual)(key1, key2) : (key1) == (key2))
 
 #define DUPKEY(table, key) ((table)->callbacks.retainKey ? \
     (*(table)->callbacks.retainKey)(key) : (key))
@@ -35,15 +53,18 @@ typedef struct W_HashTable {
 #define RELKEY(table, key) if ((table)->callbacks.releaseKey) \
     (*(table)->callbacks.releaseKey)(key)
 
+/* distance of the item in slot 'pos' from its home slot */
+#define DISTANCE(item, pos, mask) (((pos) - (item)->hash) & (mask))
+
+/* 32 bit FNV-1a */
 static inline unsigned hashString(const void *param)
 {
-	const char *key = param;
-	unsigned ret = 0;
-	unsigned ctr = 0;
+	const unsigned char *key = param;
+	uint32_t ret = 2166136261U;
 
 	while (*key) {
-		ret ^= *key++ << ctr;
-		ctr = (ctr + 1) % sizeof(char *);
+		ret ^= *key++;
+		ret *= 16777619U;
 	}
 
 	return ret;
@@ -51,43 +72,155 @@ static inline unsigned hashString(const void *param)
 
 static inline unsigned hashPtr(const void *key)
 {
-	return ((size_t) key / sizeof(char *));
+	uint64_t x = (uintptr_t) key;
+
+	/* pointers are aligned and close together, spread all their bits */
+	x ^= x >> 33;
+	x *= UINT64_C(0xff51afd7ed558ccd);
+	x ^= x >> 33;
+
+	return (unsigned)x;
 }
 
-static void rellocateItem(WMHashTable * table, HashItem * item)
+/*
+ * The slot is taken from the low bits of the hash, so the result of the
+ * hash callback is mixed again in case it only varies in its high bits.
+ */
+static inline unsigned hashKey(WMHashTable *table, const void *key)
 {
-	unsigned h;
+	uint32_t h;
+
+	h = table->callbacks.hash ? (*table->callbacks.hash)(key) : hashPtr(key);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+
+	return h ? h : 1;
+}
+
+/*
+ * Returns the slot holding key in 'slots', or -1. Slots below 'first'
+ * are not considered, they were moved to the new table.
+ */
+static long findSlot(WMHashTable *table, HashItem *slots, unsigned size, unsigned first,
+		     const void *key, unsigned hash)
+{
+	unsigned mask = size - 1;
+	unsigned pos = hash & mask;
+	unsigned dist;
+
+	for (dist = 0;; dist++) {
+		HashItem *item = &slots[pos];
+
+		if (item->hash == 0 || DISTANCE(item, pos, mask) < dist)
+			return -1;
+
+		if (item->hash == hash && pos >= first && KEYEQUAL(table, key, item->key))
+			return pos;
+
+		pos = (pos + 1) & mask;
+	}
+}
+
+static void placeItem(HashItem *slots, unsigned size, HashItem item)
+{
+	unsigned mask = size - 1;
+	unsigned pos = item.hash & mask;
+	unsigned dist, d;
+	HashItem tmp;
+
+	for (dist = 0;; dist++) {
+		if (slots[pos].hash == 0) {
+			slots[pos] = item;
+			return;
+		}
+
+		d = DISTANCE(&slots[pos], pos, mask);
+		if (d < dist) {
+			tmp = slots[pos];
+			slots[pos] = item;
+			item = tmp;
+			dist = d;
+		}
+
+		pos = (pos + 1) & mask;
+	}
+}
+
+static void removeSlot(HashItem *slots, unsigned size, unsigned pos)
+{
+	unsigned mask = size - 1;
+	unsigned next;
+
+	/* shift back the items that were pushed away from their home slot */
+	for (;;) {
+		next = (pos + 1) & mask;
+		if (slots[next].hash == 0 || DISTANCE(&slots[next], next, mask) == 0)
+			break;
+		slots[pos] = slots[next];
+		pos = next;
+	}
+
+	memset(&slots[pos], 0, sizeof(HashItem));
+}
 
-	h = HASH(table, item->key);
+static void migrateItems(WMHashTable *table, unsigned count)
+{
+	if (!table->oldTable)
+		return;
+
+	while (count-- > 0 && table->migrated < table->oldSize) {
+		HashItem *item = &table->oldTable[table->migrated++];
+
+		/* the old slot stays as it is so probing in the old table still works */
+		if (item->hash)
+			placeItem(table->table, table->size, *item);
+	}
 
-	item->next = table->table[h];
-	table->table[h] = item;
+	if (table->migrated == table->oldSize) {
+		wfree(table->oldTable);
+		table->oldTable = NULL;
+		table->oldSize = 0;
+		table->migrated = 0;
+	}
 }
 
-static void rebuildTable(WMHashTable * table)
+static void growTable(WMHashTable *table)
 {
-	HashItem *next;
-	HashItem **oldArray;
-	int i;
-	int oldSize;
-	int newSize;
+	/* finish a previous resize first, the table is only allowed two sets of slots */
+	migrateItems(table, table->oldSize);
+
+	table->oldTable = table->table;
+	table->oldSize = table->size;
+	table->migrated = 0;
 
-	oldArray = table->table;
-	oldSize = table->size;
+	table->size *= 2;
+	table->table = wmalloc(sizeof(HashItem) * table->size);
+}
 
-	newSize = table->size * 2;
+static void releaseKeys(WMHashTable *table)
+{
+	unsigned i;
 
-	table->table = wmalloc(sizeof(char *) * newSize);
-	table->size = newSize;
+	if (!table->callbacks.releaseKey)
+		return;
 
-	for (i = 0; i < oldSize; i++) {
-		while (oldArray[i] != NULL) {
-			next = oldArray[i]->next;
-			rellocateItem(table, oldArray[i]);
-			oldArray[i] = next;
+	for (i = 0; i < table->size; i++) {
+		if (table->table[i].hash) {
+			RELKEY(table, table->table[i].key);
+		}
+	}
+
+	if (table->oldTable) {
+		for (i = table->migrated; i < table->oldSize; i++) {
+			if (table->oldTable[i].hash) {
+				RELKEY(table, table->oldTable[i].key);
+			}
 		}
 	}
-	wfree(oldArray);
 }
 
 WMHashTable *WMCreateHashTable(const WMHashTableCallbacks callbacks)
@@ -100,24 +233,20 @@ WMHashTable *WMCreateHashTable(const WMHashTableCallbacks callbacks)
 
 	table->size = INITIAL_CAPACITY;
 
-	table->table = wmalloc(sizeof(HashItem *) * table->size);
+	table->table = wmalloc(sizeof(HashItem) * table->size);
 
 	return table;
 }
 
 void WMResetHashTable(WMHashTable * table)
 {
-	HashItem *item, *tmp;
-	int i;
+	releaseKeys(table);
 
-	for (i = 0; i < table->size; i++) {
-		item = table->table[i];
-		while (item) {
-			tmp = item->next;
-			RELKEY(table, item->key);
-			wfree(item);
-			item = tmp;
-		}
+	if (table->oldTable) {
+		wfree(table->oldTable);
+		table->oldTable = NULL;
+		table->oldSize = 0;
+		table->migrated = 0;
 	}
 
 	table->itemCount = 0;
@@ -125,26 +254,18 @@ void WMResetHashTable(WMHashTable * table)
 	if (table->size > INITIAL_CAPACITY) {
 		wfree(table->table);
 		table->size = INITIAL_CAPACITY;
-		table->table = wmalloc(sizeof(HashItem *) * table->size);
+		table->table = wmalloc(sizeof(HashItem) * table->size);
 	} else {
-		memset(table->table, 0, sizeof(HashItem *) * table->size);
+		memset(table->table, 0, sizeof(HashItem) * table->size);
 	}
 }
 
 void WMFreeHashTable(WMHashTable * table)
 {
-	HashItem *item, *tmp;
-	int i;
+	releaseKeys(table);
 
-	for (i = 0; i < table->size; i++) {
-		item = table->table[i];
-		while (item) {
-			tmp = item->next;
-			RELKEY(table, item->key);
-			wfree(item);
-			item = tmp;
-		}
-	}
+	if (table->oldTable)
+		wfree(table->oldTable);
 	wfree(table->table);
 	wfree(table);
 }
@@ -157,27 +278,21 @@ unsigned WMCountHashTable(WMHashTable * table)
 static HashItem *hashGetItem(WMHashTable *table, const void *key)
 {
 	unsigned h;
-	HashItem *item;
+	long pos;
 
-	h = HASH(table, key);
-	item = table->table[h];
+	h = hashKey(table, key);
 
-	if (table->callbacks.keyIsEqual) {
-		while (item) {
-			if ((*table->callbacks.keyIsEqual) (key, item->key)) {
-				break;
-			}
-			item = item->next;
-		}
-	} else {
-		while (item) {
-			if (key == item->key) {
-				break;
-			}
-			item = item->next;
-		}
+	pos = findSlot(table, table->table, table->size, 0, key, h);
+	if (pos >= 0)
+		return &table->table[pos];
+
+	if (table->oldTable) {
+		pos = findSlot(table, table->oldTable, table->oldSize, table->migrated, key, h);
+		if (pos >= 0)
+			return &table->oldTable[pos];
 	}
-	return item;
+
+	return NULL;
 }
 
 void *WMHashGet(WMHashTable * table, const void *key)
@@ -207,32 +322,11 @@ Bool WMHashGetItemAndKey(WMHashTable * table, const void *key, void **retItem, v
 
 void *WMHashInsert(WMHashTable * table, const void *key, const void *data)
 {
-	unsigned h;
 	HashItem *item;
-	int replacing = 0;
-
-	h = HASH(table, key);
-	/* look for the entry */
-	item = table->table[h];
-	if (table->callbacks.keyIsEqual) {
-		while (item) {
-			if ((*table->callbacks.keyIsEqual) (key, item->key)) {
-				replacing = 1;
-				break;
-			}
-			item = item->next;
-		}
-	} else {
-		while (item) {
-			if (key == item->key) {
-				replacing = 1;
-				break;
-			}
-			item = item->next;
-		}
-	}
+	HashItem nitem;
 
-	if (replacing) {
+	item = hashGetItem(table, key);
+	if (item) {
 		const void *old;
 
 		old = item->data;
@@ -241,63 +335,69 @@ void *WMHashInsert(WMHashTable * table, const void *key, const void *data)
 		item->key = DUPKEY(table, key);
 
 		return (void *)old;
-	} else {
-		HashItem *nitem;
+	}
 
-		nitem = wmalloc(sizeof(HashItem));
-		nitem->key = DUPKEY(table, key);
-		nitem->data = data;
-		nitem->next = table->table[h];
-		table->table[h] = nitem;
+	/* keep the load under 3/4 */
+	if ((table->itemCount + 1) * 4 > table->size * 3)
+		growTable(table);
 
-		table->itemCount++;
-	}
+	nitem.key = DUPKEY(table, key);
+	nitem.data = data;
+	nitem.hash = hashKey(table, key);
+	placeItem(table->table, table->size, nitem);
 
-	/* OPTIMIZE: put this in an idle handler. */
-	if (table->itemCount > table->size) {
-#ifdef DEBUG0
-		printf("rebuilding hash table...\n");
-#endif
-		rebuildTable(table);
-#ifdef DEBUG0
-		printf("finished rebuild.\n");
-#endif
-	}
+	table->itemCount++;
+
+	migrateItems(table, MIGRATE_STEP);
 
 	return NULL;
 }
 
-static HashItem *deleteFromList(HashTable * table, HashItem * item, const void *key)
+void WMHashRemove(WMHashTable * table, const void *key)
 {
-	HashItem *next;
+	unsigned h;
+	long pos;
 
-	if (item == NULL)
-		return NULL;
+	/* items cannot be taken out of the old slots, so finish moving them */
+	migrateItems(table, table->oldSize);
 
-	if ((table->callbacks.keyIsEqual && (*table->callbacks.keyIsEqual) (key, item->key))
-	    || (!table->callbacks.keyIsEqual && key == item->key)) {
+	h = hashKey(table, key);
+	pos = findSlot(table, table->table, table->size, 0, key, h);
+	if (pos < 0)
+		return;
 
-		next = item->next;
-		RELKEY(table, item->key);
-		wfree(item);
+	RELKEY(table, table->table[pos].key);
+	removeSlot(table->table, table->size, pos);
 
-		table->itemCount--;
+	table->itemCount--;
+}
 
-		return next;
-	}
+/*
+ * The enumerator index runs over the old slots still in use, if the table
+ * is growing, then over the slots of the table.
+ */
+static HashItem *nextEnumeratorItem(WMHashEnumerator *enumerator)
+{
+	HashTable *table = enumerator->table;
+	HashItem *item;
+	unsigned i;
 
-	item->next = deleteFromList(table, item->next, key);
+	/* this assumes the table doesn't change between
+	 * WMEnumerateHashTable() and WMNextHashEnumerator*() calls */
 
-	return item;
-}
+	while ((i = enumerator->index) < table->oldSize + table->size) {
+		enumerator->index++;
 
-void WMHashRemove(WMHashTable * table, const void *key)
-{
-	unsigned h;
+		if (i < table->oldSize)
+			item = &table->oldTable[i];
+		else
+			item = &table->table[i - table->oldSize];
 
-	h = HASH(table, key);
+		if (item->hash)
+			return item;
+	}
 
-	table->table[h] = deleteFromList(table, table->table[h], key);
+	return NULL;
 }
 
 WMHashEnumerator WMEnumerateHashTable(WMHashTable * table)
@@ -305,88 +405,48 @@ WMHashEnumerator WMEnumerateHashTable(WMHashTable * table)
 	WMHashEnumerator enumerator;
 
 	enumerator.table = table;
-	enumerator.index = 0;
-	enumerator.nextItem = table->table[0];
+	enumerator.index = table->oldTable ? table->migrated : 0;
+	enumerator.nextItem = NULL;
 
 	return enumerator;
 }
 
 void *WMNextHashEnumeratorItem(WMHashEnumerator * enumerator)
 {
-	const void *data = NULL;
-
-	/* this assumes the table doesn't change between
-	 * WMEnumerateHashTable() and WMNextHashEnumeratorItem() calls */
-
-	if (enumerator->nextItem == NULL) {
-		HashTable *table = enumerator->table;
-		while (++enumerator->index < table->size) {
-			if (table->table[enumerator->index] != NULL) {
-				enumerator->nextItem = table->table[enumerator->index];
-				break;
-			}
-		}
-	}
+	HashItem *item;
 
-	if (enumerator->nextItem) {
-		data = ((HashItem *) enumerator->nextItem)->data;
-		enumerator->nextItem = ((HashItem *) enumerator->nextItem)->next;
-	}
+	item = nextEnumeratorItem(enumerator);
+	if (!item)
+		return NULL;
 
-	return (void *)data;
+	return (void *)item->data;
 }
 
 void *WMNextHashEnumeratorKey(WMHashEnumerator * enumerator)
 {
-	const void *key = NULL;
-
-	/* this assumes the table doesn't change between
-	 * WMEnumerateHashTable() and WMNextHashEnumeratorKey() calls */
-
-	if (enumerator->nextItem == NULL) {
-		HashTable *table = enumerator->table;
-		while (++enumerator->index < table->size) {
-			if (table->table[enumerator->index] != NULL) {
-				enumerator->nextItem = table->table[enumerator->index];
-				break;
-			}
-		}
-	}
+	HashItem *item;
 
-	if (enumerator->nextItem) {
-		key = ((HashItem *) enumerator->nextItem)->key;
-		enumerator->nextItem = ((HashItem *) enumerator->nextItem)->next;
-	}
+	item = nextEnumeratorItem(enumerator);
+	if (!item)
+		return NULL;
 
-	return (void *)key;
+	return (void *)item->key;
 }
 
 Bool WMNextHashEnumeratorItemAndKey(WMHashEnumerator * enumerator, void **item, void **key)
 {
-	/* this assumes the table doesn't change between
-	 * WMEnumerateHashTable() and WMNextHashEnumeratorItemAndKey() calls */
-
-	if (enumerator->nextItem == NULL) {
-		HashTable *table = enumerator->table;
-		while (++enumerator->index < table->size) {
-			if (table->table[enumerator->index] != NULL) {
-				enumerator->nextItem = table->table[enumerator->index];
-				break;
-			}
-		}
-	}
+	HashItem *hitem;
 
-	if (enumerator->nextItem) {
-		if (item)
-			*item = (void *)((HashItem *) enumerator->nextItem)->data;
-		if (key)
-			*key = (void *)((HashItem *) enumerator->nextItem)->key;
-		enumerator->nextItem = ((HashItem *) enumerator->nextItem)->next;
+	hitem = nextEnumeratorItem(enumerator);
+	if (!hitem)
+		return False;
 
-		return True;
-	}
+	if (item)
+		*item = (void *)hitem->data;
+	if (key)
+		*key = (void *)hitem->key;
 
-	return False;
+	return True;
 }
 
 static Bool compareStrings(const void *param1, const void *param2)
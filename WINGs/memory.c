@@ -220,3 +220,155 @@ void wrelease(void *ptr)
 #endif
 	}
 }
+
+/*
+ * Arenas hand out memory from large blocks, for data with a bounded
+ * lifetime such as the scratch buffers of a parse. The allocations are
+ * not freed one by one: the whole arena is reset or freed at once, and
+ * what must outlive it is copied out with WMArenaPromote().
+ */
+
+#define ARENA_ALIGN		(2 * sizeof(void *))
+#define ARENA_ROUND(size)	(((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_HEADER		ARENA_ROUND(sizeof(ArenaBlock))
+
+typedef struct ArenaBlock {
+	struct ArenaBlock *next;
+	size_t size;		/* usable bytes after the header */
+	size_t used;
+} ArenaBlock;
+
+struct W_Arena {
+	ArenaBlock *blocks;	/* the block being filled comes first */
+	size_t blockSize;
+
+	WMArenaStatistics stats;
+};
+
+static ArenaBlock *newArenaBlock(WMArena *arena, size_t size)
+{
+	ArenaBlock *block;
+
+	/* the memory is handed out as is, so do not pay for wmalloc() clearing it */
+#ifdef USE_BOEHM_GC
+	block = GC_MALLOC(ARENA_HEADER + size);
+#else
+	block = malloc(ARENA_HEADER + size);
+#endif
+	if (!block)
+		block = wmalloc(ARENA_HEADER + size);
+
+	block->size = size;
+	block->used = 0;
+	arena->stats.reserved += size;
+
+	return block;
+}
+
+WMArena *WMCreateArena(size_t blockSize)
+{
+	WMArena *arena;
+
+	arena = wmalloc(sizeof(WMArena));
+	arena->blockSize = ARENA_ROUND(blockSize > 0 ? blockSize : 8192);
+
+	return arena;
+}
+
+void *WMArenaAlloc(WMArena *arena, size_t size)
+{
+	ArenaBlock *block = arena->blocks;
+	void *ptr;
+
+	size = ARENA_ROUND(size > 0 ? size : 1);
+
+	if (!block || block->size - block->used < size) {
+		if (size > arena->blockSize / 4) {
+			/* big requests get a block of their own, keep filling the current one */
+			block = newArenaBlock(arena, size);
+			if (arena->blocks) {
+				block->next = arena->blocks->next;
+				arena->blocks->next = block;
+			} else {
+				block->next = NULL;
+				arena->blocks = block;
+			}
+		} else {
+			block = newArenaBlock(arena, arena->blockSize);
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+	}
+
+	ptr = (char *)block + ARENA_HEADER + block->used;
+	block->used += size;
+
+	arena->stats.allocations++;
+	arena->stats.bytes += size;
+	arena->stats.inUse += size;
+	if (arena->stats.inUse > arena->stats.peak)
+		arena->stats.peak = arena->stats.inUse;
+
+	return ptr;
+}
+
+char *WMArenaStrndup(WMArena *arena, const char *str, size_t len)
+{
+	char *copy;
+
+	copy = WMArenaAlloc(arena, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = 0;
+
+	return copy;
+}
+
+void *WMArenaPromote(WMArena *arena, const void *ptr, size_t size)
+{
+	void *copy;
+
+	copy = wmalloc(size);
+	memcpy(copy, ptr, size);
+	arena->stats.promoted++;
+
+	return copy;
+}
+
+void WMResetArena(WMArena *arena)
+{
+	ArenaBlock *block, *next;
+
+	block = arena->blocks;
+	arena->blocks = NULL;
+
+	/* keep one block around, the arena is likely to be filled again */
+	for (; block; block = next) {
+		next = block->next;
+		if (!arena->blocks && block->size == arena->blockSize) {
+			block->used = 0;
+			block->next = NULL;
+			arena->blocks = block;
+		} else {
+			arena->stats.reserved -= block->size;
+			wfree(block);
+		}
+	}
+
+	arena->stats.inUse = 0;
+}
+
+void WMFreeArena(WMArena *arena)
+{
+	ArenaBlock *block, *next;
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		wfree(block);
+	}
+	wfree(arena);
+}
+
+void WMGetArenaStatistics(WMArena *arena, WMArenaStatistics *stats)
+{
+	*stats = arena->stats;
+}
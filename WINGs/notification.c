@@ -1,6 +1,5 @@
 
 #include <stdlib.h>
-#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -62,22 +61,55 @@ WMNotification *WMRetainNotification(WMNotification * notification)
 
 /***************** Notification Center *****************/
 
+/*
+ * Notification names are interned when they are first seen, and each
+ * interned name keeps its observers in one list per observed object. A
+ * post then only visits the observers that will be notified.
+ *
+ * Observer lists are arrays. A removed observer leaves an empty slot,
+ * so the lists can be walked safely while observers are added or removed
+ * by the actions being called, and the slots are compacted once no post
+ * is walking the list.
+ */
+
+typedef struct NotificationName {
+	char *name;
+	WMHashTable *objects;	/* object -> ObserverList, NULL for any object */
+	unsigned observerCount;
+
+	/* statistics */
+	unsigned long posted;
+	unsigned long delivered;
+} NotificationName;
+
+typedef struct ObserverList {
+	struct NotificationObserver **items;
+	int count;		/* slots used, including emptied ones */
+	int size;
+	int removed;		/* slots emptied since the last compaction */
+	int posting;		/* number of posts walking the list */
+
+	WMHashTable *table;	/* the table holding the list, and its key */
+	const void *key;
+} ObserverList;
+
 typedef struct NotificationObserver {
 	WMNotificationObserverAction *observerAction;
 	void *observer;
 
-	const char *name;
+	NotificationName *name;
 	void *object;
 
-	struct NotificationObserver *prev;	/* for tables */
-	struct NotificationObserver *next;
+	ObserverList *list;
+	int slot;		/* index in list->items */
+
 	struct NotificationObserver *nextAction;	/* for observerTable */
 } NotificationObserver;
 
 typedef struct W_NotificationCenter {
-	WMHashTable *nameTable;	/* names -> observer lists */
-	WMHashTable *objectTable;	/* object -> observer lists */
-	NotificationObserver *nilList;	/* obervers that catch everything */
+	WMHashTable *nameTable;	/* names -> NotificationName */
+	WMHashTable *objectTable;	/* object -> observers of any name */
+	ObserverList *nilList;	/* obervers that catch everything */
 
 	WMHashTable *observerTable;	/* observer -> NotificationObserver */
 } NotificationCenter;
@@ -85,24 +117,160 @@ typedef struct W_NotificationCenter {
 /* default (and only) center */
 static NotificationCenter *notificationCenter = NULL;
 
+static NotificationName *internName(const char *name)
+{
+	NotificationName *entry;
+
+	entry = WMHashGet(notificationCenter->nameTable, name);
+	if (!entry) {
+		entry = wmalloc(sizeof(NotificationName));
+		entry->name = wstrdup(name);
+		entry->objects = WMCreateHashTable(WMIntHashCallbacks);
+		WMHashInsert(notificationCenter->nameTable, entry->name, entry);
+	}
+
+	return entry;
+}
+
+static ObserverList *createList(WMHashTable *table, const void *key)
+{
+	ObserverList *list;
+
+	list = wmalloc(sizeof(ObserverList));
+	list->table = table;
+	list->key = key;
+	if (table)
+		WMHashInsert(table, key, list);
+
+	return list;
+}
+
+static void freeList(ObserverList *list)
+{
+	if (list->items)
+		wfree(list->items);
+	wfree(list);
+}
+
+static void addToList(ObserverList *list, NotificationObserver *oRec)
+{
+	if (list->count == list->size) {
+		list->size = list->size ? list->size * 2 : 4;
+		list->items = wrealloc(list->items, list->size * sizeof(NotificationObserver *));
+	}
+
+	oRec->list = list;
+	oRec->slot = list->count;
+	list->items[list->count++] = oRec;
+}
+
+/* Drops the emptied slots, and the list itself once it has no observer left */
+static void compactList(ObserverList *list)
+{
+	int i, j;
+
+	if (list->posting > 0 || list->removed == 0)
+		return;
+
+	for (i = 0, j = 0; i < list->count; i++) {
+		if (list->items[i]) {
+			list->items[j] = list->items[i];
+			list->items[j]->slot = j;
+			j++;
+		}
+	}
+	list->count = j;
+	list->removed = 0;
+
+	if (list->count == 0 && list->table) {
+		WMHashRemove(list->table, list->key);
+		freeList(list);
+	}
+}
+
+static void removeFromList(NotificationObserver *oRec)
+{
+	ObserverList *list = oRec->list;
+
+	list->items[oRec->slot] = NULL;
+	list->removed++;
+
+	if (list->removed * 2 >= list->count)
+		compactList(list);
+}
+
+static void releaseObserver(NotificationObserver *oRec)
+{
+	if (oRec->name)
+		oRec->name->observerCount--;
+
+	removeFromList(oRec);
+	wfree(oRec);
+}
+
 void W_InitNotificationCenter(void)
 {
 	notificationCenter = wmalloc(sizeof(NotificationCenter));
 	notificationCenter->nameTable = WMCreateHashTable(WMStringPointerHashCallbacks);
 	notificationCenter->objectTable = WMCreateHashTable(WMIntHashCallbacks);
-	notificationCenter->nilList = NULL;
+	notificationCenter->nilList = createList(NULL, NULL);
 	notificationCenter->observerTable = WMCreateHashTable(WMIntHashCallbacks);
 }
 
+void W_PrintNotificationStatistics(void)
+{
+	WMHashEnumerator e;
+	NotificationName *entry;
+
+	if (!notificationCenter)
+		return;
+
+	printf("%-48s %10s %10s %9s\n", "notification", "posted", "delivered", "observers");
+
+	e = WMEnumerateHashTable(notificationCenter->nameTable);
+	while ((entry = WMNextHashEnumeratorItem(&e)) != NULL) {
+		printf("%-48s %10lu %10lu %9u\n", entry->name,
+		       entry->posted, entry->delivered, entry->observerCount);
+	}
+}
+
 void W_ReleaseNotificationCenter(void)
 {
+	WMHashEnumerator e, e2;
+	NotificationObserver *oRec, *tmp;
+	NotificationName *entry;
+	ObserverList *list;
+
 	if (notificationCenter) {
-		if (notificationCenter->nameTable)
-			WMFreeHashTable(notificationCenter->nameTable);
-		if (notificationCenter->objectTable)
-			WMFreeHashTable(notificationCenter->objectTable);
-		if (notificationCenter->observerTable)
-			WMFreeHashTable(notificationCenter->observerTable);
+#ifdef DEBUG
+		W_PrintNotificationStatistics();
+#endif
+		e = WMEnumerateHashTable(notificationCenter->observerTable);
+		while ((oRec = WMNextHashEnumeratorItem(&e)) != NULL) {
+			for (; oRec; oRec = tmp) {
+				tmp = oRec->nextAction;
+				wfree(oRec);
+			}
+		}
+		WMFreeHashTable(notificationCenter->observerTable);
+
+		e = WMEnumerateHashTable(notificationCenter->nameTable);
+		while ((entry = WMNextHashEnumeratorItem(&e)) != NULL) {
+			e2 = WMEnumerateHashTable(entry->objects);
+			while ((list = WMNextHashEnumeratorItem(&e2)) != NULL)
+				freeList(list);
+			WMFreeHashTable(entry->objects);
+			wfree(entry->name);
+			wfree(entry);
+		}
+		WMFreeHashTable(notificationCenter->nameTable);
+
+		e = WMEnumerateHashTable(notificationCenter->objectTable);
+		while ((list = WMNextHashEnumeratorItem(&e)) != NULL)
+			freeList(list);
+		WMFreeHashTable(notificationCenter->objectTable);
+
+		freeList(notificationCenter->nilList);
 
 		wfree(notificationCenter);
 		notificationCenter = NULL;
@@ -113,161 +281,163 @@ void
 WMAddNotificationObserver(WMNotificationObserverAction * observerAction,
 			  void *observer, const char *name, void *object)
 {
-	NotificationObserver *oRec, *rec;
+	NotificationObserver *oRec;
+	ObserverList *list;
 
 	oRec = wmalloc(sizeof(NotificationObserver));
 	oRec->observerAction = observerAction;
 	oRec->observer = observer;
-	oRec->name = name;
 	oRec->object = object;
-	oRec->next = NULL;
-	oRec->prev = NULL;
 
 	/* put this action in the list of actions for this observer */
-	rec = (NotificationObserver *) WMHashInsert(notificationCenter->observerTable, observer, oRec);
-
-	if (rec) {
-		/* if this is not the first action for the observer */
-		oRec->nextAction = rec;
-	} else {
-		oRec->nextAction = NULL;
-	}
+	oRec->nextAction = WMHashInsert(notificationCenter->observerTable, observer, oRec);
 
 	if (!name && !object) {
 		/* catch-all */
-		oRec->next = notificationCenter->nilList;
-		if (notificationCenter->nilList) {
-			notificationCenter->nilList->prev = oRec;
-		}
-		notificationCenter->nilList = oRec;
+		list = notificationCenter->nilList;
 	} else if (!name) {
 		/* any message coming from object */
-		rec = (NotificationObserver *) WMHashInsert(notificationCenter->objectTable, object, oRec);
-		oRec->next = rec;
-		if (rec) {
-			rec->prev = oRec;
-		}
+		list = WMHashGet(notificationCenter->objectTable, object);
+		if (!list)
+			list = createList(notificationCenter->objectTable, object);
 	} else {
 		/* name && (object || !object) */
-		rec = (NotificationObserver *) WMHashInsert(notificationCenter->nameTable, name, oRec);
-		oRec->next = rec;
-		if (rec) {
-			rec->prev = oRec;
+		oRec->name = internName(name);
+		oRec->name->observerCount++;
+
+		list = WMHashGet(oRec->name->objects, object);
+		if (!list)
+			list = createList(oRec->name->objects, object);
+	}
+
+	addToList(list, oRec);
+}
+
+/*
+ * Calls the observers in the list, the most recently added first. The
+ * ones added while doing so are not called.
+ */
+static void postToList(ObserverList *list, WMNotification *notification, NotificationName *entry)
+{
+	NotificationObserver *oRec;
+	int i;
+
+	list->posting++;
+
+	for (i = list->count - 1; i >= 0; i--) {
+		oRec = list->items[i];
+		if (oRec && oRec->observerAction) {
+			if (entry)
+				entry->delivered++;
+			(*oRec->observerAction) (oRec->observer, notification);
 		}
 	}
+
+	list->posting--;
+	if (list->removed * 2 >= list->count)
+		compactList(list);
 }
 
-void WMPostNotification(WMNotification * notification)
+static Bool isObserved(NotificationName *entry, void *object)
 {
-	NotificationObserver *orec, *tmp;
+	if (notificationCenter->nilList->count > notificationCenter->nilList->removed)
+		return True;
 
-	WMRetainNotification(notification);
+	if (entry->observerCount > 0)
+		return True;
 
-	/* tell the observers that want to know about a particular message */
-	orec = (NotificationObserver *) WMHashGet(notificationCenter->nameTable, notification->name);
+	return object && WMHashGet(notificationCenter->objectTable, object) != NULL;
+}
 
-	while (orec) {
-		tmp = orec->next;
+static void postNotification(NotificationName *entry, WMNotification *notification)
+{
+	ObserverList *list;
 
-		if (!orec->object || !notification->object || orec->object == notification->object) {
-			/* tell the observer */
-			if (orec->observerAction) {
-				(*orec->observerAction) (orec->observer, notification);
+	WMRetainNotification(notification);
+
+	/* tell the observers that want to know about a particular message */
+	if (entry->observerCount > 0) {
+		if (notification->object) {
+			list = WMHashGet(entry->objects, notification->object);
+			if (list)
+				postToList(list, notification, entry);
+
+			list = WMHashGet(entry->objects, NULL);
+			if (list)
+				postToList(list, notification, entry);
+		} else {
+			/* no object given, every observer of the name is interested */
+			WMHashEnumerator e;
+			ObserverList **lists;
+			int i, count;
+
+			/* the actions may add observers, so do not walk the table itself */
+			lists = wmalloc(WMCountHashTable(entry->objects) * sizeof(ObserverList *));
+			count = 0;
+			e = WMEnumerateHashTable(entry->objects);
+			while ((list = WMNextHashEnumeratorItem(&e)) != NULL) {
+				list->posting++;
+				lists[count++] = list;
 			}
+			for (i = 0; i < count; i++) {
+				lists[i]->posting--;
+				postToList(lists[i], notification, entry);
+			}
+			wfree(lists);
 		}
-
-		orec = tmp;
 	}
 
 	/* tell the observers that want to know about an object */
-	orec = (NotificationObserver *) WMHashGet(notificationCenter->objectTable, notification->object);
-
-	while (orec) {
-		tmp = orec->next;
-
-		/* tell the observer */
-		if (orec->observerAction) {
-			(*orec->observerAction) (orec->observer, notification);
-		}
-		orec = tmp;
+	if (notification->object) {
+		list = WMHashGet(notificationCenter->objectTable, notification->object);
+		if (list)
+			postToList(list, notification, NULL);
 	}
 
 	/* tell the catch all observers */
-	orec = notificationCenter->nilList;
-	while (orec) {
-		tmp = orec->next;
-
-		/* tell the observer */
-		if (orec->observerAction) {
-			(*orec->observerAction) (orec->observer, notification);
-		}
-		orec = tmp;
-	}
+	postToList(notificationCenter->nilList, notification, NULL);
 
 	WMReleaseNotification(notification);
 }
 
+void WMPostNotification(WMNotification * notification)
+{
+	NotificationName *entry;
+
+	entry = internName(notification->name);
+	entry->posted++;
+
+	if (isObserved(entry, notification->object))
+		postNotification(entry, notification);
+}
+
 void WMRemoveNotificationObserver(void *observer)
 {
-	NotificationObserver *orec, *tmp, *rec;
+	NotificationObserver *orec, *tmp;
 
 	/* get the list of actions the observer is doing */
 	orec = (NotificationObserver *) WMHashGet(notificationCenter->observerTable, observer);
 
-	/*
-	 * FOREACH orec IN actionlist for observer
-	 * DO
-	 *   remove from respective lists/tables
-	 *   free
-	 * END
-	 */
+	WMHashRemove(notificationCenter->observerTable, observer);
+
 	while (orec) {
 		tmp = orec->nextAction;
-
-		if (!orec->name && !orec->object) {
-			/* catch-all */
-			if (notificationCenter->nilList == orec)
-				notificationCenter->nilList = orec->next;
-		} else if (!orec->name) {
-			/* any message coming from object */
-			rec = (NotificationObserver *) WMHashGet(notificationCenter->objectTable, orec->object);
-			if (rec == orec) {
-				/* replace table entry */
-				if (orec->next) {
-					WMHashInsert(notificationCenter->objectTable, orec->object, orec->next);
-				} else {
-					WMHashRemove(notificationCenter->objectTable, orec->object);
-				}
-			}
-		} else {
-			/* name && (object || !object) */
-			rec = (NotificationObserver *) WMHashGet(notificationCenter->nameTable, orec->name);
-			if (rec == orec) {
-				/* replace table entry */
-				if (orec->next) {
-					WMHashInsert(notificationCenter->nameTable, orec->name, orec->next);
-				} else {
-					WMHashRemove(notificationCenter->nameTable, orec->name);
-				}
-			}
-		}
-		if (orec->prev)
-			orec->prev->next = orec->next;
-		if (orec->next)
-			orec->next->prev = orec->prev;
-
-		wfree(orec);
-
+		releaseObserver(orec);
 		orec = tmp;
 	}
-
-	WMHashRemove(notificationCenter->observerTable, observer);
 }
 
 void WMRemoveNotificationObserverWithName(void *observer, const char *name, void *object)
 {
-	NotificationObserver *orec, *tmp, *rec;
-	NotificationObserver *newList = NULL;
+	NotificationObserver *orec, *tmp;
+	NotificationObserver *newList = NULL, *last = NULL;
+	NotificationName *entry = NULL;
+
+	if (name) {
+		entry = WMHashGet(notificationCenter->nameTable, name);
+		if (!entry)
+			return;
+	}
 
 	/* get the list of actions the observer is doing */
 	orec = (NotificationObserver *) WMHashGet(notificationCenter->observerTable, observer);
@@ -275,61 +445,18 @@ void WMRemoveNotificationObserverWithName(void *observer, const char *name, void
 	WMHashRemove(notificationCenter->observerTable, observer);
 
 	/* rebuild the list of actions for the observer */
-
 	while (orec) {
 		tmp = orec->nextAction;
-		if (orec->name == name && orec->object == object) {
-			if (!name && !object) {
-				if (notificationCenter->nilList == orec)
-					notificationCenter->nilList = orec->next;
-			} else if (!name) {
-				rec =
-				    (NotificationObserver *) WMHashGet(notificationCenter->objectTable,
-								       orec->object);
-				if (rec == orec) {
-					assert(rec->prev == NULL);
-					/* replace table entry */
-					if (orec->next) {
-						WMHashInsert(notificationCenter->objectTable,
-							     orec->object, orec->next);
-					} else {
-						WMHashRemove(notificationCenter->objectTable, orec->object);
-					}
-				}
-			} else {
-				rec = (NotificationObserver *) WMHashGet(notificationCenter->nameTable,
-									 orec->name);
-				if (rec == orec) {
-					assert(rec->prev == NULL);
-					/* replace table entry */
-					if (orec->next) {
-						WMHashInsert(notificationCenter->nameTable,
-							     orec->name, orec->next);
-					} else {
-						WMHashRemove(notificationCenter->nameTable, orec->name);
-					}
-				}
-			}
-
-			if (orec->prev)
-				orec->prev->next = orec->next;
-			if (orec->next)
-				orec->next->prev = orec->prev;
-			wfree(orec);
+		if (orec->name == entry && orec->object == object) {
+			releaseObserver(orec);
 		} else {
 			/* append this action in the new action list */
 			orec->nextAction = NULL;
-			if (!newList) {
+			if (last)
+				last->nextAction = orec;
+			else
 				newList = orec;
-			} else {
-				NotificationObserver *p;
-
-				p = newList;
-				while (p->nextAction) {
-					p = p->nextAction;
-				}
-				p->nextAction = orec;
-			}
+			last = orec;
 		}
 		orec = tmp;
 	}
@@ -343,10 +470,18 @@ void WMRemoveNotificationObserverWithName(void *observer, const char *name, void
 void WMPostNotificationName(const char *name, void *object, void *clientData)
 {
 	WMNotification *notification;
+	NotificationName *entry;
+
+	entry = internName(name);
+	entry->posted++;
+
+	/* do not bother creating the notification if nobody listens */
+	if (!isObserved(entry, object))
+		return;
 
 	notification = WMCreateNotification(name, object, clientData);
 
-	WMPostNotification(notification);
+	postNotification(entry, notification);
 
 	WMReleaseNotification(notification);
 }
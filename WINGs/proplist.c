@@ -4,6 +4,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <ftw.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -40,13 +41,9 @@ typedef struct PLData {
 	int pos;
 	const char *filename;
 	int lineNumber;
+	WMArena *arena;		/* scratch memory for the parse */
 } PLData;
 
-typedef struct StringBuffer {
-	char *str;
-	int size;
-} StringBuffer;
-
 static unsigned hashPropList(const void *param);
 static WMPropList *getPLString(PLData * pldata);
 static WMPropList *getPLQString(PLData * pldata);
@@ -67,7 +64,6 @@ static const WMHashTableCallbacks WMPropListHashCallbacks = {
 static Bool caseSensitive = True;
 
 #define BUFFERSIZE           8192
-#define BUFFERSIZE_INCREMENT 1024
 
 #if 0
 # define DPUT(s) puts(s)
@@ -83,12 +79,6 @@ static Bool caseSensitive = True;
 #define ISSTRINGABLE(c) (isalnum(c) || (c)=='.' || (c)=='_' || (c)=='/' \
     || (c)=='+')
 
-#define CHECK_BUFFER_SIZE(buf, ptr) \
-    if ((ptr) >= (buf).size-1) {\
-    (buf).size += BUFFERSIZE_INCREMENT;\
-    (buf).str = wrealloc((buf).str, (buf).size);\
-    }
-
 #define inrange(ch, min, max) ((ch)>=(min) && (ch)<=(max))
 #define noquote(ch) (inrange(ch, 'a', 'z') || inrange(ch, 'A', 'Z') || inrange(ch, '0', '9') || ((ch)=='_') || ((ch)=='.') || ((ch)=='$'))
 #define charesc(ch) (inrange(ch, 0x07, 0x0c) || ((ch)=='"') || ((ch)=='\\'))
@@ -220,247 +210,334 @@ static void releasePropListByCount(WMPropList * plist, int count)
 	}
 }
 
-static char *dataDescription(WMPropList * plist)
+/*
+ * Descriptions are produced through a writer, which appends them to a
+ * string, writes them to a file, or compares them with the contents of a
+ * file, so a property list can be saved without building its whole
+ * description in memory first.
+ */
+typedef struct PLWriter {
+	FILE *file;		/* file to write to, or */
+	FILE *compare;		/* file to compare with, or else a string */
+
+	char *str;
+	size_t length;
+	size_t size;
+
+	Bool differs;		/* for compare */
+	Bool failed;
+} PLWriter;
+
+static void plWrite(PLWriter *w, const char *data, size_t length)
+{
+	if (w->failed || w->differs || length == 0)
+		return;
+
+	if (w->file) {
+		if (fwrite(data, 1, length, w->file) != length)
+			w->failed = True;
+	} else if (w->compare) {
+		char buf[512];
+		size_t n;
+
+		while (length > 0) {
+			n = length < sizeof(buf) ? length : sizeof(buf);
+			if (fread(buf, 1, n, w->compare) != n || memcmp(buf, data, n) != 0) {
+				w->differs = True;
+				return;
+			}
+			data += n;
+			length -= n;
+		}
+	} else {
+		if (w->length + length + 1 > w->size) {
+			while (w->length + length + 1 > w->size)
+				w->size = w->size ? w->size * 2 : 256;
+			w->str = wrealloc(w->str, w->size);
+		}
+		memcpy(w->str + w->length, data, length);
+		w->length += length;
+		w->str[w->length] = 0;
+	}
+}
+
+static void plWriteIndent(PLWriter *w, int level)
+{
+	static const char spaces[] = "                                ";
+	int n = 2 * level;
+
+	while (n > 0) {
+		plWrite(w, spaces, n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1);
+		n -= sizeof(spaces) - 1;
+	}
+}
+
+#define plWriteLiteral(w, s) plWrite(w, s, sizeof(s) - 1)
+
+static void writeData(PLWriter *w, WMPropList *plist)
 {
 	const unsigned char *data;
-	char *retVal;
+	char buf[128];
 	int i, j, length;
 
 	data = WMDataBytes(plist->d.data);
 	length = WMGetDataLength(plist->d.data);
 
-	retVal = (char *)wmalloc(2 * length + length / 4 + 3);
-
-	retVal[0] = '<';
+	buf[0] = '<';
 	for (i = 0, j = 1; i < length; i++) {
-		retVal[j++] = num2char((data[i] >> 4) & 0x0f);
-		retVal[j++] = num2char(data[i] & 0x0f);
+		buf[j++] = num2char((data[i] >> 4) & 0x0f);
+		buf[j++] = num2char(data[i] & 0x0f);
 		if ((i & 0x03) == 3 && i != length - 1) {
 			/* if we've just finished a 32-bit int, add a space */
-			retVal[j++] = ' ';
+			buf[j++] = ' ';
+		}
+		if (j > sizeof(buf) - 4) {
+			plWrite(w, buf, j);
+			j = 0;
 		}
 	}
-	retVal[j++] = '>';
-	retVal[j] = '\0';
-
-	return retVal;
+	buf[j++] = '>';
+	plWrite(w, buf, j);
 }
 
-static char *stringDescription(WMPropList * plist)
+/* Length of the description of the string, and whether it must be quoted */
+static int stringLength(const char *str, Bool *quote)
 {
-	const char *str;
-	char *retVal, *sPtr, *dPtr;
-	int len, quote;
 	unsigned char ch;
+	int len = 0;
 
-	str = plist->d.string;
-
-	if (strlen(str) == 0) {
-		return wstrdup("\"\"");
-	}
-
-	/* FIXME: make this work with unichars. */
-
-	quote = 0;
-	sPtr = (char *)str;
-	len = 0;
-	while ((ch = *sPtr)) {
+	*quote = False;
+	for (; (ch = *str); str++) {
 		if (!noquote(ch)) {
-			quote = 1;
+			*quote = True;
 			if (charesc(ch))
 				len++;
 			else if (numesc(ch))
 				len += 3;
 		}
-		sPtr++;
 		len++;
 	}
 
-	if (quote)
-		len += 2;
+	return *quote ? len + 2 : len;
+}
 
-	retVal = (char *)wmalloc(len + 1);
+static void writeString(PLWriter *w, WMPropList *plist)
+{
+	const char *str;
+	char buf[128];
+	unsigned char ch;
+	Bool quote;
+	int j = 0;
 
-	sPtr = (char *)str;
-	dPtr = retVal;
+	str = plist->d.string;
+
+	if (*str == 0) {
+		plWriteLiteral(w, "\"\"");
+		return;
+	}
+
+	/* FIXME: make this work with unichars. */
+
+	stringLength(str, &quote);
 
 	if (quote)
-		*dPtr++ = '"';
+		buf[j++] = '"';
 
-	while ((ch = *sPtr)) {
+	for (; (ch = *str); str++) {
 		if (charesc(ch)) {
-			*(dPtr++) = '\\';
+			buf[j++] = '\\';
 			switch (ch) {
 			case '\a':
-				*dPtr = 'a';
+				buf[j++] = 'a';
 				break;
 			case '\b':
-				*dPtr = 'b';
+				buf[j++] = 'b';
 				break;
 			case '\t':
-				*dPtr = 't';
+				buf[j++] = 't';
 				break;
 			case '\n':
-				*dPtr = 'n';
+				buf[j++] = 'n';
 				break;
 			case '\v':
-				*dPtr = 'v';
+				buf[j++] = 'v';
 				break;
 			case '\f':
-				*dPtr = 'f';
+				buf[j++] = 'f';
 				break;
 			default:
-				*dPtr = ch;	/* " or \ */
+				buf[j++] = ch;	/* " or \ */
 			}
 		} else if (numesc(ch)) {
-			*(dPtr++) = '\\';
-			*(dPtr++) = '0' + ((ch >> 6) & 07);
-			*(dPtr++) = '0' + ((ch >> 3) & 07);
-			*dPtr = '0' + (ch & 07);
+			buf[j++] = '\\';
+			buf[j++] = '0' + ((ch >> 6) & 07);
+			buf[j++] = '0' + ((ch >> 3) & 07);
+			buf[j++] = '0' + (ch & 07);
 		} else {
-			*dPtr = ch;
+			buf[j++] = ch;
+		}
+		if (j > sizeof(buf) - 5) {
+			plWrite(w, buf, j);
+			j = 0;
 		}
-		sPtr++;
-		dPtr++;
 	}
 
 	if (quote)
-		*dPtr++ = '"';
+		buf[j++] = '"';
+
+	plWrite(w, buf, j);
+}
 
-	*dPtr = '\0';
+/*
+ * Length of the description of plist, as written by writeDescription();
+ * the computation stops as soon as it goes over limit.
+ */
+static int descriptionLength(WMPropList *plist, int limit)
+{
+	WMPropList *key, *val;
+	WMHashEnumerator e;
+	Bool quote;
+	int i, len, count;
 
-	return retVal;
+	switch (plist->type) {
+	case WPLString:
+		if (*plist->d.string == 0)
+			return 2;
+		return stringLength(plist->d.string, &quote);
+	case WPLData:
+		len = WMGetDataLength(plist->d.data);
+		return 2 + 2 * len + (len > 0 ? (len - 1) / 4 : 0);
+	case WPLArray:
+		count = WMGetArrayItemCount(plist->d.array);
+		len = 2 + (count > 0 ? 2 * (count - 1) : 0);
+		for (i = 0; i < count && len <= limit; i++)
+			len += descriptionLength(WMGetFromArray(plist->d.array, i), limit - len);
+		return len;
+	case WPLDictionary:
+		len = 2;
+		e = WMEnumerateHashTable(plist->d.dict);
+		while (len <= limit && WMNextHashEnumeratorItemAndKey(&e, (void **)&val, (void **)&key)) {
+			len += descriptionLength(key, limit - len) + 4;
+			len += descriptionLength(val, limit - len);
+		}
+		return len;
+	default:
+		return 0;
+	}
 }
 
-static char *description(WMPropList * plist)
+static void writeDescription(PLWriter *w, WMPropList *plist)
 {
 	WMPropList *key, *val;
-	char *retstr = NULL;
-	char *str, *tmp, *skey, *sval;
 	WMHashEnumerator e;
 	int i;
 
 	switch (plist->type) {
 	case WPLString:
-		retstr = stringDescription(plist);
+		writeString(w, plist);
 		break;
 	case WPLData:
-		retstr = dataDescription(plist);
+		writeData(w, plist);
 		break;
 	case WPLArray:
-		retstr = wstrdup("(");
+		plWriteLiteral(w, "(");
 		for (i = 0; i < WMGetArrayItemCount(plist->d.array); i++) {
-			str = description(WMGetFromArray(plist->d.array, i));
-			if (i == 0) {
-				retstr = wstrappend(retstr, str);
-			} else {
-				tmp = (char *)wmalloc(strlen(retstr) + strlen(str) + 3);
-				sprintf(tmp, "%s, %s", retstr, str);
-				wfree(retstr);
-				retstr = tmp;
-			}
-			wfree(str);
+			if (i > 0)
+				plWriteLiteral(w, ", ");
+			writeDescription(w, WMGetFromArray(plist->d.array, i));
 		}
-		retstr = wstrappend(retstr, ")");
+		plWriteLiteral(w, ")");
 		break;
 	case WPLDictionary:
-		retstr = wstrdup("{");
+		plWriteLiteral(w, "{");
 		e = WMEnumerateHashTable(plist->d.dict);
 		while (WMNextHashEnumeratorItemAndKey(&e, (void **)&val, (void **)&key)) {
-			skey = description(key);
-			sval = description(val);
-			tmp = (char *)wmalloc(strlen(retstr) + strlen(skey) + strlen(sval) + 5);
-			sprintf(tmp, "%s%s = %s;", retstr, skey, sval);
-			wfree(skey);
-			wfree(sval);
-			wfree(retstr);
-			retstr = tmp;
-		}
-		retstr = wstrappend(retstr, "}");
+			writeDescription(w, key);
+			plWriteLiteral(w, " = ");
+			writeDescription(w, val);
+			plWriteLiteral(w, ";");
+		}
+		plWriteLiteral(w, "}");
 		break;
 	default:
 		wwarning(_("Used proplist functions on non-WMPropLists objects"));
-		wassertrv(False, NULL);
+		w->failed = True;
 		break;
 	}
-
-	return retstr;
 }
 
-static char *indentedDescription(WMPropList * plist, int level)
+static void writeIndentedDescription(PLWriter *w, WMPropList *plist, int level)
 {
 	WMPropList *key, *val;
-	char *retstr = NULL;
-	char *str, *tmp, *skey, *sval;
 	WMHashEnumerator e;
-	int i;
-
-	if (plist->type == WPLArray /* || plist->type==WPLDictionary */ ) {
-		retstr = description(plist);
-
-		if (retstr && ((2 * (level + 1) + strlen(retstr)) <= 77)) {
-			return retstr;
-		} else if (retstr) {
-			wfree(retstr);
-			retstr = NULL;
+	int i, limit;
+
+	/* short arrays are kept on one line */
+	if (plist->type == WPLArray) {
+		limit = 77 - 2 * (level + 1);
+		if (limit >= 0 && descriptionLength(plist, limit) <= limit) {
+			writeDescription(w, plist);
+			return;
 		}
 	}
 
 	switch (plist->type) {
 	case WPLString:
-		retstr = stringDescription(plist);
+		writeString(w, plist);
 		break;
 	case WPLData:
-		retstr = dataDescription(plist);
+		writeData(w, plist);
 		break;
 	case WPLArray:
-		retstr = wstrdup("(\n");
+		plWriteLiteral(w, "(\n");
 		for (i = 0; i < WMGetArrayItemCount(plist->d.array); i++) {
-			str = indentedDescription(WMGetFromArray(plist->d.array, i), level + 1);
-			if (i == 0) {
-				tmp = (char *)wmalloc(2 * (level + 1) + strlen(retstr) + strlen(str) + 1);
-				sprintf(tmp, "%s%*s%s", retstr, 2 * (level + 1), "", str);
-				wfree(retstr);
-				retstr = tmp;
-			} else {
-				tmp = (char *)wmalloc(2 * (level + 1) + strlen(retstr) + strlen(str) + 3);
-				sprintf(tmp, "%s,\n%*s%s", retstr, 2 * (level + 1), "", str);
-				wfree(retstr);
-				retstr = tmp;
-			}
-			wfree(str);
+			if (i > 0)
+				plWriteLiteral(w, ",\n");
+			plWriteIndent(w, level + 1);
+			writeIndentedDescription(w, WMGetFromArray(plist->d.array, i), level + 1);
 		}
-		tmp = (char *)wmalloc(strlen(retstr) + 2 * level + 3);
-		sprintf(tmp, "%s\n%*s)", retstr, 2 * level, "");
-		wfree(retstr);
-		retstr = tmp;
+		plWriteLiteral(w, "\n");
+		plWriteIndent(w, level);
+		plWriteLiteral(w, ")");
 		break;
 	case WPLDictionary:
-		retstr = wstrdup("{\n");
+		plWriteLiteral(w, "{\n");
 		e = WMEnumerateHashTable(plist->d.dict);
 		while (WMNextHashEnumeratorItemAndKey(&e, (void **)&val, (void **)&key)) {
-			skey = indentedDescription(key, level + 1);
-			sval = indentedDescription(val, level + 1);
-			tmp = (char *)wmalloc(2 * (level + 1) + strlen(retstr) + strlen(skey)
-					      + strlen(sval) + 6);
-			sprintf(tmp, "%s%*s%s = %s;\n", retstr, 2 * (level + 1), "", skey, sval);
-			wfree(skey);
-			wfree(sval);
-			wfree(retstr);
-			retstr = tmp;
-		}
-		tmp = (char *)wmalloc(strlen(retstr) + 2 * level + 2);
-		sprintf(tmp, "%s%*s}", retstr, 2 * level, "");
-		wfree(retstr);
-		retstr = tmp;
+			plWriteIndent(w, level + 1);
+			writeIndentedDescription(w, key, level + 1);
+			plWriteLiteral(w, " = ");
+			writeIndentedDescription(w, val, level + 1);
+			plWriteLiteral(w, ";\n");
+		}
+		plWriteIndent(w, level);
+		plWriteLiteral(w, "}");
 		break;
 	default:
 		wwarning(_("Used proplist functions on non-WMPropLists objects"));
-		wassertrv(False, NULL);
+		w->failed = True;
 		break;
 	}
+}
+
+static char *description(WMPropList * plist, Bool indented)
+{
+	PLWriter w;
+
+	memset(&w, 0, sizeof(w));
+
+	if (indented)
+		writeIndentedDescription(&w, plist, 0);
+	else
+		writeDescription(&w, plist);
 
-	return retstr;
+	if (w.failed) {
+		if (w.str)
+			wfree(w.str);
+		return NULL;
+	}
+
+	return w.str ? w.str : wstrdup("");
 }
 
 static inline int getChar(PLData * pldata)
@@ -500,37 +577,31 @@ static inline int getNonSpaceChar(PLData * pldata)
 	return c;
 }
 
-static char *unescapestr(const char *src)
+/* Unescapes the length bytes at src into a string allocated in the arena */
+static char *unescapestr(WMArena *arena, const char *src, int length)
 {
-	char *dest = wmalloc(strlen(src) + 1);
+	const char *end = src + length;
+	char *dest = WMArenaAlloc(arena, length + 1);
 	char *dPtr;
 	char ch;
 
-	for (dPtr = dest; ; dPtr++) {
+	for (dPtr = dest; src < end; dPtr++) {
 		ch = *src++;
-		if (ch == '\0')
-			break;
-		else if (ch != '\\')
+		if (ch != '\\')
 			*dPtr = ch;
+		else if (src == end)
+			*dPtr = '\\';
 		else {
 			ch = *(src++);
-			if (ch == '\0') {
-				*dPtr = '\\';
-				break;
-			} else if ((ch >= '0') && (ch <= '7')) {
+			if ((ch >= '0') && (ch <= '7')) {
 				char wch;
 
 				/* Convert octal number to character */
 				wch = (ch & 07);
-				ch = *src;
-				if ((ch >= '0') && (ch <= '7')) {
-					src++;
-					wch = (wch << 3) | (ch & 07);
-					ch = *src;
-					if ((ch >= '0') && (ch <= '7')) {
-						src++;
-						wch = (wch << 3) | (ch & 07);
-					}
+				if (src < end && (*src >= '0') && (*src <= '7')) {
+					wch = (wch << 3) | (*src++ & 07);
+					if (src < end && (*src >= '0') && (*src <= '7'))
+						wch = (wch << 3) | (*src++ & 07);
 				}
 				*dPtr = wch;
 			} else {
@@ -568,22 +639,18 @@ static char *unescapestr(const char *src)
 	return dest;
 }
 
+/*
+ * Strings are unescaped straight from the text being parsed into the
+ * parse arena, WMCreatePLString() then makes the copy kept in the plist.
+ */
 static WMPropList *getPLString(PLData * pldata)
 {
-	WMPropList *plist;
-	StringBuffer sBuf;
-	int ptr = 0;
+	int start = pldata->pos;
 	int c;
 
-	sBuf.str = wmalloc(BUFFERSIZE);
-	sBuf.size = BUFFERSIZE;
-
 	while (1) {
 		c = getChar(pldata);
-		if (ISSTRINGABLE(c)) {
-			CHECK_BUFFER_SIZE(sBuf, ptr);
-			sBuf.str[ptr++] = c;
-		} else {
+		if (!ISSTRINGABLE(c)) {
 			if (c != 0) {
 				pldata->pos--;
 			}
@@ -591,69 +658,35 @@ static WMPropList *getPLString(PLData * pldata)
 		}
 	}
 
-	sBuf.str[ptr] = 0;
-
-	if (ptr == 0) {
-		plist = NULL;
-	} else {
-		char *tmp = unescapestr(sBuf.str);
-		plist = WMCreatePLString(tmp);
-		wfree(tmp);
-	}
-
-	wfree(sBuf.str);
+	if (pldata->pos == start)
+		return NULL;
 
-	return plist;
+	return WMCreatePLString(unescapestr(pldata->arena, pldata->ptr + start, pldata->pos - start));
 }
 
 static WMPropList *getPLQString(PLData * pldata)
 {
-	WMPropList *plist;
-	int ptr = 0, escaping = 0, ok = 1;
+	int start = pldata->pos;
+	int escaping = 0;
 	int c;
-	StringBuffer sBuf;
-
-	sBuf.str = wmalloc(BUFFERSIZE);
-	sBuf.size = BUFFERSIZE;
 
 	while (1) {
 		c = getChar(pldata);
-		if (!escaping) {
-			if (c == '\\') {
-				escaping = 1;
-				continue;
-			} else if (c == '"') {
-				break;
-			}
-		} else {
-			CHECK_BUFFER_SIZE(sBuf, ptr);
-			sBuf.str[ptr++] = '\\';
-			escaping = 0;
-		}
-
 		if (c == 0) {
 			COMPLAIN(pldata, _("unterminated PropList string"));
-			ok = 0;
-			break;
-		} else {
-			CHECK_BUFFER_SIZE(sBuf, ptr);
-			sBuf.str[ptr++] = c;
+			return NULL;
 		}
-	}
-
-	sBuf.str[ptr] = 0;
 
-	if (!ok) {
-		plist = NULL;
-	} else {
-		char *tmp = unescapestr(sBuf.str);
-		plist = WMCreatePLString(tmp);
-		wfree(tmp);
+		if (escaping)
+			escaping = 0;
+		else if (c == '\\')
+			escaping = 1;
+		else if (c == '"')
+			break;
 	}
 
-	wfree(sBuf.str);
-
-	return plist;
+	/* leave out the closing quote */
+	return WMCreatePLString(unescapestr(pldata->arena, pldata->ptr + start, pldata->pos - 1 - start));
 }
 
 static WMPropList *getPLData(PLData * pldata)
@@ -1480,19 +1513,21 @@ WMPropList *WMDeepCopyPropList(WMPropList * plist)
 	return ret;
 }
 
-WMPropList *WMCreatePropListFromDescription(const char *desc)
+static WMPropList *parsePropList(const char *text, const char *filename)
 {
-	WMPropList *plist = NULL;
-	PLData *pldata;
+	WMPropList *plist;
+	PLData pldata;
 
-	pldata = (PLData *) wmalloc(sizeof(PLData));
-	pldata->ptr = desc;
-	pldata->lineNumber = 1;
+	memset(&pldata, 0, sizeof(pldata));
+	pldata.ptr = text;
+	pldata.filename = filename;
+	pldata.lineNumber = 1;
+	pldata.arena = WMCreateArena(0);
 
-	plist = getPropList(pldata);
+	plist = getPropList(&pldata);
 
-	if (getNonSpaceChar(pldata) != 0 && plist) {
-		COMPLAIN(pldata, _("extra data after end of property list"));
+	if (getNonSpaceChar(&pldata) != 0 && plist) {
+		COMPLAIN(&pldata, _("extra data after end of property list"));
 		/*
 		 * We can't just ignore garbage after the end of the description
 		 * (especially if the description was read from a file), because
@@ -1503,20 +1538,24 @@ WMPropList *WMCreatePropListFromDescription(const char *desc)
 		plist = NULL;
 	}
 
-	wfree(pldata);
+	WMFreeArena(pldata.arena);
 
 	return plist;
 }
 
+WMPropList *WMCreatePropListFromDescription(const char *desc)
+{
+	return parsePropList(desc, NULL);
+}
+
 char *WMGetPropListDescription(WMPropList * plist, Bool indented)
 {
-	return (indented ? indentedDescription(plist, 0) : description(plist));
+	return description(plist, indented);
 }
 
 WMPropList *WMReadPropListFromFile(const char *file)
 {
 	WMPropList *plist = NULL;
-	PLData *pldata;
 	char *read_buf;
 	FILE *f;
 	struct stat stbuf;
@@ -1549,27 +1588,9 @@ WMPropList *WMReadPropListFromFile(const char *file)
 	read_buf[length] = '\0';
 	fclose(f);
 
-	pldata = (PLData *) wmalloc(sizeof(PLData));
-	pldata->ptr = read_buf;
-	pldata->filename = file;
-	pldata->lineNumber = 1;
-
-	plist = getPropList(pldata);
-
-	if (getNonSpaceChar(pldata) != 0 && plist) {
-		COMPLAIN(pldata, _("extra data after end of property list"));
-		/*
-		 * We can't just ignore garbage after the end of the description
-		 * (especially if the description was read from a file), because
-		 * the "garbage" can be the real data and the real garbage is in
-		 * fact in the beginning of the file (which is now inside plist)
-		 */
-		WMReleasePropList(plist);
-		plist = NULL;
-	}
+	plist = parsePropList(read_buf, file);
 
 	wfree(read_buf);
-	wfree(pldata);
 
 	return plist;
 }
@@ -1578,7 +1599,6 @@ WMPropList *WMReadPropListFromPipe(const char *command)
 {
 	FILE *file;
 	WMPropList *plist;
-	PLData *pldata;
 	char *read_buf, *read_ptr;
 	size_t remain_size, line_size;
 	const size_t block_read_size = 4096;
@@ -1613,38 +1633,70 @@ WMPropList *WMReadPropListFromPipe(const char *command)
 
 	pclose(file);
 
-	pldata = (PLData *) wmalloc(sizeof(PLData));
-	pldata->ptr = read_buf;
-	pldata->filename = command;
-	pldata->lineNumber = 1;
-
-	plist = getPropList(pldata);
-
-	if (getNonSpaceChar(pldata) != 0 && plist) {
-		COMPLAIN(pldata, _("extra data after end of property list"));
-		/*
-		 * We can't just ignore garbage after the end of the description
-		 * (especially if the description was read from a file), because
-		 * the "garbage" can be the real data and the real garbage is in
-		 * fact in the beginning of the file (which is now inside plist)
-		 */
-		WMReleasePropList(plist);
-		plist = NULL;
-	}
+	plist = parsePropList(read_buf, command);
 
 	wfree(read_buf);
-	wfree(pldata);
 
 	return plist;
 }
 
 /* TODO: review this function's code */
 
+/* Returns True if the file at path already holds the description of plist */
+static Bool isFileUpToDate(WMPropList *plist, const char *path)
+{
+	PLWriter w;
+
+	memset(&w, 0, sizeof(w));
+	w.compare = fopen(path, "rb");
+	if (!w.compare)
+		return False;
+
+	writeIndentedDescription(&w, plist, 0);
+	plWriteLiteral(&w, "\n");
+
+	if (!w.differs && !w.failed && fgetc(w.compare) != EOF)
+		w.differs = True;
+
+	fclose(w.compare);
+
+	return !w.differs && !w.failed;
+}
+
+/* Makes the rename of a file in the directory of path durable */
+static void syncDirectory(const char *path)
+{
+	char *dir, *ptr;
+	int fd;
+
+	dir = wstrdup(path);
+	ptr = strrchr(dir, '/');
+	if (ptr == dir)
+		ptr[1] = 0;
+	else if (ptr)
+		*ptr = 0;
+	else
+		strcpy(dir, ".");
+
+	fd = open(dir, O_RDONLY);
+	if (fd >= 0) {
+		(void)fsync(fd);
+		close(fd);
+	}
+	wfree(dir);
+}
+
+/*
+ * The description is written straight to a temporary file, which is
+ * synced to disk before it replaces the destination, so a crash leaves
+ * either the old or the new file. Nothing is written if the file already
+ * has the same contents.
+ */
 Bool WMWritePropListToFile(WMPropList * plist, const char *path)
 {
 	char *thePath = NULL;
-	char *desc;
 	FILE *theFile;
+	PLWriter w;
 #ifdef	HAVE_MKSTEMP
 	int fd, mask;
 #endif
@@ -1652,6 +1704,9 @@ Bool WMWritePropListToFile(WMPropList * plist, const char *path)
 	if (!wmkdirhier(path))
 		return False;
 
+	if (isFileUpToDate(plist, path))
+		return True;
+
 	/* Use the path name of the destination file as a prefix for the
 	 * mkstemp() call so that we can be sure that both files are on
 	 * the same filesystem and the subsequent rename() will work. */
@@ -1690,17 +1745,20 @@ Bool WMWritePropListToFile(WMPropList * plist, const char *path)
 		goto failure;
 	}
 
-	desc = indentedDescription(plist, 0);
+	memset(&w, 0, sizeof(w));
+	w.file = theFile;
+	writeIndentedDescription(&w, plist, 0);
+	plWriteLiteral(&w, "\n");
 
-	if (fprintf(theFile, "%s\n", desc) != strlen(desc) + 1) {
+	if (w.failed || fflush(theFile) != 0) {
 		werror(_("writing to file: %s failed"), thePath);
-		wfree(desc);
+		fclose(theFile);
 		goto failure;
 	}
 
-	wfree(desc);
-
+	/* the data must be on disk before the rename makes it the real file */
 	(void)fsync(fileno(theFile));
+
 	if (fclose(theFile) != 0) {
 		werror(_("fclose (%s) failed"), thePath);
 		goto failure;
@@ -1714,6 +1772,8 @@ Bool WMWritePropListToFile(WMPropList * plist, const char *path)
 		goto failure;
 	}
 
+	syncDirectory(path);
+
 	wfree(thePath);
 	return True;
 
@@ -9,11 +9,29 @@
 
 #include "wconfig.h"
 
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
 #include "WINGs.h"
 #include "WINGsP.h"
 #include "userdefaults.h"
 
 
+/*
+ * What we know of the file a domain was last read from or written to.
+ * The modification time alone is not enough: a second-resolution mtime
+ * misses writes made within the same second, and a file replaced by
+ * rename() may well keep the same mtime.
+ */
+typedef struct FileStamp {
+	time_t seconds;
+	long nanoseconds;
+	off_t size;
+	ino_t inode;
+	dev_t device;
+} FileStamp;
+
 typedef struct W_UserDefaults {
 	WMPropList *defaults;
 
@@ -26,9 +44,16 @@ typedef struct W_UserDefaults {
 
 	char dontSync;
 
+	char pending;		/* a synchronization is scheduled */
+
 	char *path;		/* where is db located */
 
-	time_t timestamp;	/* last modification time */
+	FileStamp stamp;	/* state of the file when last synced */
+
+#ifdef HAVE_INOTIFY
+	int watch;		/* inotify watch on the file's directory */
+	char *fileName;		/* name of the file inside that directory */
+#endif
 
 	struct W_UserDefaults *next;
 
@@ -37,15 +62,24 @@ typedef struct W_UserDefaults {
 static UserDefaults *sharedUserDefaults = NULL;
 
 char *WMUserDefaultsDidChangeNotification = "WMUserDefaultsDidChangeNotification";
+char *WMUserDefaultsKeyDidChangeNotification = "WMUserDefaultsKeyDidChangeNotification";
 
 static void synchronizeUserDefaults(void *foo);
 
 #define DEFAULTS_DIR "/Defaults"
-#ifndef HAVE_INOTIFY
+
 /* Check defaults database for changes every this many milliseconds */
 /* XXX: this is shared with src/ stuff, put it in some common header */
 #define UD_SYNC_INTERVAL	2000
-#endif
+
+/*
+ * Delay between a change (a key set by the application or the file
+ * rewritten by someone else) and the synchronization it triggers, so
+ * that a burst of changes is written or read only once.
+ */
+#define UD_SYNC_DELAY		300
+
+static WMHandlerID syncTimer = NULL;
 
 const char *wusergnusteppath()
 {
@@ -157,7 +191,6 @@ static void synchronizeUserDefaults(void *foo)
 	}
 }
 
-#ifndef HAVE_INOTIFY
 static void addSynchronizeTimerHandler(void)
 {
 	static Bool initialized = False;
@@ -168,96 +201,255 @@ static void addSynchronizeTimerHandler(void)
 		initialized = True;
 	}
 }
+
+static void synchronizePending(void *foo)
+{
+	UserDefaults *database;
+
+	/* Parameter not used, but tell the compiler that it is ok */
+	(void) foo;
+
+	syncTimer = NULL;
+
+	for (database = sharedUserDefaults; database; database = database->next) {
+		if (database->pending && !database->dontSync)
+			WMSynchronizeUserDefaults(database);
+		database->pending = 0;
+	}
+}
+
+/* Synchronize the database soon, coalescing with other pending changes */
+static void scheduleSynchronize(UserDefaults *database)
+{
+	if (database->dontSync)
+		return;
+
+	database->pending = 1;
+	if (!syncTimer)
+		syncTimer = WMAddTimerHandler(UD_SYNC_DELAY, synchronizePending, NULL);
+}
+
+static char *getDatabasePath(UserDefaults *database)
+{
+	if (database->path)
+		return wstrdup(database->path);
+
+	return wdefaultspathfordomain(WMGetApplicationName());
+}
+
+/* Returns False if the file does not exist (or cannot be stat'ed) */
+static Bool getFileStamp(const char *path, FileStamp *stamp)
+{
+	struct stat stbuf;
+
+	if (stat(path, &stbuf) < 0)
+		return False;
+
+	stamp->seconds = stbuf.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	stamp->nanoseconds = stbuf.st_mtim.tv_nsec;
+#else
+	stamp->nanoseconds = 0;
+#endif
+	stamp->size = stbuf.st_size;
+	stamp->inode = stbuf.st_ino;
+	stamp->device = stbuf.st_dev;
+
+	return True;
+}
+
+static Bool isSameFileStamp(const FileStamp *a, const FileStamp *b)
+{
+	return (a->seconds == b->seconds && a->nanoseconds == b->nanoseconds
+		&& a->size == b->size && a->inode == b->inode && a->device == b->device);
+}
+
+#ifdef HAVE_INOTIFY
+static int inotifyFD = -1;
+
+static void handleDefaultsEvent(int fd, int mask, void *clientData)
+{
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *event;
+	UserDefaults *database;
+	ssize_t length;
+	char *ptr;
+
+	/* Parameters not used, but tell the compiler that it is ok */
+	(void) mask;
+	(void) clientData;
+
+	while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+		for (ptr = buffer; ptr < buffer + length; ptr += sizeof(*event) + event->len) {
+			event = (struct inotify_event *) ptr;
+
+			for (database = sharedUserDefaults; database; database = database->next) {
+				if (event->mask & IN_Q_OVERFLOW) {
+					if (database->watch > 0)
+						scheduleSynchronize(database);
+				} else if (event->wd != database->watch) {
+					continue;
+				} else if (event->mask & IN_IGNORED) {
+					/* the directory went away, fall back to polling */
+					database->watch = 0;
+					addSynchronizeTimerHandler();
+				} else if (event->len > 0 && strcmp(event->name, database->fileName) == 0) {
+					scheduleSynchronize(database);
+				}
+			}
+		}
+	}
+}
 #endif
 
+/*
+ * Arrange for the database to be synchronized when its file is changed
+ * by someone else. With inotify we watch the directory rather than the
+ * file, because the file is replaced (by us too) through rename() and a
+ * watch on it would be lost on the first save. Without inotify, or when
+ * the directory cannot be watched, the files are polled instead.
+ */
+static void watchDatabase(UserDefaults *database)
+{
+#ifdef HAVE_INOTIFY
+	char *path, *name;
+
+	if (database->dontSync || database->watch > 0)
+		return;
+
+	if (inotifyFD < 0) {
+		inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFD < 0) {
+			addSynchronizeTimerHandler();
+			return;
+		}
+		WMAddInputHandler(inotifyFD, WIReadMask, handleDefaultsEvent, NULL);
+	}
+
+	path = getDatabasePath(database);
+	name = strrchr(path, '/');
+	if (!name) {
+		wfree(path);
+		addSynchronizeTimerHandler();
+		return;
+	}
+
+	if (!database->fileName)
+		database->fileName = wstrdup(name + 1);
+
+	if (name == path)
+		name[1] = '\0';
+	else
+		name[0] = '\0';
+
+	database->watch = inotify_add_watch(inotifyFD, path, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (database->watch <= 0) {
+		database->watch = 0;
+		addSynchronizeTimerHandler();
+	}
+	wfree(path);
+#else
+	if (!database->dontSync)
+		addSynchronizeTimerHandler();
+#endif
+}
+
 void WMEnableUDPeriodicSynchronization(WMUserDefaults * database, Bool enable)
 {
 	database->dontSync = !enable;
+	if (enable)
+		watchDatabase(database);
+}
+
+/*
+ * Tell observers which keys of the application domain differ between
+ * the old and the new contents, before the domain-wide notification.
+ */
+static void notifyChangedKeys(UserDefaults *database, WMPropList *oldDomain, WMPropList *newDomain)
+{
+	WMPropList *keys, *key, *value;
+	int i, count;
+
+	keys = WMGetPLDictionaryKeys(newDomain);
+	count = WMGetPropListItemCount(keys);
+	for (i = 0; i < count; i++) {
+		key = WMGetFromPLArray(keys, i);
+		value = WMGetFromPLDictionary(oldDomain, key);
+		if (!value || !WMIsPropListEqualTo(value, WMGetFromPLDictionary(newDomain, key)))
+			WMPostNotificationName(WMUserDefaultsKeyDidChangeNotification,
+					       database, WMGetFromPLString(key));
+	}
+	WMReleasePropList(keys);
+
+	keys = WMGetPLDictionaryKeys(oldDomain);
+	count = WMGetPropListItemCount(keys);
+	for (i = 0; i < count; i++) {
+		key = WMGetFromPLArray(keys, i);
+		if (!WMGetFromPLDictionary(newDomain, key))
+			WMPostNotificationName(WMUserDefaultsKeyDidChangeNotification,
+					       database, WMGetFromPLString(key));
+	}
+	WMReleasePropList(keys);
 }
 
 void WMSynchronizeUserDefaults(WMUserDefaults * database)
 {
-	Bool fileIsNewer = False, release = False, notify = False;
-	WMPropList *plF, *key;
+	Bool fileChanged = False;
+	WMPropList *plF, *oldDomain = NULL;
+	FileStamp stamp;
 	char *path;
-	struct stat stbuf;
 
-	if (!database->path) {
-		path = wdefaultspathfordomain(WMGetApplicationName());
-		release = True;
-	} else {
-		path = database->path;
-	}
+	database->pending = 0;
+
+	path = getDatabasePath(database);
 
-	if (stat(path, &stbuf) >= 0 && stbuf.st_mtime > database->timestamp)
-		fileIsNewer = True;
+	if (getFileStamp(path, &stamp) && !isSameFileStamp(&stamp, &database->stamp))
+		fileChanged = True;
 
-	if (database->appDomain && (database->dirty || fileIsNewer)) {
-		if (database->dirty && fileIsNewer) {
+	if (database->appDomain && (database->dirty || fileChanged)) {
+		if (fileChanged) {
 			plF = WMReadPropListFromFile(path);
 			if (plF) {
-				plF = WMMergePLDictionaries(plF, database->appDomain, False);
-				WMReleasePropList(database->appDomain);
+				if (database->dirty) {
+					plF = WMMergePLDictionaries(plF, database->appDomain, False);
+					WMWritePropListToFile(plF, path);
+				}
+				oldDomain = database->appDomain;
 				database->appDomain = plF;
-				key = database->searchList[0];
-				WMPutInPLDictionary(database->defaults, key, plF);
-				notify = True;
+				WMPutInPLDictionary(database->defaults, database->searchList[0], plF);
 			} else {
 				/* something happened with the file. just overwrite it */
 				wwarning(_("cannot read domain from file '%s' when syncing"), path);
 				WMWritePropListToFile(database->appDomain, path);
 			}
-		} else if (database->dirty) {
+		} else {
 			WMWritePropListToFile(database->appDomain, path);
-		} else if (fileIsNewer) {
-			plF = WMReadPropListFromFile(path);
-			if (plF) {
-				WMReleasePropList(database->appDomain);
-				database->appDomain = plF;
-				key = database->searchList[0];
-				WMPutInPLDictionary(database->defaults, key, plF);
-				notify = True;
-			} else {
-				/* something happened with the file. just overwrite it */
-				wwarning(_("cannot read domain from file '%s' when syncing"), path);
-				WMWritePropListToFile(database->appDomain, path);
-			}
 		}
 
 		database->dirty = 0;
 
-		if (stat(path, &stbuf) >= 0)
-			database->timestamp = stbuf.st_mtime;
+		getFileStamp(path, &database->stamp);
 
-		if (notify) {
+		if (oldDomain) {
+			notifyChangedKeys(database, oldDomain, database->appDomain);
+			WMReleasePropList(oldDomain);
 			WMPostNotificationName(WMUserDefaultsDidChangeNotification, database, NULL);
 		}
 	}
 
-	if (release)
-		wfree(path);
-
+	wfree(path);
 }
 
 void WMSaveUserDefaults(WMUserDefaults * database)
 {
 	if (database->appDomain) {
-		struct stat stbuf;
 		char *path;
-		Bool release = False;
 
-		if (!database->path) {
-			path = wdefaultspathfordomain(WMGetApplicationName());
-			release = True;
-		} else {
-			path = database->path;
-		}
+		path = getDatabasePath(database);
 		WMWritePropListToFile(database->appDomain, path);
 		database->dirty = 0;
-		if (stat(path, &stbuf) >= 0)
-			database->timestamp = stbuf.st_mtime;
-		if (release)
-			wfree(path);
+		getFileStamp(path, &database->stamp);
+		wfree(path);
 	}
 }
 
@@ -266,7 +458,6 @@ WMUserDefaults *WMGetStandardUserDefaults(void)
 	WMUserDefaults *defaults;
 	WMPropList *domain;
 	WMPropList *key;
-	struct stat stbuf;
 	char *path;
 	int i;
 
@@ -296,8 +487,7 @@ WMUserDefaults *WMGetStandardUserDefaults(void)
 
 	path = wdefaultspathfordomain(WMGetFromPLString(key));
 
-	if (stat(path, &stbuf) >= 0)
-		defaults->timestamp = stbuf.st_mtime;
+	getFileStamp(path, &defaults->stamp);
 
 	domain = WMReadPropListFromFile(path);
 
@@ -342,9 +532,7 @@ WMUserDefaults *WMGetStandardUserDefaults(void)
 		defaults->next = sharedUserDefaults;
 	sharedUserDefaults = defaults;
 
-#ifndef HAVE_INOTIFY
-	addSynchronizeTimerHandler();
-#endif
+	watchDatabase(defaults);
 	registerSaveOnExit();
 
 	return defaults;
@@ -355,7 +543,6 @@ WMUserDefaults *WMGetDefaultsFromPath(const char *path)
 	WMUserDefaults *defaults;
 	WMPropList *domain;
 	WMPropList *key;
-	struct stat stbuf;
 	const char *name;
 	int i;
 
@@ -385,8 +572,7 @@ WMUserDefaults *WMGetDefaultsFromPath(const char *path)
 	key = WMCreatePLString(name);
 	defaults->searchList[0] = key;
 
-	if (stat(path, &stbuf) >= 0)
-		defaults->timestamp = stbuf.st_mtime;
+	getFileStamp(path, &defaults->stamp);
 
 	domain = WMReadPropListFromFile(path);
 
@@ -415,9 +601,7 @@ WMUserDefaults *WMGetDefaultsFromPath(const char *path)
 		defaults->next = sharedUserDefaults;
 	sharedUserDefaults = defaults;
 
-#ifndef HAVE_INOTIFY
-	addSynchronizeTimerHandler();
-#endif
+	watchDatabase(defaults);
 	registerSaveOnExit();
 
 	return defaults;
@@ -456,6 +640,7 @@ void WMSetUDObjectForKey(WMUserDefaults * database, WMPropList * object, const c
 	WMPropList *key = WMCreatePLString(defaultName);
 
 	database->dirty = 1;
+	scheduleSynchronize(database);
 
 	WMPutInPLDictionary(database->appDomain, key, object);
 	WMReleasePropList(key);
@@ -466,6 +651,7 @@ void WMRemoveUDObjectForKey(WMUserDefaults * database, const char *defaultName)
 	WMPropList *key = WMCreatePLString(defaultName);
 
 	database->dirty = 1;
+	scheduleSynchronize(database);
 
 	WMRemoveFromPLDictionary(database->appDomain, key);
 
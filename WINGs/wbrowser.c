@@ -1132,8 +1132,7 @@ static char *createTruncatedString(WMFont * font, const char *text, int *textLen
 		if (wstrlcpy(textBuf, text, slen) >= slen)
 			goto error;
 
-		while (tmpTextLen && (WMWidthOfString(font, textBuf, tmpTextLen) + 3 * dLen > width))
-			tmpTextLen--;
+		tmpTextLen = WMFitStringInWidth(font, textBuf, tmpTextLen, width - 3 * dLen);
 
 		if (wstrlcpy(textBuf + tmpTextLen, "...", slen) >= slen)
 			goto error;
@@ -1,5 +1,6 @@
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "wconfig.h"
 
@@ -170,6 +171,10 @@ WMFont *WMCreateFont(WMScreen * scrPtr, const char *fontName)
 
 	font->name = fname;
 
+#ifndef USE_PANGO
+	memset(font->latinAdvance, 0xff, sizeof(font->latinAdvance));
+#endif
+
 #ifdef USE_PANGO
 	fontmap = pango_xft_get_font_map(scrPtr->display, scrPtr->screen);
 	context = pango_font_map_create_context(fontmap);
@@ -209,6 +214,17 @@ void WMReleaseFont(WMFont * font)
 
 	font->refCount--;
 	if (font->refCount < 1) {
+#ifdef USE_PANGO
+		int i;
+
+		for (i = 0; i < W_FONT_RECENT_STRINGS; i++) {
+			if (font->recent[i].text)
+				wfree(font->recent[i].text);
+		}
+#else
+		if (font->advances)
+			WMFreeHashTable(font->advances);
+#endif
 		XftFontClose(font->screen->display, font->font);
 		if (font->name) {
 			WMHashRemove(font->screen->fontCache, font->name);
@@ -283,29 +299,164 @@ WMFont *WMBoldSystemFontOfSize(WMScreen * scrPtr, int size)
 	return font;
 }
 
-int WMWidthOfString(WMFont * font, const char *text, int length)
-{
 #ifdef USE_PANGO
+static void setLayoutText(WMFont * font, const char *text, int length)
+{
 	const char *previous_text;
-	int width;
-#else
-	XGlyphInfo extents;
-#endif
 
-	wassertrv(font != NULL && text != NULL, 0);
-#ifdef USE_PANGO
 	previous_text = pango_layout_get_text(font->layout);
 	if ((previous_text == NULL) || (strncmp(text, previous_text, length) != 0) || previous_text[length] != '\0')
 		pango_layout_set_text(font->layout, text, length);
+}
+
+int WMWidthOfString(WMFont * font, const char *text, int length)
+{
+	int width, i;
+
+	wassertrv(font != NULL && text != NULL, 0);
+
+	/* the same strings tend to be measured again and again */
+	for (i = 0; i < W_FONT_RECENT_STRINGS; i++) {
+		if (font->recent[i].text && font->recent[i].length == length
+		    && memcmp(font->recent[i].text, text, length) == 0)
+			return font->recent[i].width;
+	}
+
+	setLayoutText(font, text, length);
 	pango_layout_get_pixel_size(font->layout, &width, NULL);
 
+	i = font->nextRecent;
+	if (font->recent[i].text)
+		wfree(font->recent[i].text);
+	font->recent[i].text = wmalloc(length + 1);
+	memcpy(font->recent[i].text, text, length);
+	font->recent[i].length = length;
+	font->recent[i].width = width;
+	font->nextRecent = (i + 1) % W_FONT_RECENT_STRINGS;
+
 	return width;
+}
+
+int WMFitStringInWidth(WMFont * font, const char *text, int length, int width)
+{
+	PangoLayoutLine *line;
+	int index, trailing;
+
+	wassertrv(font != NULL && text != NULL, 0);
+
+	if (WMWidthOfString(font, text, length) <= width)
+		return length;
+
+	/* let Pango find the character under the limit, taking shaping
+	 * into account, then make sure the prefix really fits */
+	setLayoutText(font, text, length);
+	line = pango_layout_get_line_readonly(font->layout, 0);
+	if (!line)
+		return 0;
+	pango_layout_line_x_to_index(line, width * PANGO_SCALE, &index, &trailing);
+
+	while (index > 0 && WMWidthOfString(font, text, index) > width) {
+		do {
+			index--;
+		} while (index > 0 && (text[index] & 0xc0) == 0x80);
+	}
+
+	return index;
+}
+
 #else
-	XftTextExtentsUtf8(font->screen->display, font->font, (XftChar8 *) text, length, &extents);
 
-	return extents.xOff;	/* don't ask :P */
-#endif
+/*
+ * Xft does not do kerning, so the width of a string is the sum of the
+ * advances of its glyphs, which are measured only once per font.
+ */
+static int glyphAdvance(WMFont * font, FcChar32 ucs4)
+{
+	XGlyphInfo extents;
+	FT_UInt glyph;
+
+	if (ucs4 < W_FONT_LATIN_GLYPHS) {
+		if (font->latinAdvance[ucs4] >= 0)
+			return font->latinAdvance[ucs4];
+	} else if (font->advances) {
+		void *cached = WMHashGet(font->advances, (void *)(uintptr_t) ucs4);
+
+		/* stored plus one, to tell a zero advance from a missing entry */
+		if (cached)
+			return (int)(intptr_t) cached - 1;
+	}
+
+	glyph = XftCharIndex(font->screen->display, font->font, ucs4);
+	XftGlyphExtents(font->screen->display, font->font, &glyph, 1, &extents);
+
+	if (ucs4 < W_FONT_LATIN_GLYPHS) {
+		font->latinAdvance[ucs4] = extents.xOff;
+	} else {
+		if (!font->advances)
+			font->advances = WMCreateHashTable(WMIntHashCallbacks);
+		WMHashInsert(font->advances, (void *)(uintptr_t) ucs4, (void *)(intptr_t) (extents.xOff + 1));
+	}
+
+	return extents.xOff;
+}
+
+/* Decode one UTF-8 character, returns its length or 0 if invalid */
+static inline int nextChar(const char *text, int length, FcChar32 *ucs4)
+{
+	int len;
+
+	if ((unsigned char)*text < 0x80) {
+		*ucs4 = (unsigned char)*text;
+		return 1;
+	}
+
+	len = FcUtf8ToUcs4((const FcChar8 *) text, ucs4, length);
+
+	return (len > 0) ? len : 0;
+}
+
+int WMWidthOfString(WMFont * font, const char *text, int length)
+{
+	FcChar32 ucs4;
+	int width = 0;
+	int len;
+
+	wassertrv(font != NULL && text != NULL, 0);
+
+	/* like XftTextExtentsUtf8, stop at the first invalid sequence */
+	while (length > 0 && (len = nextChar(text, length, &ucs4)) > 0) {
+		width += glyphAdvance(font, ucs4);
+		text += len;
+		length -= len;
+	}
+
+	return width;
+}
+
+int WMFitStringInWidth(WMFont * font, const char *text, int length, int width)
+{
+	FcChar32 ucs4;
+	int total = 0;
+	int fit = 0;
+	int len;
+
+	wassertrv(font != NULL && text != NULL, 0);
+
+	while (fit < length) {
+		len = nextChar(text + fit, length - fit, &ucs4);
+		if (len == 0) {
+			/* the rest is not measured by WMWidthOfString either */
+			return length;
+		}
+		total += glyphAdvance(font, ucs4);
+		if (total > width)
+			break;
+		fit += len;
+	}
+
+	return fit;
 }
+#endif
 
 void WMDrawString(WMScreen * scr, Drawable d, WMColor * color, WMFont * font, int x, int y, const char *text, int length)
 {
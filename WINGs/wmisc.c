@@ -122,11 +122,14 @@ static int fitText(const char *text, WMFont * font, int width, int wrap)
 		word1 = word2;
 	}
 
-	for (i = word1; i < word2; i++) {
-		w = WMWidthOfString(font, text, i);
-		if (w > width) {
-			break;
-		}
+	/* find the first character of the last word that does not fit */
+	i = WMFitStringInWidth(font, text, word2, width);
+	if (i < word1)
+		i = word1;
+	if (i < word2) {
+		do {
+			i++;
+		} while (i < word2 && (text[i] & 0xc0) == 0x80);
 	}
 
 	/* keep words complete if possible */
@@ -131,7 +131,7 @@ WMPixmap *WMCreateScaledBlendedPixmapFromFile(WMScreen *scrPtr, const char *file
 	WMPixmap *pixPtr;
 	RImage *image;
 
-	image = RLoadImage(scrPtr->rcontext, fileName, 0);
+	image = RLoadImageForSize(scrPtr->rcontext, fileName, 0, width, height);
 	if (!image)
 		return NULL;
 
@@ -88,6 +88,9 @@ static const struct {
 	  /* default: */ False, OPTION_WMAKER, "KbdModeLock" },
 #endif /* XKB_MODELOCK */
 
+	{ N_("Maximum window updates per second while moving or resizing."),
+	  /* default: */ 60, OPTION_WMAKER_INT, "MoveResizeRate" },
+
 	{ N_("Maximize (snap) a window to edge or corner by dragging."),
 	  /* default: */ False, OPTION_WMAKER, "WindowSnapping" },
 
@@ -110,7 +113,10 @@ static const struct {
 	  /* default: */ False, OPTION_WMAKER, "PointerWithHalfMaxWindows" },
 
 	{ N_("Open dialogs in the same workspace as their owners."),
-	  /* default: */ False, OPTION_WMAKER, "OpenTransientOnOwnerWorkspace" }
+	  /* default: */ False, OPTION_WMAKER, "OpenTransientOnOwnerWorkspace" },
+
+	{ N_("Memory for rendered workspace backgrounds, in MB (0 keeps only the current one)."),
+	  /* default: */ 64, OPTION_WMAKER_INT, "WorkspaceBackCacheSize" }
 
 };
 
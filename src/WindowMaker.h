@@ -331,6 +331,7 @@ extern struct WPreferences {
 	char opaque_move;                  /* update window position during move */
 	char opaque_resize;                /* update window position during resize */
 	char opaque_move_resize_keyboard;  /* update window position during move,resize with keyboard */
+	int move_resize_rate;              /* max geometry updates per second during move/resize */
 	char wrap_menus;                   /* wrap menus at edge of screen */
 	char scrollable_menus;             /* let them be scrolled */
 	char vi_key_menus;                 /* use h/j/k/l to select */
@@ -592,7 +593,6 @@ extern struct wmaker_global_variables {
 
 	/* X Contexts */
 	struct {
-		XContext client_win;
 		XContext app_win;
 		XContext stack;
 	} context;
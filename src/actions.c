@@ -50,6 +50,7 @@
 #include "placement.h"
 #include "misc.h"
 #include "event.h"
+#include "animation.h"
 
 
 #ifndef HAVE_FLOAT_MATHFUNC
@@ -93,9 +94,9 @@ static int compareTimes(Time t1, Time t2)
 }
 
 #ifdef USE_ANIMATIONS
-static void shade_animate(WWindow *wwin, Bool what);
+static Bool shade_animate(WWindow *wwin, Bool what);
 #else
-static inline void shade_animate(WWindow *wwin, Bool what)
+static inline Bool shade_animate(WWindow *wwin, Bool what)
 {
 	/*
 	 * This function is empty on purpose, so tell the compiler
@@ -103,6 +104,8 @@ static inline void shade_animate(WWindow *wwin, Bool what)
 	 */
 	(void) wwin;
 	(void) what;
+
+	return False;
 }
 #endif
 
@@ -240,17 +243,10 @@ void wSetFocusTo(WScreen *scr, WWindow *wwin)
 	old_scr = scr;
 }
 
-void wShadeWindow(WWindow *wwin)
+/* Called once the shading animation, if any, is over */
+static void finishShade(WWindow *wwin)
 {
-
-	if (wwin->flags.shaded)
-		return;
-
-	XLowerWindow(dpy, wwin->client_win);
-	shade_animate(wwin, SHADE);
-
 	wwin->flags.skip_next_animation = 0;
-	wwin->flags.shaded = 1;
 	wwin->flags.mapped = 0;
 	/* prevent window withdrawal when getting UnmapNotify */
 	XSelectInput(dpy, wwin->client_win, wwin->event_mask & ~StructureNotifyMask);
@@ -268,27 +264,25 @@ void wShadeWindow(WWindow *wwin)
 	 */
 
 	WMPostNotificationName(WMNChangedState, wwin, "shade");
-
-#ifdef USE_ANIMATIONS
-	if (!wwin->screen_ptr->flags.startup) {
-		/* Catch up with events not processed while animation was running */
-		ProcessPendingEvents();
-	}
-#endif
 }
 
-void wUnshadeWindow(WWindow *wwin)
+void wShadeWindow(WWindow *wwin)
 {
+	wStopShadeAnimation(wwin, True);
 
-	if (!wwin->flags.shaded)
+	if (wwin->flags.shaded)
 		return;
 
-	wwin->flags.shaded = 0;
-	wwin->flags.mapped = 1;
-	XMapWindow(dpy, wwin->client_win);
+	XLowerWindow(dpy, wwin->client_win);
+	wwin->flags.shaded = 1;
 
-	shade_animate(wwin, UNSHADE);
+	if (!shade_animate(wwin, SHADE))
+		finishShade(wwin);
+}
 
+/* Called once the unshading animation, if any, is over */
+static void finishUnshade(WWindow *wwin)
+{
 	wwin->flags.skip_next_animation = 0;
 	wFrameWindowResize(wwin->frame, wwin->frame->core->width,
 			   wwin->frame->top_width + wwin->client.height + wwin->frame->bottom_width);
@@ -304,6 +298,21 @@ void wUnshadeWindow(WWindow *wwin)
 	WMPostNotificationName(WMNChangedState, wwin, "shade");
 }
 
+void wUnshadeWindow(WWindow *wwin)
+{
+	wStopShadeAnimation(wwin, True);
+
+	if (!wwin->flags.shaded)
+		return;
+
+	wwin->flags.shaded = 0;
+	wwin->flags.mapped = 1;
+	XMapWindow(dpy, wwin->client_win);
+
+	if (!shade_animate(wwin, UNSHADE))
+		finishUnshade(wwin);
+}
+
 /* Set the old coordinates using the current values */
 static void save_old_geometry(WWindow *wwin, int directions)
 {
@@ -891,185 +900,182 @@ void wUnfullscreenWindow(WWindow *wwin)
 }
 
 #ifdef USE_ANIMATIONS
-static void animateResizeFlip(WScreen *scr, int x, int y, int w, int h, int fx, int fy, int fw, int fh, int steps)
-{
-#define FRAMES (MINIATURIZE_ANIMATION_FRAMES_F)
-	float cx, cy, cw, ch;
+/*
+ * The outlines are XORed on the root window, so each frame is drawn and
+ * erased again while the server is grabbed.
+ */
+typedef struct ResizeAnimation {
+	WScreen *scr;
+	float x, y, w, h;
 	float xstep, ystep, wstep, hstep;
+	float delta, final_angle;
+
 	XPoint points[5];
+	XRectangle rects[MINIATURIZE_ANIMATION_FRAMES_Z];
+} ResizeAnimation;
+
+static void initResizeAnimation(ResizeAnimation *anim, WScreen *scr, int x, int y, int w, int h,
+				int fx, int fy, int fw, int fh, int steps)
+{
+	anim->scr = scr;
+	anim->x = (float)x;
+	anim->y = (float)y;
+	anim->w = (float)w;
+	anim->h = (float)h;
+	anim->xstep = (float)(fx - x) / steps;
+	anim->ystep = (float)(fy - y) / steps;
+	anim->wstep = (float)(fw - w) / steps;
+	anim->hstep = (float)(fh - h) / steps;
+}
+
+static void eraseResizeOutline(void *data)
+{
+	ResizeAnimation *anim = data;
+
+	XDrawLines(dpy, anim->scr->root_win, anim->scr->frame_gc, anim->points, 5, CoordModeOrigin);
+	XUngrabServer(dpy);
+}
+
+static Bool drawResizeFlip(int frame, void *data)
+{
+	ResizeAnimation *anim = data;
+	XPoint *points = anim->points;
+	float cx, cy, cw, ch;
 	float dx, dch, midy;
-	float angle, final_angle, delta;
-
-	xstep = (float)(fx - x) / steps;
-	ystep = (float)(fy - y) / steps;
-	wstep = (float)(fw - w) / steps;
-	hstep = (float)(fh - h) / steps;
-
-	cx = (float)x;
-	cy = (float)y;
-	cw = (float)w;
-	ch = (float)h;
-
-	final_angle = 2 * WM_PI * MINIATURIZE_ANIMATION_TWIST_F;
-	delta = (float)(final_angle / FRAMES);
-	for (angle = 0;; angle += delta) {
-		if (angle > final_angle)
-			angle = final_angle;
-
-		dx = (cw / 10) - ((cw / 5) * sinf(angle));
-		dch = (ch / 2) * cosf(angle);
-		midy = cy + (ch / 2);
-
-		points[0].x = cx + dx;
-		points[0].y = midy - dch;
-		points[1].x = cx + cw - dx;
-		points[1].y = points[0].y;
-		points[2].x = cx + cw + dx;
-		points[2].y = midy + dch;
-		points[3].x = cx - dx;
-		points[3].y = points[2].y;
-		points[4].x = points[0].x;
-		points[4].y = points[0].y;
+	float angle;
+
+	angle = frame * anim->delta;
+	if (angle > anim->final_angle)
+		angle = anim->final_angle;
+
+	cx = anim->x + frame * anim->xstep;
+	cy = anim->y + frame * anim->ystep;
+	cw = anim->w + frame * anim->wstep;
+	ch = anim->h + frame * anim->hstep;
+
+	dx = (cw / 10) - ((cw / 5) * sinf(angle));
+	dch = (ch / 2) * cosf(angle);
+	midy = cy + (ch / 2);
+
+	points[0].x = cx + dx;
+	points[0].y = midy - dch;
+	points[1].x = cx + cw - dx;
+	points[1].y = points[0].y;
+	points[2].x = cx + cw + dx;
+	points[2].y = midy + dch;
+	points[3].x = cx - dx;
+	points[3].y = points[2].y;
+	points[4].x = points[0].x;
+	points[4].y = points[0].y;
 
-		XGrabServer(dpy);
-		XDrawLines(dpy, scr->root_win, scr->frame_gc, points, 5, CoordModeOrigin);
-		XFlush(dpy);
-		wusleep(MINIATURIZE_ANIMATION_DELAY_F);
+	XGrabServer(dpy);
+	XDrawLines(dpy, anim->scr->root_win, anim->scr->frame_gc, points, 5, CoordModeOrigin);
 
-		XDrawLines(dpy, scr->root_win, scr->frame_gc, points, 5, CoordModeOrigin);
-		XUngrabServer(dpy);
-		cx += xstep;
-		cy += ystep;
-		cw += wstep;
-		ch += hstep;
-		if (angle >= final_angle)
-			break;
+	return True;
+}
 
-	}
+static void animateResizeFlip(WScreen *scr, int x, int y, int w, int h, int fx, int fy, int fw, int fh, int steps)
+{
+	ResizeAnimation anim;
+
+	initResizeAnimation(&anim, scr, x, y, w, h, fx, fy, fw, fh, steps);
+	anim.final_angle = 2 * WM_PI * MINIATURIZE_ANIMATION_TWIST_F;
+	anim.delta = (float)(anim.final_angle / MINIATURIZE_ANIMATION_FRAMES_F);
+
+	wAnimationRun(MINIATURIZE_ANIMATION_FRAMES_F + 1, MINIATURIZE_ANIMATION_DELAY_F,
+		      drawResizeFlip, eraseResizeOutline, &anim);
 	XFlush(dpy);
 }
 
-#undef FRAMES
+static Bool drawResizeTwist(int frame, void *data)
+{
+	ResizeAnimation *anim = data;
+	XPoint *points = anim->points;
+	float cx, cy, cw, ch;
+	float angle, a, d;
+
+	angle = frame * anim->delta;
+	if (angle > anim->final_angle)
+		angle = anim->final_angle;
+
+	cx = anim->x + frame * anim->xstep;
+	cy = anim->y + frame * anim->ystep;
+	cw = anim->w + frame * anim->wstep;
+	ch = anim->h + frame * anim->hstep;
+
+	a = atan2f(ch, cw);
+	d = sqrtf((cw / 2) * (cw / 2) + (ch / 2) * (ch / 2));
+
+	points[0].x = cx + cosf(angle - a) * d;
+	points[0].y = cy + sinf(angle - a) * d;
+	points[1].x = cx + cosf(angle + a) * d;
+	points[1].y = cy + sinf(angle + a) * d;
+	points[2].x = cx + cosf(angle - a + (float)WM_PI) * d;
+	points[2].y = cy + sinf(angle - a + (float)WM_PI) * d;
+	points[3].x = cx + cosf(angle + a + (float)WM_PI) * d;
+	points[3].y = cy + sinf(angle + a + (float)WM_PI) * d;
+	points[4].x = cx + cosf(angle - a) * d;
+	points[4].y = cy + sinf(angle - a) * d;
+
+	XGrabServer(dpy);
+	XDrawLines(dpy, anim->scr->root_win, anim->scr->frame_gc, points, 5, CoordModeOrigin);
+
+	return True;
+}
 
 static void
 animateResizeTwist(WScreen *scr, int x, int y, int w, int h, int fx, int fy, int fw, int fh, int steps)
 {
-#define FRAMES (MINIATURIZE_ANIMATION_FRAMES_T)
-	float cx, cy, cw, ch;
-	float xstep, ystep, wstep, hstep;
-	XPoint points[5];
-	float angle, final_angle, a, d, delta;
-
-	x += w / 2;
-	y += h / 2;
-	fx += fw / 2;
-	fy += fh / 2;
-
-	xstep = (float)(fx - x) / steps;
-	ystep = (float)(fy - y) / steps;
-	wstep = (float)(fw - w) / steps;
-	hstep = (float)(fh - h) / steps;
-
-	cx = (float)x;
-	cy = (float)y;
-	cw = (float)w;
-	ch = (float)h;
-
-	final_angle = 2 * WM_PI * MINIATURIZE_ANIMATION_TWIST_T;
-	delta = (float)(final_angle / FRAMES);
-	for (angle = 0;; angle += delta) {
-		if (angle > final_angle)
-			angle = final_angle;
-
-		a = atan2f(ch, cw);
-		d = sqrtf((cw / 2) * (cw / 2) + (ch / 2) * (ch / 2));
-
-		points[0].x = cx + cosf(angle - a) * d;
-		points[0].y = cy + sinf(angle - a) * d;
-		points[1].x = cx + cosf(angle + a) * d;
-		points[1].y = cy + sinf(angle + a) * d;
-		points[2].x = cx + cosf(angle - a + (float)WM_PI) * d;
-		points[2].y = cy + sinf(angle - a + (float)WM_PI) * d;
-		points[3].x = cx + cosf(angle + a + (float)WM_PI) * d;
-		points[3].y = cy + sinf(angle + a + (float)WM_PI) * d;
-		points[4].x = cx + cosf(angle - a) * d;
-		points[4].y = cy + sinf(angle - a) * d;
-		XGrabServer(dpy);
-		XDrawLines(dpy, scr->root_win, scr->frame_gc, points, 5, CoordModeOrigin);
-		XFlush(dpy);
-		wusleep(MINIATURIZE_ANIMATION_DELAY_T);
+	ResizeAnimation anim;
 
-		XDrawLines(dpy, scr->root_win, scr->frame_gc, points, 5, CoordModeOrigin);
-		XUngrabServer(dpy);
-		cx += xstep;
-		cy += ystep;
-		cw += wstep;
-		ch += hstep;
-		if (angle >= final_angle)
-			break;
+	/* the twist turns around the centre of the rectangle */
+	initResizeAnimation(&anim, scr, x + w / 2, y + h / 2, w, h, fx + fw / 2, fy + fh / 2, fw, fh, steps);
+	anim.final_angle = 2 * WM_PI * MINIATURIZE_ANIMATION_TWIST_T;
+	anim.delta = (float)(anim.final_angle / MINIATURIZE_ANIMATION_FRAMES_T);
 
-	}
+	wAnimationRun(MINIATURIZE_ANIMATION_FRAMES_T + 1, MINIATURIZE_ANIMATION_DELAY_T,
+		      drawResizeTwist, eraseResizeOutline, &anim);
 	XFlush(dpy);
 }
 
-#undef FRAMES
-
-static void animateResizeZoom(WScreen *scr, int x, int y, int w, int h, int fx, int fy, int fw, int fh, int steps)
+/* The zoom is a trail of rectangles, the newest one leading */
+static Bool drawResizeZoom(int frame, void *data)
 {
-#define FRAMES (MINIATURIZE_ANIMATION_FRAMES_Z)
-	float cx[FRAMES], cy[FRAMES], cw[FRAMES], ch[FRAMES];
-	float xstep, ystep, wstep, hstep;
-	int i, j;
-
-	xstep = (float)(fx - x) / steps;
-	ystep = (float)(fy - y) / steps;
-	wstep = (float)(fw - w) / steps;
-	hstep = (float)(fh - h) / steps;
-
-	for (j = 0; j < FRAMES; j++) {
-		cx[j] = (float)x;
-		cy[j] = (float)y;
-		cw[j] = (float)w;
-		ch[j] = (float)h;
-	}
-	XGrabServer(dpy);
-	for (i = 0; i < steps; i++) {
-		for (j = 0; j < FRAMES; j++) {
-			XDrawRectangle(dpy, scr->root_win, scr->frame_gc,
-				       (int)cx[j], (int)cy[j], (int)cw[j], (int)ch[j]);
-		}
-		XFlush(dpy);
-		wusleep(MINIATURIZE_ANIMATION_DELAY_Z);
-
-		for (j = 0; j < FRAMES; j++) {
-			XDrawRectangle(dpy, scr->root_win, scr->frame_gc,
-				       (int)cx[j], (int)cy[j], (int)cw[j], (int)ch[j]);
-			if (j < FRAMES - 1) {
-				cx[j] = cx[j + 1];
-				cy[j] = cy[j + 1];
-				cw[j] = cw[j + 1];
-				ch[j] = ch[j + 1];
-			} else {
-				cx[j] += xstep;
-				cy[j] += ystep;
-				cw[j] += wstep;
-				ch[j] += hstep;
-			}
-		}
+	ResizeAnimation *anim = data;
+	int j, k;
+
+	for (j = 0; j < MINIATURIZE_ANIMATION_FRAMES_Z; j++) {
+		k = frame - (MINIATURIZE_ANIMATION_FRAMES_Z - 1 - j);
+		if (k < 0)
+			k = 0;
+
+		anim->rects[j].x = (int)(anim->x + k * anim->xstep);
+		anim->rects[j].y = (int)(anim->y + k * anim->ystep);
+		anim->rects[j].width = (int)(anim->w + k * anim->wstep);
+		anim->rects[j].height = (int)(anim->h + k * anim->hstep);
 	}
+	XDrawRectangles(dpy, anim->scr->root_win, anim->scr->frame_gc, anim->rects, MINIATURIZE_ANIMATION_FRAMES_Z);
 
-	for (j = 0; j < FRAMES; j++)
-		XDrawRectangle(dpy, scr->root_win, scr->frame_gc, (int)cx[j], (int)cy[j], (int)cw[j], (int)ch[j]);
-	XFlush(dpy);
-	wusleep(MINIATURIZE_ANIMATION_DELAY_Z);
+	return True;
+}
 
-	for (j = 0; j < FRAMES; j++)
-		XDrawRectangle(dpy, scr->root_win, scr->frame_gc, (int)cx[j], (int)cy[j], (int)cw[j], (int)ch[j]);
+static void eraseResizeZoom(void *data)
+{
+	ResizeAnimation *anim = data;
 
-	XUngrabServer(dpy);
+	XDrawRectangles(dpy, anim->scr->root_win, anim->scr->frame_gc, anim->rects, MINIATURIZE_ANIMATION_FRAMES_Z);
 }
 
-#undef FRAMES
+static void animateResizeZoom(WScreen *scr, int x, int y, int w, int h, int fx, int fy, int fw, int fh, int steps)
+{
+	ResizeAnimation anim;
+
+	initResizeAnimation(&anim, scr, x, y, w, h, fx, fy, fw, fh, steps);
+
+	XGrabServer(dpy);
+	wAnimationRun(steps + 1, MINIATURIZE_ANIMATION_DELAY_Z, drawResizeZoom, eraseResizeZoom, &anim);
+	XUngrabServer(dpy);
+}
 
 void animateResize(WScreen *scr, int x, int y, int w, int h, int fx, int fy, int fw, int fh)
 {
@@ -1261,6 +1267,7 @@ void wIconifyWindow(WWindow *wwin)
 			Window baz;
 
 			XRaiseWindow(dpy, wwin->frame->core->window);
+			ForgetStackingPosition(wwin->frame->core);
 			XTranslateCoordinates(dpy, wwin->client_win, wwin->screen_ptr->root_win, 0, 0, &x, &y, &baz);
 
 			w = attribs.width;
@@ -1967,7 +1974,7 @@ void wArrangeIcons(WScreen *scr, Bool arrangeAll)
 			if (aicon->x_pos != X || aicon->y_pos != Y) {
 #ifdef USE_ANIMATIONS
 				if (!wPreferences.no_animations)
-					slide_window(aicon->icon->core->window, aicon->x_pos, aicon->y_pos, X, Y);
+					slide_window(aicon->icon->core->window, aicon->x_pos, aicon->y_pos, X, Y, NULL, NULL);
 #endif /* USE_ANIMATIONS */
 			}
 			wAppIconMove(aicon, X, Y);
@@ -2096,72 +2103,128 @@ void movePionterToWindowCenter(WWindow *wwin)
 
 /*
  * Do the animation while shading (called with what = SHADE)
- * or unshading (what = UNSHADE).
+ * or unshading (what = UNSHADE). The window keeps handling
+ * events meanwhile, and is finished being (un)shaded once the
+ * animation is over. Returns False if there is no animation.
  */
 #ifdef USE_ANIMATIONS
-static void shade_animate(WWindow *wwin, Bool what)
+typedef struct ShadeAnimation {
+	WWindow *wwin;			/* NULL if the window went away */
+	WAnimation *animation;
+	Bool what;
+	int y, h, step, width;
+	time_t time0;
+} ShadeAnimation;
+
+static Bool drawShade(int frame, void *data)
+{
+	ShadeAnimation *anim = data;
+
+	XMoveWindow(dpy, anim->wwin->client_win, 0, anim->y + frame * anim->step);
+	XResizeWindow(dpy, anim->wwin->frame->core->window, anim->width, anim->h + frame * anim->step);
+
+	return time(NULL) - anim->time0 <= MAX_ANIMATION_TIME;
+}
+
+static void finishShadeAnimation(void *data)
+{
+	ShadeAnimation *anim = data;
+	WWindow *wwin = anim->wwin;
+
+	if (wwin) {
+		wwin->shade_animation = NULL;
+		XMoveWindow(dpy, wwin->client_win, 0, wwin->frame->top_width);
+
+		if (anim->what == SHADE)
+			finishShade(wwin);
+		else
+			finishUnshade(wwin);
+	}
+	wfree(anim);
+}
+
+static Bool shade_animate(WWindow *wwin, Bool what)
 {
-	int y, s, w, h;
-	time_t time0 = time(NULL);
+	ShadeAnimation *anim;
+	int h, y, s, end, frames;
+	long delay;
 
 	if (wwin->flags.skip_next_animation || wPreferences.no_animations)
-		return;
+		return False;
 
 	switch (what) {
 	case SHADE:
-		if (!wwin->screen_ptr->flags.startup) {
-			/* do the shading animation */
-			h = wwin->frame->core->height;
-			s = h / SHADE_STEPS;
-			if (s < 1)
-				s = 1;
-			w = wwin->frame->core->width;
-			y = wwin->frame->top_width;
-			while (h > wwin->frame->top_width + 1) {
-				XMoveWindow(dpy, wwin->client_win, 0, y);
-				XResizeWindow(dpy, wwin->frame->core->window, w, h);
-				XFlush(dpy);
-
-				if (time(NULL) - time0 > MAX_ANIMATION_TIME)
-					break;
+		if (wwin->screen_ptr->flags.startup)
+			return False;
 
-				if (SHADE_DELAY > 0)
-					wusleep(SHADE_DELAY * 1000L);
-				else
-					wusleep(10);
-				h -= s;
-			y -= s;
-			}
-			XMoveWindow(dpy, wwin->client_win, 0, wwin->frame->top_width);
-		}
+		h = wwin->frame->core->height;
+		s = h / SHADE_STEPS;
+		if (s < 1)
+			s = 1;
+		y = wwin->frame->top_width;
+		end = wwin->frame->top_width + 1;
+		frames = (h - end + s - 1) / s;
+		delay = SHADE_DELAY * 1000L;
+		s = -s;
 		break;
 
 	case UNSHADE:
+	default:
 		h = wwin->frame->top_width + wwin->frame->bottom_width;
 		y = wwin->frame->top_width - wwin->client.height;
 		s = abs(y) / SHADE_STEPS;
 		if (s < 1)
 			s = 1;
-		w = wwin->frame->core->width;
+		end = wwin->client.height + wwin->frame->top_width + wwin->frame->bottom_width;
+		frames = (end - h + s - 1) / s;
+		delay = SHADE_DELAY * 2000L / 3;
+
 		XMoveWindow(dpy, wwin->client_win, 0, y);
-		if (s > 0) {
-			while (h < wwin->client.height + wwin->frame->top_width + wwin->frame->bottom_width) {
-				XResizeWindow(dpy, wwin->frame->core->window, w, h);
-				XMoveWindow(dpy, wwin->client_win, 0, y);
-				XFlush(dpy);
-				if (SHADE_DELAY > 0)
-					wusleep(SHADE_DELAY * 2000L / 3);
-				else
-					wusleep(10);
-				h += s;
-				y += s;
+		break;
+	}
 
-				if (time(NULL) - time0 > MAX_ANIMATION_TIME)
-					break;
-			}
-		}
+	if (frames <= 0) {
 		XMoveWindow(dpy, wwin->client_win, 0, wwin->frame->top_width);
-		break;
+		return False;
 	}
+
+	anim = wmalloc(sizeof(ShadeAnimation));
+	anim->wwin = wwin;
+	anim->what = what;
+	anim->width = wwin->frame->core->width;
+	anim->h = h;
+	anim->y = y;
+	anim->step = s;
+	anim->time0 = time(NULL);
+
+	wwin->shade_animation = anim;
+	anim->animation = wAnimationStart(frames, delay, drawShade, finishShadeAnimation, anim);
+
+	return True;
 }
 #endif
+
+void wStopShadeAnimation(WWindow *wwin, Bool complete)
+{
+#ifdef USE_ANIMATIONS
+	ShadeAnimation *anim = wwin->shade_animation;
+	unsigned int skip;
+
+	if (!anim)
+		return;
+
+	if (!complete) {
+		anim->wwin = NULL;
+		wwin->shade_animation = NULL;
+	}
+
+	/* it may have been set by the caller for what it does next */
+	skip = wwin->flags.skip_next_animation;
+	wAnimationStop(anim->animation);
+	wwin->flags.skip_next_animation = skip;
+#else
+	/* Parameters not used, but tell the compiler that it is ok */
+	(void) wwin;
+	(void) complete;
+#endif
+}
@@ -48,6 +48,7 @@ void wMouseResizeWindow(WWindow *wwin, XEvent *ev);
 
 void wShadeWindow(WWindow *wwin);
 void wUnshadeWindow(WWindow *wwin);
+void wStopShadeAnimation(WWindow *wwin, Bool complete);
 
 void wIconifyWindow(WWindow *wwin);
 void wDeiconifyWindow(WWindow *wwin);
@@ -0,0 +1,245 @@
+/* animation.c - frame pacing for animations
+ *
+ *  Window Maker window manager
+ *
+ *  Copyright (c) 2014 Window Maker Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "wconfig.h"
+
+#include <X11/Xlib.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include "WindowMaker.h"
+#include "animation.h"
+
+
+/*
+ * Animations are timed against the monotonic clock: the frame drawn is
+ * the one due at the current time, so when the server or the window
+ * manager is slow frames get dropped instead of stretching the whole
+ * animation.
+ */
+
+struct WAnimation {
+	WAnimationDrawProc *draw;
+	WAnimationProc *finish;
+	void *data;
+
+	int frames;
+	long delay;			/* microseconds between frames */
+	int last_frame;
+	Bool done;			/* nothing is left to draw */
+	struct timespec start;
+};
+
+static struct {
+	WMArray *active;		/* animations played from timers */
+	WMHandlerID timer;
+
+	unsigned long rendered;
+	unsigned long skipped;
+} animations;
+
+
+static long elapsedSince(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L;
+}
+
+/*
+ * Returns the frame that should be drawn next, or -1 if the last frame
+ * of the animation was already drawn.
+ */
+static int nextFrame(int frames, long delay, int last, long elapsed)
+{
+	int frame;
+
+	if (frames > 0 && last >= frames - 1)
+		return -1;
+
+	frame = (delay > 0) ? elapsed / delay : last + 1;
+	if (frame <= last)
+		frame = last + 1;
+	if (frames > 0 && frame >= frames)
+		frame = frames - 1;
+
+	animations.skipped += frame - last - 1;
+	animations.rendered++;
+
+	return frame;
+}
+
+void wAnimationRun(int frames, long delay, WAnimationDrawProc *draw, WAnimationProc *erase, void *data)
+{
+	struct timespec start;
+	long wait;
+	int frame, last;
+	Bool more;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	last = -1;
+	do {
+		frame = nextFrame(frames, delay, last, elapsedSince(&start));
+		if (frame < 0)
+			break;
+
+		more = (*draw) (frame, data);
+		XFlush(dpy);
+		last = frame;
+
+		/* keep the frame on screen until the next one is due */
+		wait = (last + 1) * delay - elapsedSince(&start);
+		if (wait > 0)
+			wusleep(wait);
+
+		if (erase)
+			(*erase) (data);
+	} while (more);
+}
+
+static void finishAnimation(WAnimation *anim)
+{
+	if (anim->finish)
+		(*anim->finish) (anim->data);
+	wfree(anim);
+}
+
+static void animationTick(void *foo);
+
+/* Sets the timer for the animation that is due first */
+static void scheduleAnimations(void)
+{
+	WAnimation *anim;
+	long due, next;
+	int i;
+
+	if (animations.timer)
+		WMDeleteTimerHandler(animations.timer);
+	animations.timer = NULL;
+
+	next = -1;
+	for (i = 0; i < WMGetArrayItemCount(animations.active); i++) {
+		anim = WMGetFromArray(animations.active, i);
+
+		due = anim->done ? 0 : (anim->last_frame + 1) * anim->delay - elapsedSince(&anim->start);
+		if (due < 0)
+			due = 0;
+		if (next < 0 || due < next)
+			next = due;
+	}
+
+	if (next >= 0)
+		animations.timer = WMAddTimerHandler(next > 1000 ? next / 1000 : 1, animationTick, NULL);
+}
+
+static void animationTick(void *foo)
+{
+	WAnimation *anim;
+	int i, frame;
+
+	/* Parameter not used, but tell the compiler that it is ok */
+	(void) foo;
+
+	animations.timer = NULL;
+
+	i = 0;
+	while (i < WMGetArrayItemCount(animations.active)) {
+		anim = WMGetFromArray(animations.active, i);
+
+		/* the tick might be for some other animation */
+		if (!anim->done && elapsedSince(&anim->start) >= (anim->last_frame + 1) * anim->delay) {
+			frame = nextFrame(anim->frames, anim->delay, anim->last_frame, elapsedSince(&anim->start));
+			if (frame < 0) {
+				anim->done = True;
+			} else {
+				anim->done = !(*anim->draw) (frame, anim->data);
+				anim->last_frame = frame;
+			}
+		}
+
+		if (anim->done) {
+			WMDeleteFromArray(animations.active, i);
+			finishAnimation(anim);
+
+			/*
+			 * The finish procedure may have started or stopped other
+			 * animations. Those already drawn are not due again, so
+			 * going through the list again only picks up the changes.
+			 */
+			i = 0;
+			continue;
+		}
+		i++;
+	}
+	XFlush(dpy);
+
+	scheduleAnimations();
+}
+
+WAnimation *wAnimationStart(int frames, long delay, WAnimationDrawProc *draw, WAnimationProc *finish, void *data)
+{
+	WAnimation *anim;
+
+	anim = wmalloc(sizeof(WAnimation));
+	anim->draw = draw;
+	anim->finish = finish;
+	anim->data = data;
+	anim->frames = frames;
+	anim->delay = delay;
+	clock_gettime(CLOCK_MONOTONIC, &anim->start);
+
+	if (!animations.active)
+		animations.active = WMCreateArray(4);
+	WMAddToArray(animations.active, anim);
+
+	/*
+	 * The first frame is drawn right away, but even if it is the last
+	 * one the animation only finishes from the timer, so the caller
+	 * can keep the animation until the finish procedure is called.
+	 */
+	anim->last_frame = nextFrame(frames, delay, -1, 0);
+	anim->done = !(*draw) (anim->last_frame, data);
+	XFlush(dpy);
+
+	scheduleAnimations();
+
+	return anim;
+}
+
+void wAnimationStop(WAnimation *anim)
+{
+	WMRemoveFromArray(animations.active, anim);
+	finishAnimation(anim);
+
+	scheduleAnimations();
+}
+
+#ifdef DEBUG
+void wAnimationPrintStatistics(void)
+{
+	printf("animations: %lu frames rendered, %lu skipped\n",
+	       animations.rendered, animations.skipped);
+}
+#endif
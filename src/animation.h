@@ -0,0 +1,60 @@
+/*
+ *  Window Maker window manager
+ *
+ *  Copyright (c) 2014 Window Maker Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef WMANIMATION_H_
+#define WMANIMATION_H_
+
+/*
+ * Draws the given frame of an animation. Frames may be skipped when
+ * drawing falls behind, so the frame must be computed from its number
+ * alone. Returns False when there is nothing left to draw.
+ */
+typedef Bool WAnimationDrawProc(int frame, void *data);
+
+typedef void WAnimationProc(void *data);
+
+typedef struct WAnimation WAnimation;
+
+/*
+ * Plays an animation of the given number of frames (0 if the draw
+ * procedure decides when it ends), one every delay microseconds, and
+ * returns when it is over. erase is called before the next frame is
+ * drawn, for animations that draw over other windows.
+ */
+void wAnimationRun(int frames, long delay, WAnimationDrawProc *draw, WAnimationProc *erase, void *data);
+
+/*
+ * Plays an animation from timers, while events keep being handled.
+ * finish is called once it is over, never before this returns, and
+ * the animation returned can be used until then.
+ */
+WAnimation *wAnimationStart(int frames, long delay, WAnimationDrawProc *draw, WAnimationProc *finish, void *data);
+
+/*
+ * Ends an animation started with wAnimationStart() without drawing its
+ * remaining frames. Its finish procedure is called right away.
+ */
+void wAnimationStop(WAnimation *anim);
+
+#ifdef DEBUG
+void wAnimationPrintStatistics(void);
+#endif
+
+#endif
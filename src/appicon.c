@@ -777,6 +777,9 @@ Bool wHandleAppIconMove(WAppIcon *aicon, XEvent *event)
 	if (wPreferences.flags.noupdates && originalDock != NULL)
 		return False;
 
+	/* the icon may still be sliding from where it was put last */
+	stop_window_slide(icon->core->window);
+
 	if (!(event->xbutton.state & MOD_MASK))
 		wRaiseFrame(icon->core);
 	else {
@@ -971,7 +974,7 @@ Bool wHandleAppIconMove(WAppIcon *aicon, XEvent *event)
 
 			Bool docked = False;
 			if (ondock) {
-				slide_window(icon->core->window, x, y, shad_x, shad_y);
+				slide_window(icon->core->window, x, y, shad_x, shad_y, NULL, NULL);
 				XUnmapWindow(dpy, scr->dock_shadow);
 				if (originalDock == NULL) { // docking an undocked appicon
 					docked = wDockAttachIcon(lastDock, aicon, ix, iy, False);
@@ -984,7 +987,7 @@ Bool wHandleAppIconMove(WAppIcon *aicon, XEvent *event)
 							// Also fill the gap left in the drawer
 							wDrawerFillTheGap(lastDock, aicon, False);
 						}
-						slide_window(icon->core->window, x, y, oldX, oldY);
+						slide_window(icon->core->window, x, y, oldX, oldY, NULL, NULL);
 					}
 				}
 				else { // moving a docked appicon to a dock
@@ -1020,7 +1023,7 @@ Bool wHandleAppIconMove(WAppIcon *aicon, XEvent *event)
 								// Trust the appicon is inserted at exactly the same place, so its oldX/oldY are consistent with its "new" location?
 							}
 
-							slide_window(icon->core->window, x, y, oldX, oldY);
+							slide_window(icon->core->window, x, y, oldX, oldY, NULL, NULL);
 							wDockReattachIcon(originalDock, aicon, aicon->xindex, aicon->yindex);
 						}
 						else {
@@ -1237,7 +1240,7 @@ WAppIcon *wAppIconFor(Window window)
 	if (window == None)
 		return NULL;
 
-	if (XFindContext(dpy, window, w_global.context.client_win, (XPointer *) & desc) == XCNOENT)
+	if ((desc = wCoreFindDescriptor(window)) == NULL)
 		return NULL;
 
 	if (desc->parent_type == WCLASS_APPICON || desc->parent_type == WCLASS_DOCK_ICON)
@@ -193,7 +193,7 @@ void wApplicationDestroy(WApplication *wapp)
 	if (wwin) {
 		/* undelete client window context that was deleted in
 		 * wWindowDestroy */
-		XSaveContext(dpy, wwin->client_win, w_global.context.client_win, (XPointer) & wwin->client_descriptor);
+		wCoreRegisterWindow(wwin->client_win, &wwin->client_descriptor);
 	}
 	wfree(wapp);
 }
@@ -31,6 +31,7 @@
 #endif
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #include <wraster.h>
@@ -46,6 +47,26 @@
 #include "misc.h"
 
 
+/*
+ * Rendered balloons are kept in a small cache, most recently used
+ * first, so that sweeping the pointer back and forth over the same
+ * icons and titlebars doesn't measure and draw the same text again.
+ */
+#define BALLOON_CACHE_SIZE	16
+
+typedef struct BalloonCacheEntry {
+	/* key */
+	char *text;
+	WMFont *font;
+	int side;
+	Pixmap preview;			/* None for text balloons */
+	int size;			/* preview size it was rendered for */
+
+	Pixmap pixmap;
+	Pixmap mask;			/* None if the balloon is not shaped */
+	int width, height;
+} BalloonCacheEntry;
+
 typedef struct _WBalloon {
 	Window window;
 
@@ -60,9 +81,11 @@ typedef struct _WBalloon {
 
 	WMHandlerID timer;
 
-	Pixmap contents;
 	Pixmap mini_preview;
 
+	BalloonCacheEntry cache[BALLOON_CACHE_SIZE];
+	int cache_count;
+
 	char mapped;
 	char ignoreTimer;
 } WBalloon;
@@ -72,6 +95,85 @@ typedef struct _WBalloon {
 #define LEFT	0
 #define RIGHT	2
 
+static void freeCacheEntry(BalloonCacheEntry *entry)
+{
+	wfree(entry->text);
+	if (entry->pixmap != None)
+		XFreePixmap(dpy, entry->pixmap);
+	if (entry->mask != None)
+		XFreePixmap(dpy, entry->mask);
+}
+
+static void flushCache(WBalloon *bal)
+{
+	int i;
+
+	for (i = 0; i < bal->cache_count; i++)
+		freeCacheEntry(&bal->cache[i]);
+	bal->cache_count = 0;
+}
+
+/*
+ * Looks up a rendered balloon and moves it to the front of the cache.
+ * A side of -1 matches a balloon rendered for any side, which is enough
+ * to learn its size.
+ */
+static BalloonCacheEntry *findCachedBalloon(WBalloon *bal, const char *text, WMFont *font,
+					    int side, Pixmap preview, int size)
+{
+	BalloonCacheEntry tmp;
+	int i;
+
+	for (i = 0; i < bal->cache_count; i++) {
+		BalloonCacheEntry *entry = &bal->cache[i];
+
+		if (entry->font == font && entry->preview == preview && entry->size == size
+		    && (side < 0 || entry->side == side) && strcmp(entry->text, text) == 0)
+			break;
+	}
+	if (i == bal->cache_count)
+		return NULL;
+
+	if (i > 0) {
+		tmp = bal->cache[i];
+		memmove(&bal->cache[1], &bal->cache[0], i * sizeof(BalloonCacheEntry));
+		bal->cache[0] = tmp;
+	}
+	return &bal->cache[0];
+}
+
+/* Adds an empty entry at the front of the cache, evicting the oldest one */
+static BalloonCacheEntry *addCachedBalloon(WBalloon *bal, const char *text, WMFont *font,
+					   int side, Pixmap preview, int size)
+{
+	BalloonCacheEntry *entry;
+
+	if (bal->cache_count == BALLOON_CACHE_SIZE)
+		freeCacheEntry(&bal->cache[--bal->cache_count]);
+
+	memmove(&bal->cache[1], &bal->cache[0], bal->cache_count * sizeof(BalloonCacheEntry));
+	bal->cache_count++;
+
+	entry = &bal->cache[0];
+	entry->text = wstrdup(text);
+	entry->font = font;
+	entry->side = side;
+	entry->preview = preview;
+	entry->size = size;
+	entry->pixmap = None;
+	entry->mask = None;
+
+	return entry;
+}
+
+static void appearanceObserver(void *self, WMNotification *notif)
+{
+	uintptr_t flags = (uintptr_t)WMGetNotificationClientData(notif);
+
+	if (flags & (WColorSettings | WTextureSettings | WFontSettings))
+		flushCache((WBalloon *) self);
+}
+
 static int countLines(const char *text)
 {
 	const char *p = text;
@@ -263,25 +365,27 @@ static Pixmap makePixmap(WScreen *scr, int width, int height, int side, Pixmap *
 
 static void showText(WScreen *scr, int x, int y, int h, int w, const char *text)
 {
+	BalloonCacheEntry *entry;
 	int width;
 	int height;
-	Pixmap pixmap;
-	Pixmap mask;
 	WMFont *font = scr->info_text_font;
 	int side = 0;
 	int ty;
 	int bx, by;
 
-	if (scr->balloon->contents)
-		XFreePixmap(dpy, scr->balloon->contents);
-
-	width = getMaxStringWidth(font, text) + 16;
-	height = countLines(text) * WMFontHeight(font) + 4;
+	entry = findCachedBalloon(scr->balloon, text, font, -1, None, 0);
+	if (entry) {
+		width = entry->width;
+		height = entry->height;
+	} else {
+		width = getMaxStringWidth(font, text) + 16;
+		height = countLines(text) * WMFontHeight(font) + 4;
 
-	if (height < 16)
-		height = 16;
-	if (width < height)
-		width = height;
+		if (height < 16)
+			height = 16;
+		if (width < height)
+			width = height;
+	}
 
 	if (x + width > scr->scr_width) {
 		side = RIGHT;
@@ -304,16 +408,22 @@ static void showText(WScreen *scr, int x, int y, int h, int w, const char *text)
 		by = y - (height + SPACE);
 		ty = 0;
 	}
-	pixmap = makePixmap(scr, width, height, side, &mask);
 
-	drawMultiLineString(scr->wmscreen, pixmap, scr->black, font, 8, ty + 2, text, strlen(text));
+	if (!entry || entry->side != side)
+		entry = findCachedBalloon(scr->balloon, text, font, side, None, 0);
+	if (!entry) {
+		entry = addCachedBalloon(scr->balloon, text, font, side, None, 0);
+		entry->width = width;
+		entry->height = height;
+		entry->pixmap = makePixmap(scr, width, height, side, &entry->mask);
 
-	XSetWindowBackgroundPixmap(dpy, scr->balloon->window, pixmap);
-	scr->balloon->contents = pixmap;
+		drawMultiLineString(scr->wmscreen, entry->pixmap, scr->black, font, 8, ty + 2, text, strlen(text));
+	}
+
+	XSetWindowBackgroundPixmap(dpy, scr->balloon->window, entry->pixmap);
 
 	XResizeWindow(dpy, scr->balloon->window, width, height + SPACE);
-	XShapeCombineMask(dpy, scr->balloon->window, ShapeBounding, 0, 0, mask, ShapeSet);
-	XFreePixmap(dpy, mask);
+	XShapeCombineMask(dpy, scr->balloon->window, ShapeBounding, 0, 0, entry->mask, ShapeSet);
 	XMoveWindow(dpy, scr->balloon->window, bx, by);
 	XMapRaised(dpy, scr->balloon->window);
 
@@ -323,17 +433,20 @@ static void showText(WScreen *scr, int x, int y, int h, int w, const char *text)
 
 static void showText(WScreen *scr, int x, int y, int h, int w, const char *text)
 {
+	BalloonCacheEntry *entry;
 	int width;
 	int height;
-	Pixmap pixmap;
 	WMFont *font = scr->info_text_font;
 
-	if (scr->balloon->contents)
-		XFreePixmap(dpy, scr->balloon->contents);
-
-	width = getMaxStringWidth(font, text) + 8;
-	/*width = WMWidthOfString(font, text, strlen(text))+8; */
-	height = countLines(text) * WMFontHeight(font) + 4;
+	entry = findCachedBalloon(scr->balloon, text, font, 0, None, 0);
+	if (entry) {
+		width = entry->width;
+		height = entry->height;
+	} else {
+		width = getMaxStringWidth(font, text) + 8;
+		/*width = WMWidthOfString(font, text, strlen(text))+8; */
+		height = countLines(text) * WMFontHeight(font) + 4;
+	}
 
 	if (x < 0)
 		x = 0;
@@ -348,51 +461,84 @@ static void showText(WScreen *scr, int x, int y, int h, int w, const char *text)
 		y -= height + 2;
 	}
 
-	if (scr->window_title_texture[0])
-		XSetForeground(dpy, scr->draw_gc, scr->window_title_texture[0]->any.color.pixel);
-	else
-		XSetForeground(dpy, scr->draw_gc, scr->light_pixel);
+	if (!entry) {
+		entry = addCachedBalloon(scr->balloon, text, font, 0, None, 0);
+		entry->width = width;
+		entry->height = height;
 
-	pixmap = XCreatePixmap(dpy, scr->root_win, width, height, scr->w_depth);
-	XFillRectangle(dpy, pixmap, scr->draw_gc, 0, 0, width, height);
+		if (scr->window_title_texture[0])
+			XSetForeground(dpy, scr->draw_gc, scr->window_title_texture[0]->any.color.pixel);
+		else
+			XSetForeground(dpy, scr->draw_gc, scr->light_pixel);
+
+		entry->pixmap = XCreatePixmap(dpy, scr->root_win, width, height, scr->w_depth);
+		XFillRectangle(dpy, entry->pixmap, scr->draw_gc, 0, 0, width, height);
 
-	drawMultiLineString(scr->wmscreen, pixmap, scr->window_title_color[0], font, 4, 2, text, strlen(text));
+		drawMultiLineString(scr->wmscreen, entry->pixmap, scr->window_title_color[0], font, 4, 2, text, strlen(text));
+	}
 
 	XResizeWindow(dpy, scr->balloon->window, width, height);
 	XMoveWindow(dpy, scr->balloon->window, x, y);
 
-	XSetWindowBackgroundPixmap(dpy, scr->balloon->window, pixmap);
+	XSetWindowBackgroundPixmap(dpy, scr->balloon->window, entry->pixmap);
 	XClearWindow(dpy, scr->balloon->window);
 	XMapRaised(dpy, scr->balloon->window);
 
-	scr->balloon->contents = pixmap;
-
 	scr->balloon->mapped = 1;
 }
 #endif				/* !SHAPED_BALLOON */
 
 static void show_minipreview(WScreen *scr, int x, int y, const char *title, Pixmap mini_preview)
 {
-	Pixmap pixmap;
+	BalloonCacheEntry *entry;
 	WMFont *font = scr->info_text_font;
 	int width, height;
 	int titleHeight;
 	char *shortenTitle;
+	int side;
 
-	if (scr->balloon->contents)
-		XFreePixmap(dpy, scr->balloon->contents);
+	/* the title is only drawn when title balloons are enabled as well */
+	side = wPreferences.miniwin_title_balloon;
 
-	width  = wPreferences.minipreview_size;
-	height = wPreferences.minipreview_size;
+	entry = findCachedBalloon(scr->balloon, title, font, side, mini_preview, wPreferences.minipreview_size);
+	if (!entry) {
+		width  = wPreferences.minipreview_size;
+		height = wPreferences.minipreview_size;
 
-	if (wPreferences.miniwin_title_balloon) {
-		shortenTitle = ShrinkString(font, title, width - MINIPREVIEW_BORDER * 2);
-		titleHeight = countLines(shortenTitle) * WMFontHeight(font) + 4;
-		height += titleHeight;
-	} else {
-		shortenTitle = NULL;
-		titleHeight = 0;
+		if (wPreferences.miniwin_title_balloon) {
+			shortenTitle = ShrinkString(font, title, width - MINIPREVIEW_BORDER * 2);
+			titleHeight = countLines(shortenTitle) * WMFontHeight(font) + 4;
+			height += titleHeight;
+		} else {
+			shortenTitle = NULL;
+			titleHeight = 0;
+		}
+
+		entry = addCachedBalloon(scr->balloon, title, font, side, mini_preview, wPreferences.minipreview_size);
+		entry->width = width;
+		entry->height = height;
+
+		if (scr->window_title_texture[0])
+			XSetForeground(dpy, scr->draw_gc, scr->window_title_texture[0]->any.color.pixel);
+		else
+			XSetForeground(dpy, scr->draw_gc, scr->light_pixel);
+
+		entry->pixmap = XCreatePixmap(dpy, scr->root_win, width, height, scr->w_depth);
+		XFillRectangle(dpy, entry->pixmap, scr->draw_gc, 0, 0, width, height);
+
+		if (shortenTitle != NULL) {
+			drawMultiLineString(scr->wmscreen, entry->pixmap, scr->window_title_color[0], font,
+							MINIPREVIEW_BORDER, MINIPREVIEW_BORDER, shortenTitle, strlen(shortenTitle));
+			wfree(shortenTitle);
+		}
+
+		XCopyArea(dpy, mini_preview, entry->pixmap, scr->draw_gc,
+			  0, 0, (wPreferences.minipreview_size - 1 - MINIPREVIEW_BORDER * 2),
+			  (wPreferences.minipreview_size - 1 - MINIPREVIEW_BORDER * 2),
+			  MINIPREVIEW_BORDER, MINIPREVIEW_BORDER + titleHeight);
 	}
+	width = entry->width;
+	height = entry->height;
 
 	if (x < 0)
 		x = 0;
@@ -407,39 +553,17 @@ static void show_minipreview(WScreen *scr, int x, int y, const char *title, Pixm
 		y -= height + 2;
 	}
 
-	if (scr->window_title_texture[0])
-		XSetForeground(dpy, scr->draw_gc, scr->window_title_texture[0]->any.color.pixel);
-	else
-		XSetForeground(dpy, scr->draw_gc, scr->light_pixel);
-
-	pixmap = XCreatePixmap(dpy, scr->root_win, width, height, scr->w_depth);
-	XFillRectangle(dpy, pixmap, scr->draw_gc, 0, 0, width, height);
-
-	if (shortenTitle != NULL) {
-		drawMultiLineString(scr->wmscreen, pixmap, scr->window_title_color[0], font,
-						MINIPREVIEW_BORDER, MINIPREVIEW_BORDER, shortenTitle, strlen(shortenTitle));
-		wfree(shortenTitle);
-	}
-
-	XCopyArea(dpy, mini_preview, pixmap, scr->draw_gc,
-	          0, 0, (wPreferences.minipreview_size - 1 - MINIPREVIEW_BORDER * 2),
-	          (wPreferences.minipreview_size - 1 - MINIPREVIEW_BORDER * 2),
-	          MINIPREVIEW_BORDER, MINIPREVIEW_BORDER + titleHeight);
-
 #ifdef SHAPED_BALLOON
 	XShapeCombineMask(dpy, scr->balloon->window, ShapeBounding, 0, 0, None, ShapeSet);
 #endif
 	XResizeWindow(dpy, scr->balloon->window, width, height);
 	XMoveWindow(dpy, scr->balloon->window, x, y);
 
-	XSetWindowBackgroundPixmap(dpy, scr->balloon->window, pixmap);
+	XSetWindowBackgroundPixmap(dpy, scr->balloon->window, entry->pixmap);
 
 	XClearWindow(dpy, scr->balloon->window);
 	XMapRaised(dpy, scr->balloon->window);
 
-
-	scr->balloon->contents = pixmap;
-
 	scr->balloon->mapped = 1;
 }
 
@@ -588,6 +712,8 @@ void wBalloonInitialize(WScreen *scr)
 
 	scr->balloon = bal;
 
+	WMAddNotificationObserver(appearanceObserver, bal, WNWindowAppearanceSettingsChanged, NULL);
+
 	vmask = CWSaveUnder | CWOverrideRedirect | CWColormap | CWBackPixel | CWBorderPixel;
 	attribs.save_under = True;
 	attribs.override_redirect = True;
@@ -650,6 +776,28 @@ void wBalloonEnteredObject(WScreen *scr, WObjDescriptor *object)
 	scr->balloon->prevType = object->parent_type;
 }
 
+/*
+ * Drops the balloons rendered from a miniwindow preview that is about
+ * to be freed, so that a later pixmap reusing its id isn't mistaken
+ * for it.
+ */
+void wBalloonForgetPreview(WScreen *scr, Pixmap preview)
+{
+	WBalloon *bal = scr->balloon;
+	int i, j;
+
+	if (!bal || preview == None)
+		return;
+
+	for (i = 0, j = 0; i < bal->cache_count; i++) {
+		if (bal->cache[i].preview == preview)
+			freeCacheEntry(&bal->cache[i]);
+		else
+			bal->cache[j++] = bal->cache[i];
+	}
+	bal->cache_count = j;
+}
+
 void wBalloonHide(WScreen *scr)
 {
 	if (scr) {
@@ -27,4 +27,6 @@ void wBalloonEnteredObject(WScreen *scr, WObjDescriptor *object);
 
 void wBalloonHide(WScreen *scr);
 
+void wBalloonForgetPreview(WScreen *scr, Pixmap preview);
+
 #endif
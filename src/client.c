@@ -183,7 +183,7 @@ void wClientConfigure(WWindow * wwin, XConfigureRequestEvent * xcre)
 		WWindow *sibling;
 
 		if ((xcre->value_mask & CWSibling) &&
-		    (XFindContext(dpy, xcre->above, w_global.context.client_win, (XPointer *) & desc) == XCSUCCESS)
+		    (desc = wCoreFindDescriptor(xcre->above)) != NULL
 		    && (desc->parent_type == WCLASS_WINDOW)) {
 			sibling = desc->parent;
 			xwc.sibling = sibling->frame->core->window;
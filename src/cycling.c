@@ -53,6 +53,7 @@ static void raiseWindow(WSwitchPanel * swpanel, WWindow * wwin)
 			XRestackWindows(dpy, win, 2);
 		} else
 			XRaiseWindow(dpy, wwin->frame->core->window);
+		ForgetStackingPosition(wwin->frame->core);
 	}
 }
 
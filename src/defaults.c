@@ -453,6 +453,8 @@ WDefaultEntry optionList[] = {
 	    &wPreferences.opaque_resize, getBool, NULL, NULL, NULL},
 	{"OpaqueMoveResizeKeyboard", "NO", NULL,
 	    &wPreferences.opaque_move_resize_keyboard, getBool, NULL, NULL, NULL},
+	{"MoveResizeRate", "60", NULL,
+	    &wPreferences.move_resize_rate, getInt, NULL, NULL, NULL},
 	{"DisableAnimations", "NO", NULL,
 	    &wPreferences.no_animations, getBool, NULL, NULL, NULL},
 	{"DontLinkWorkspaces", "YES", NULL,
@@ -36,6 +36,11 @@
 #include <dirent.h>
 #include <limits.h>
 #include <errno.h>
+#include <time.h>
+
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
 
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
@@ -288,11 +293,365 @@ ScanFiles(const char *dir, const char *prefix, unsigned acceptmask, unsigned dec
 	}
 }
 
+/*
+ * Index of the executables found in the directories of $PATH, used to
+ * complete the first word typed in the Run dialog.
+ *
+ * The index is built a batch of directory entries at a time from an idle
+ * handler, so it does not hold up the event loop, and the previous index
+ * is still used for completion while a new one is being built. With
+ * inotify the directories are watched and the index is rebuilt when they
+ * change; without it their modification times are checked when the index
+ * is used.
+ */
+#define PATH_INDEX_BATCH	64	/* directory entries examined per idle call */
+
+static struct {
+	char *path;		/* $PATH the current index was built from */
+	char **names;		/* sorted names of the executables */
+	int count;
+	Bool stale;		/* a directory changed since the build started */
+
+	struct {
+		char *path;
+		char **dirs;
+		time_t *mtimes;
+		int ndirs;
+		int dir;	/* directory being read */
+		DIR *d;
+		WMHashTable *seen;
+		char **names;
+		int count;
+		int size;
+		WMHandlerID handler;
+	} build;
+
+	/* directories of the current index, to notice changes */
+	char **dirs;
+	time_t *mtimes;
+	int ndirs;
+
+#ifdef HAVE_INOTIFY
+	int fd;
+	WMHandlerID input;
+#endif
+} pathIndex = {
+#ifdef HAVE_INOTIFY
+	.fd = -1
+#endif
+};
+
+static void pathIndexStartBuild(void);
+static void pathIndexStep(void *data);
+
+static void freeStrings(char **list, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		wfree(list[i]);
+	wfree(list);
+}
+
+static int pathIndexCompare(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void pathIndexAbortBuild(void)
+{
+	if (pathIndex.build.handler) {
+		WMDeleteIdleHandler(pathIndex.build.handler);
+		pathIndex.build.handler = NULL;
+	}
+	if (pathIndex.build.d) {
+		closedir(pathIndex.build.d);
+		pathIndex.build.d = NULL;
+	}
+	if (pathIndex.build.seen) {
+		WMFreeHashTable(pathIndex.build.seen);
+		pathIndex.build.seen = NULL;
+	}
+	if (pathIndex.build.names)
+		freeStrings(pathIndex.build.names, pathIndex.build.count);
+	if (pathIndex.build.dirs)
+		freeStrings(pathIndex.build.dirs, pathIndex.build.ndirs);
+	if (pathIndex.build.mtimes)
+		wfree(pathIndex.build.mtimes);
+	if (pathIndex.build.path)
+		wfree(pathIndex.build.path);
+
+	memset(&pathIndex.build, 0, sizeof(pathIndex.build));
+}
+
+#ifdef HAVE_INOTIFY
+static void pathIndexChanged(int fd, int mask, void *data)
+{
+	char buff[(sizeof(struct inotify_event) + NAME_MAX + 1) * 8];
+
+	/* Parameter not used, but tell the compiler that it is ok */
+	(void) mask;
+	(void) data;
+
+	/* we only care that something changed, not what */
+	if (read(fd, buff, sizeof(buff)) <= 0)
+		return;
+
+	pathIndex.stale = True;
+	if (!pathIndex.build.path)
+		pathIndexStartBuild();
+}
+
+static void pathIndexWatch(void)
+{
+	int i;
+
+	if (pathIndex.input) {
+		WMDeleteInputHandler(pathIndex.input);
+		pathIndex.input = NULL;
+	}
+	if (pathIndex.fd >= 0)
+		close(pathIndex.fd);
+
+	pathIndex.fd = inotify_init();
+	if (pathIndex.fd < 0)
+		return;
+
+	for (i = 0; i < pathIndex.build.ndirs; i++)
+		inotify_add_watch(pathIndex.fd, pathIndex.build.dirs[i],
+				  IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+				  IN_DELETE_SELF | IN_MOVE_SELF);
+
+	pathIndex.input = WMAddInputHandler(pathIndex.fd, WIReadMask, pathIndexChanged, NULL);
+}
+#endif
+
+static void pathIndexStartBuild(void)
+{
+	const char *path, *pos;
+	struct stat sb;
+	char *dir;
+	int i;
+
+	pathIndexAbortBuild();
+
+	path = getenv("PATH");
+	pathIndex.build.path = wstrdup(path ? path : "");
+
+	/* split $PATH, ignoring the empty and repeated entries */
+	for (path = pathIndex.build.path; *path; path = *pos ? pos + 1 : pos) {
+		pos = strchr(path, ':');
+		if (!pos)
+			pos = path + strlen(path);
+		if (pos == path)
+			continue;
+
+		dir = wstrndup(path, pos - path);
+		for (i = 0; i < pathIndex.build.ndirs; i++)
+			if (strcmp(pathIndex.build.dirs[i], dir) == 0)
+				break;
+		if (i < pathIndex.build.ndirs) {
+			wfree(dir);
+			continue;
+		}
+
+		pathIndex.build.dirs = wrealloc(pathIndex.build.dirs,
+						(pathIndex.build.ndirs + 1) * sizeof(char *));
+		pathIndex.build.mtimes = wrealloc(pathIndex.build.mtimes,
+						  (pathIndex.build.ndirs + 1) * sizeof(time_t));
+		pathIndex.build.dirs[pathIndex.build.ndirs] = dir;
+		pathIndex.build.mtimes[pathIndex.build.ndirs] = stat(dir, &sb) == 0 ? sb.st_mtime : 0;
+		pathIndex.build.ndirs++;
+	}
+
+	pathIndex.build.seen = WMCreateHashTable(WMStringPointerHashCallbacks);
+	pathIndex.stale = False;
+
+#ifdef HAVE_INOTIFY
+	/* watch before reading, so no change made during the build is lost */
+	pathIndexWatch();
+#endif
+
+	pathIndex.build.handler = WMAddIdleHandler(pathIndexStep, NULL);
+}
+
+static void pathIndexFinishBuild(void)
+{
+	qsort(pathIndex.build.names, pathIndex.build.count, sizeof(char *), pathIndexCompare);
+
+	if (pathIndex.names)
+		freeStrings(pathIndex.names, pathIndex.count);
+	if (pathIndex.dirs)
+		freeStrings(pathIndex.dirs, pathIndex.ndirs);
+	if (pathIndex.mtimes)
+		wfree(pathIndex.mtimes);
+	if (pathIndex.path)
+		wfree(pathIndex.path);
+
+	pathIndex.path = pathIndex.build.path;
+	pathIndex.names = pathIndex.build.names;
+	pathIndex.count = pathIndex.build.count;
+	pathIndex.dirs = pathIndex.build.dirs;
+	pathIndex.mtimes = pathIndex.build.mtimes;
+	pathIndex.ndirs = pathIndex.build.ndirs;
+
+	/* the names now belong to the index, only release the hash table */
+	WMFreeHashTable(pathIndex.build.seen);
+	memset(&pathIndex.build, 0, sizeof(pathIndex.build));
+
+	if (pathIndex.stale)
+		pathIndexStartBuild();
+}
+
+/*
+ * Reads up to 'batch' entries of the $PATH directories into the index
+ * being built, or all of them if 'batch' is 0. Returns True once the
+ * build is complete.
+ */
+static Bool pathIndexRead(int batch)
+{
+	char fullfilename[PATH_MAX];
+	struct dirent *de;
+	struct stat sb;
+	char *name;
+
+	while (pathIndex.build.dir < pathIndex.build.ndirs) {
+		if (!pathIndex.build.d) {
+			pathIndex.build.d = opendir(pathIndex.build.dirs[pathIndex.build.dir]);
+			if (!pathIndex.build.d) {
+				pathIndex.build.dir++;
+				continue;
+			}
+		}
+
+		while ((de = readdir(pathIndex.build.d)) != NULL) {
+			if (de->d_name[0] == '.' &&
+			    (de->d_name[1] == '\0' || (de->d_name[1] == '.' && de->d_name[2] == '\0')))
+				continue;
+
+			/* the first directory in $PATH providing a name wins */
+			if (WMHashGet(pathIndex.build.seen, de->d_name) != NULL)
+				continue;
+
+			snprintf(fullfilename, sizeof(fullfilename), "%s/%s",
+				 pathIndex.build.dirs[pathIndex.build.dir], de->d_name);
+
+			if (stat(fullfilename, &sb) == 0 && !S_ISDIR(sb.st_mode) &&
+			    (sb.st_mode & (S_IXOTH | S_IXGRP | S_IXUSR))) {
+				if (pathIndex.build.count == pathIndex.build.size) {
+					pathIndex.build.size = pathIndex.build.size ? pathIndex.build.size * 2 : 256;
+					pathIndex.build.names = wrealloc(pathIndex.build.names,
+									 pathIndex.build.size * sizeof(char *));
+				}
+				name = wstrdup(de->d_name);
+				pathIndex.build.names[pathIndex.build.count++] = name;
+				WMHashInsert(pathIndex.build.seen, name, name);
+			}
+
+			if (batch > 0 && --batch == 0)
+				return False;
+		}
+
+		closedir(pathIndex.build.d);
+		pathIndex.build.d = NULL;
+		pathIndex.build.dir++;
+	}
+
+	return True;
+}
+
+static void pathIndexStep(void *data)
+{
+	/* Parameter not used, but tell the compiler that it is ok */
+	(void) data;
+
+	/* the idle handler is removed by WINGs once it has been called */
+	pathIndex.build.handler = NULL;
+
+	if (pathIndexRead(PATH_INDEX_BATCH))
+		pathIndexFinishBuild();
+	else
+		pathIndex.build.handler = WMAddIdleHandler(pathIndexStep, NULL);
+}
+
+/* Starts building the index if it does not match $PATH or its directories changed */
+static void pathIndexUpdate(void)
+{
+	const char *path;
+	struct stat sb;
+	int i;
+
+	path = getenv("PATH");
+	if (!path)
+		path = "";
+
+	if (pathIndex.build.path) {
+		if (strcmp(pathIndex.build.path, path) != 0)
+			pathIndexStartBuild();
+		return;
+	}
+
+	if (!pathIndex.path || strcmp(pathIndex.path, path) != 0 || pathIndex.stale) {
+		pathIndexStartBuild();
+		return;
+	}
+
+#ifdef HAVE_INOTIFY
+	if (pathIndex.fd >= 0)
+		return;
+#endif
+	for (i = 0; i < pathIndex.ndirs; i++) {
+		if ((stat(pathIndex.dirs[i], &sb) == 0 ? sb.st_mtime : 0) != pathIndex.mtimes[i]) {
+			pathIndexStartBuild();
+			return;
+		}
+	}
+}
+
+/* Adds to 'result' the end of the names of the executables beginning with 'prefix' */
+static void pathIndexComplete(const char *prefix, WMArray *result)
+{
+	int prefixlen, lo, hi, mid;
+
+	pathIndexUpdate();
+
+	/*
+	 * Until a first index exists there is nothing to answer from, so finish
+	 * the build now; afterwards the previous index is used while the new
+	 * one is built.
+	 */
+	if (!pathIndex.names && pathIndex.build.path) {
+		if (pathIndex.build.handler) {
+			WMDeleteIdleHandler(pathIndex.build.handler);
+			pathIndex.build.handler = NULL;
+		}
+		pathIndexRead(0);
+		pathIndexFinishBuild();
+	}
+
+	/* binary search for the first name not sorting before the prefix */
+	prefixlen = strlen(prefix);
+	lo = 0;
+	hi = pathIndex.count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(pathIndex.names[mid], prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < pathIndex.count && strncmp(pathIndex.names[lo], prefix, prefixlen) == 0; lo++) {
+		if (pathIndex.names[lo][prefixlen] != '\0')
+			WMAddToArray(result, wstrdup(pathIndex.names[lo] + prefixlen));
+	}
+}
+
 static WMArray *GenerateVariants(const char *complete)
 {
 	Bool firstWord = True;
 	WMArray *variants = NULL;
-	char *pos = NULL, *path = NULL, *tmp = NULL, *dir = NULL, *prefix = NULL;
+	char *pos = NULL, *tmp = NULL, *dir = NULL, *prefix = NULL;
 
 	variants = WMCreateArrayWithDestructor(0, wfree);
 
@@ -322,20 +681,7 @@ static WMArray *GenerateVariants(const char *complete)
 	} else if (*complete == '~') {
 		WMAddToArray(variants, wstrdup("/"));
 	} else if (firstWord) {
-		path = getenv("PATH");
-		while (path) {
-			pos = strchr(path, ':');
-			if (pos) {
-				tmp = wstrndup(path, pos - path);
-				path = pos + 1;
-			} else if (*path != '\0') {
-				tmp = wstrdup(path);
-				path = NULL;
-			} else
-				break;
-			ScanFiles(tmp, complete, S_IXOTH | S_IXGRP | S_IXUSR, S_IFDIR, variants);
-			wfree(tmp);
-		}
+		pathIndexComplete(complete, variants);
 	}
 
 	WMSortArray(variants, (WMCompareDataProc *) pstrcmp);
@@ -435,6 +781,9 @@ int wAdvancedInputDialog(WScreen *scr, const char *title, const char *message, c
 	p->varpos = 0;
 	WMCreateEventHandler(WMWidgetView(p->panel->text), KeyPressMask, handleHistoryKeyPress, p);
 
+	/* get the completion index ready while the user is typing */
+	pathIndexUpdate();
+
 	parent = XCreateSimpleWindow(dpy, scr->root_win, 0, 0, 320, 160, 0, 0, 0);
 	XSelectInput(dpy, parent, KeyPressMask | KeyReleaseMask);
 
@@ -1296,6 +1296,152 @@ static WMenu *dockMenuCreate(WScreen *scr, int type)
 	return menu;
 }
 
+/*
+ * The slot map counts the icons in each slot of a square around the
+ * main icon, so that looking for a free slot doesn't have to go through
+ * all the icons. Icons outside of it can't be in the slots that
+ * wDockFindFreeSlot() looks at anyway.
+ */
+static unsigned char *dockSlot(WDock *dock, int x, int y)
+{
+	int r = dock->slot_radius;
+
+	if (!dock->slot_map || x < -r || x > r || y < -r || y > r)
+		return NULL;
+
+	return &dock->slot_map[(y + r) * (2 * r + 1) + x + r];
+}
+
+static void markSlot(WDock *dock, WAppIcon *icon, int delta)
+{
+	unsigned char *slot = dockSlot(dock, icon->xindex, icon->yindex);
+
+	if (slot)
+		*slot += delta;
+}
+
+static Bool isSlotUsed(WDock *dock, int x, int y)
+{
+	unsigned char *slot = dockSlot(dock, x, y);
+	WAppIconChain *chain;
+
+	if (slot && *slot)
+		return True;
+
+	/* omnipresent icons will come to this clip too */
+	if (dock->type == WM_CLIP) {
+		for (chain = dock->screen_ptr->global_icons; chain != NULL; chain = chain->next)
+			if (chain->aicon->xindex == x && chain->aicon->yindex == y)
+				return True;
+	}
+
+	return False;
+}
+
+/*
+ * The launch index finds the docked icons that may be waiting for a
+ * window of a given instance and class. Icons that only know one of the
+ * two match any value for the other, so they are kept apart.
+ */
+static char *launchKey(const char *wm_instance, const char *wm_class)
+{
+	char *key = wstrconcat(wm_instance, ".");
+
+	return wstrappend(key, wm_class);
+}
+
+static void addToLaunchIndex(WDock *dock, WAppIcon *icon)
+{
+	WMArray *icons;
+	char *key;
+
+	if (!icon->wm_instance && !icon->wm_class)
+		return;
+
+	if (!icon->wm_instance || !icon->wm_class) {
+		WMAddToArray(dock->launch_wildcards, icon);
+		return;
+	}
+
+	key = launchKey(icon->wm_instance, icon->wm_class);
+	icons = WMHashGet(dock->launch_index, key);
+	if (!icons) {
+		icons = WMCreateArray(1);
+		WMHashInsert(dock->launch_index, key, icons);
+	}
+	WMAddToArray(icons, icon);
+	wfree(key);
+}
+
+static void removeFromLaunchIndex(WDock *dock, WAppIcon *icon)
+{
+	WMArray *icons;
+	char *key;
+
+	if (!icon->wm_instance && !icon->wm_class)
+		return;
+
+	if (!icon->wm_instance || !icon->wm_class) {
+		WMRemoveFromArray(dock->launch_wildcards, icon);
+		return;
+	}
+
+	key = launchKey(icon->wm_instance, icon->wm_class);
+	icons = WMHashGet(dock->launch_index, key);
+	if (icons) {
+		WMRemoveFromArray(icons, icon);
+		if (WMGetArrayItemCount(icons) == 0) {
+			WMHashRemove(dock->launch_index, key);
+			WMFreeArray(icons);
+		}
+	}
+	wfree(key);
+}
+
+static void freeIndex(WDock *dock)
+{
+	if (dock->launch_index) {
+		WMHashEnumerator e = WMEnumerateHashTable(dock->launch_index);
+		WMArray *icons;
+
+		while ((icons = WMNextHashEnumeratorItem(&e)) != NULL)
+			WMFreeArray(icons);
+		WMFreeHashTable(dock->launch_index);
+		dock->launch_index = NULL;
+	}
+	if (dock->launch_wildcards) {
+		WMFreeArray(dock->launch_wildcards);
+		dock->launch_wildcards = NULL;
+	}
+	if (dock->slot_map) {
+		wfree(dock->slot_map);
+		dock->slot_map = NULL;
+	}
+}
+
+/* Recompute the indexes from the icon array, after changes made in bulk */
+void wDockRebuildIndex(WDock *dock)
+{
+	int i;
+
+	freeIndex(dock);
+
+	/* drawers are a single row, wDockFindFreeSlot() doesn't need a map */
+	if (dock->type != WM_DRAWER) {
+		dock->slot_radius = dock->max_icons;
+		dock->slot_map = wmalloc((2 * dock->slot_radius + 1) * (2 * dock->slot_radius + 1));
+	}
+	dock->launch_index = WMCreateHashTable(WMStringHashCallbacks);
+	dock->launch_wildcards = WMCreateArray(0);
+
+	for (i = 0; i < dock->max_icons; i++) {
+		if (dock->icon_array[i]) {
+			markSlot(dock, dock->icon_array[i], 1);
+			addToLaunchIndex(dock, dock->icon_array[i]);
+		}
+	}
+}
+
 WDock *wDockCreate(WScreen *scr, int type, const char *name)
 {
 	WDock *dock;
@@ -1352,6 +1498,8 @@ WDock *wDockCreate(WScreen *scr, int type, const char *name)
 		dock->auto_collapse = 1;
 	}
 
+	wDockRebuildIndex(dock);
+
 	return dock;
 }
 
@@ -1377,6 +1525,7 @@ void wDockDestroy(WDock *dock)
 	}
 	if (wPreferences.auto_arrange_icons)
 		wArrangeIcons(dock->screen_ptr, True);
+	freeIndex(dock);
 	wfree(dock->icon_array);
 	if (dock->menu && dock->type != WM_CLIP)
 		wMenuDestroy(dock->menu, True);
@@ -1995,6 +2144,8 @@ WDock *wDockRestoreState(WScreen *scr, WMPropList *dock_state, int type)
 finish:
 	WMReleasePropList(dock_state);
 
+	wDockRebuildIndex(dock);
+
 	return dock;
 }
 
@@ -2187,6 +2338,8 @@ Bool wDockAttachIcon(WDock *dock, WAppIcon *icon, int x, int y, Bool update_icon
 	dock->icon_array[index] = icon;
 	icon->yindex = y;
 	icon->xindex = x;
+	markSlot(dock, icon, 1);
+	addToLaunchIndex(dock, icon);
 
 	icon->omnipresent = 0;
 
@@ -2251,8 +2404,10 @@ void wDockReattachIcon(WDock *dock, WAppIcon *icon, int x, int y)
 	}
 	assert(index < dock->max_icons);
 
+	markSlot(dock, icon, -1);
 	icon->yindex = y;
 	icon->xindex = x;
+	markSlot(dock, icon, 1);
 
 	icon->x_pos = dock->x_pos + x * ICON_SIZE;
 	icon->y_pos = dock->y_pos + y * ICON_SIZE;
@@ -2315,6 +2470,8 @@ Bool wDockMoveIconBetweenDocks(WDock *src, WDock *dest, WAppIcon *icon, int x, i
 	}
 	assert(index < src->max_icons);
 
+	markSlot(src, icon, -1);
+	removeFromLaunchIndex(src, icon);
 	src->icon_array[index] = NULL;
 	src->icon_count--;
 
@@ -2351,6 +2508,8 @@ Bool wDockMoveIconBetweenDocks(WDock *src, WDock *dest, WAppIcon *icon, int x, i
 
 	icon->yindex = y;
 	icon->xindex = x;
+	markSlot(dest, icon, 1);
+	addToLaunchIndex(dest, icon);
 
 	icon->x_pos = dest->x_pos + x * ICON_SIZE;
 	icon->y_pos = dest->y_pos + y * ICON_SIZE;
@@ -2419,6 +2578,8 @@ void wDockDetach(WDock *dock, WAppIcon *icon)
 			break;
 
 	assert(index < dock->max_icons);
+	markSlot(dock, icon, -1);
+	removeFromLaunchIndex(dock, icon);
 	dock->icon_array[index] = NULL;
 	icon->yindex = -1;
 	icon->xindex = -1;
@@ -2715,9 +2876,6 @@ static int onScreen(WScreen *scr, int x, int y)
 Bool wDockFindFreeSlot(WDock *dock, int *x_pos, int *y_pos)
 {
 	WScreen *scr = dock->screen_ptr;
-	WAppIcon *btn;
-	WAppIconChain *chain;
-	unsigned char *slot_map;
 	int mwidth;
 	int r;
 	int x, y;
@@ -2773,160 +2931,42 @@ Bool wDockFindFreeSlot(WDock *dock, int *x_pos, int *y_pos)
 	/* If the clip is in the corner, use only slots that are in the border
 	 * of the screen */
 	if (corner != C_NONE) {
-		char *hmap, *vmap;
-		int hcount, vcount;
+		int hcount, vcount, xsign, ysign;
 
 		hcount = WMIN(dock->max_icons, scr->scr_width / ICON_SIZE);
 		vcount = WMIN(dock->max_icons, scr->scr_height / ICON_SIZE);
-		hmap = wmalloc(hcount + 1);
-		vmap = wmalloc(vcount + 1);
-
-		/* mark used positions */
-		switch (corner) {
-		case C_NE:
-			for (i = 0; i < dock->max_icons; i++) {
-				btn = dock->icon_array[i];
-				if (!btn)
-					continue;
-
-				if (btn->xindex == 0 && btn->yindex > 0 && btn->yindex < vcount)
-					vmap[btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex > 0 && btn->xindex < hcount)
-					hmap[btn->xindex] = 1;
-			}
-			for (chain = scr->global_icons; chain != NULL; chain = chain->next) {
-				btn = chain->aicon;
-				if (btn->xindex == 0 && btn->yindex > 0 && btn->yindex < vcount)
-					vmap[btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex > 0 && btn->xindex < hcount)
-					hmap[btn->xindex] = 1;
-			}
-			break;
-		case C_NW:
-			for (i = 0; i < dock->max_icons; i++) {
-				btn = dock->icon_array[i];
-				if (!btn)
-					continue;
-
-				if (btn->xindex == 0 && btn->yindex > 0 && btn->yindex < vcount)
-					vmap[btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex < 0 && btn->xindex > -hcount)
-					hmap[-btn->xindex] = 1;
-			}
-			for (chain = scr->global_icons; chain != NULL; chain = chain->next) {
-				btn = chain->aicon;
-				if (btn->xindex == 0 && btn->yindex > 0 && btn->yindex < vcount)
-					vmap[btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex < 0 && btn->xindex > -hcount)
-					hmap[-btn->xindex] = 1;
-			}
-			break;
-		case C_SE:
-			for (i = 0; i < dock->max_icons; i++) {
-				btn = dock->icon_array[i];
-				if (!btn)
-					continue;
+		xsign = (corner == C_NE || corner == C_SE) ? 1 : -1;
+		ysign = (corner == C_NW || corner == C_NE) ? 1 : -1;
 
-				if (btn->xindex == 0 && btn->yindex < 0 && btn->yindex > -vcount)
-					vmap[-btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex > 0 && btn->xindex < hcount)
-					hmap[btn->xindex] = 1;
-			}
-			for (chain = scr->global_icons; chain != NULL; chain = chain->next) {
-				btn = chain->aicon;
-				if (btn->xindex == 0 && btn->yindex < 0 && btn->yindex > -vcount)
-					vmap[-btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex > 0 && btn->xindex < hcount)
-					hmap[btn->xindex] = 1;
-			}
-			break;
-		case C_SW:
-		default:
-			for (i = 0; i < dock->max_icons; i++) {
-				btn = dock->icon_array[i];
-				if (!btn)
-					continue;
-
-				if (btn->xindex == 0 && btn->yindex < 0 && btn->yindex > -vcount)
-					vmap[-btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex < 0 && btn->xindex > -hcount)
-					hmap[-btn->xindex] = 1;
-			}
-			for (chain = scr->global_icons; chain != NULL; chain = chain->next) {
-				btn = chain->aicon;
-				if (btn->xindex == 0 && btn->yindex < 0 && btn->yindex > -vcount)
-					vmap[-btn->yindex] = 1;
-				else if (btn->yindex == 0 && btn->xindex < 0 && btn->xindex > -hcount)
-					hmap[-btn->xindex] = 1;
-			}
-		}
-		x = 0;
-		y = 0;
-		done = 0;
 		/* search a vacant slot */
 		for (i = 1; i < WMAX(vcount, hcount); i++) {
-			if (i < vcount && vmap[i] == 0) {
-				/* found a slot */
-				x = 0;
-				y = i;
-				done = 1;
-				break;
-			} else if (i < hcount && hmap[i] == 0) {
-				/* found a slot */
-				x = i;
-				y = 0;
-				done = 1;
-				break;
+			if (i < vcount && !isSlotUsed(dock, 0, ysign * i)) {
+				*x_pos = 0;
+				*y_pos = ysign * i;
+				return True;
+			} else if (i < hcount && !isSlotUsed(dock, xsign * i, 0)) {
+				*x_pos = xsign * i;
+				*y_pos = 0;
+				return True;
 			}
 		}
-		wfree(vmap);
-		wfree(hmap);
-		/* If found a slot, translate and return */
-		if (done) {
-			if (corner == C_NW || corner == C_NE)
-				*y_pos = y;
-			else
-				*y_pos = -y;
-
-			if (corner == C_NE || corner == C_SE)
-				*x_pos = x;
-			else
-				*x_pos = -x;
-
-			return True;
-		}
 		/* else, try to find a slot somewhere else */
 	}
 
-	/* a map of mwidth x mwidth would be enough if we allowed icons to be
+	/* a square of mwidth x mwidth would be enough if we allowed icons to be
 	 * placed outside of screen */
 	mwidth = (int)ceil(sqrt(dock->max_icons));
 
 	/* In the worst case (the clip is in the corner of the screen),
 	 * the amount of icons that fit in the clip is smaller.
-	 * Double the map to get a safe value.
+	 * Double the square to get a safe value.
 	 */
 	mwidth += mwidth;
 
 	r = (mwidth - 1) / 2;
 
-	slot_map = wmalloc(mwidth * mwidth);
-
-#define XY2OFS(x,y) (WMAX(abs(x),abs(y)) > r) ? 0 : (((y)+r)*(mwidth)+(x)+r)
-
-	/* mark used slots in the map. If the slot falls outside the map
-	 * (for example, when all icons are placed in line), ignore them. */
-	for (i = 0; i < dock->max_icons; i++) {
-		btn = dock->icon_array[i];
-		if (btn)
-			slot_map[XY2OFS(btn->xindex, btn->yindex)] = 1;
-	}
-
-	for (chain = scr->global_icons; chain != NULL; chain = chain->next)
-		slot_map[XY2OFS(chain->aicon->xindex, chain->aicon->yindex)] = 1;
-
 	/* Find closest slot from the center that is free by scanning the
-	 * map from the center to outward in circular passes.
+	 * square from the center to outward in circular passes.
 	 * This will not result in a neat layout, but will be optimal
 	 * in the sense that there will not be holes left.
 	 */
@@ -2939,7 +2979,7 @@ Bool wDockFindFreeSlot(WDock *dock, int *x_pos, int *y_pos)
 			tx = dock->x_pos + x * ICON_SIZE;
 			y = -i;
 			ty = dock->y_pos + y * ICON_SIZE;
-			if (slot_map[XY2OFS(x, y)] == 0 && onScreen(scr, tx, ty)) {
+			if (!isSlotUsed(dock, x, y) && onScreen(scr, tx, ty)) {
 				*x_pos = x;
 				*y_pos = y;
 				done = 1;
@@ -2947,7 +2987,7 @@ Bool wDockFindFreeSlot(WDock *dock, int *x_pos, int *y_pos)
 			}
 			y = i;
 			ty = dock->y_pos + y * ICON_SIZE;
-			if (slot_map[XY2OFS(x, y)] == 0 && onScreen(scr, tx, ty)) {
+			if (!isSlotUsed(dock, x, y) && onScreen(scr, tx, ty)) {
 				*x_pos = x;
 				*y_pos = y;
 				done = 1;
@@ -2959,7 +2999,7 @@ Bool wDockFindFreeSlot(WDock *dock, int *x_pos, int *y_pos)
 			ty = dock->y_pos + y * ICON_SIZE;
 			x = -i;
 			tx = dock->x_pos + x * ICON_SIZE;
-			if (slot_map[XY2OFS(x, y)] == 0 && onScreen(scr, tx, ty)) {
+			if (!isSlotUsed(dock, x, y) && onScreen(scr, tx, ty)) {
 				*x_pos = x;
 				*y_pos = y;
 				done = 1;
@@ -2967,7 +3007,7 @@ Bool wDockFindFreeSlot(WDock *dock, int *x_pos, int *y_pos)
 			}
 			x = i;
 			tx = dock->x_pos + x * ICON_SIZE;
-			if (slot_map[XY2OFS(x, y)] == 0 && onScreen(scr, tx, ty)) {
+			if (!isSlotUsed(dock, x, y) && onScreen(scr, tx, ty)) {
 				*x_pos = x;
 				*y_pos = y;
 				done = 1;
@@ -2975,8 +3015,6 @@ Bool wDockFindFreeSlot(WDock *dock, int *x_pos, int *y_pos)
 			}
 		}
 	}
-	wfree(slot_map);
-#undef XY2OFS
 	return done;
 }
 
@@ -3200,37 +3238,96 @@ WAppIcon *wDockFindIconForWindow(WDock *dock, Window window)
 	return NULL;
 }
 
+/*
+ * Returns the docked icons that may be waiting for a window with this
+ * instance and class, in the order they are in the dock.
+ */
+static WMArray *getLaunchCandidates(WDock *dock, const char *wm_instance, const char *wm_class)
+{
+	WMArray *candidates, *icons;
+	WAppIcon *icon;
+	int i;
+
+	if (wm_instance && wm_class) {
+		char *key = launchKey(wm_instance, wm_class);
+
+		icons = WMHashGet(dock->launch_index, key);
+		wfree(key);
+
+		candidates = WMCreateArray(0);
+		if (icons)
+			WMAppendArray(candidates, icons);
+		WMAppendArray(candidates, dock->launch_wildcards);
+
+		if (WMGetArrayItemCount(candidates) < 2)
+			return candidates;
+
+		/* keep the order of the dock, the first icon wins */
+		icons = candidates;
+		candidates = WMCreateArray(WMGetArrayItemCount(icons));
+		for (i = 0; i < dock->max_icons; i++) {
+			icon = dock->icon_array[i];
+			if (icon && WMGetFirstInArray(icons, icon) != WANotFound)
+				WMAddToArray(candidates, icon);
+		}
+		WMFreeArray(icons);
+
+		return candidates;
+	}
+
+	/* the window matches any icon */
+	candidates = WMCreateArray(0);
+	for (i = 0; i < dock->max_icons; i++) {
+		icon = dock->icon_array[i];
+		if (icon && (icon->wm_instance || icon->wm_class))
+			WMAddToArray(candidates, icon);
+	}
+
+	return candidates;
+}
+
+/* Removes the icon slid from where the window appeared to the dock */
+static void finishLaunchSlide(void *data)
+{
+	WIcon *icon = data;
+
+	XUnmapWindow(dpy, icon->core->window);
+	RemoveFromStackList(icon->core);
+	wIconDestroy(icon);
+}
+
 void wDockTrackWindowLaunch(WDock *dock, Window window)
 {
 	WAppIcon *icon;
 	char *wm_class, *wm_instance;
-	int i;
+	WMArray *candidates;
+	WMArrayIterator iter;
 	Bool firstPass = True;
 	Bool found = False;
 	char *command = NULL;
 
+	/* app is already attached to an icon */
+	if (wDockFindIconForWindow(dock, window))
+		return;
+
 	if (!PropGetWMClass(window, &wm_class, &wm_instance)) {
 		free(wm_class);
 		free(wm_instance);
 		return;
 	}
 
+	candidates = getLaunchCandidates(dock, wm_instance, wm_class);
+	if (WMGetArrayItemCount(candidates) == 0) {
+		WMFreeArray(candidates);
+		free(wm_class);
+		free(wm_instance);
+		return;
+	}
+
 	command = GetCommandForWindow(window);
  retry:
-	for (i = 0; i < dock->max_icons; i++) {
-		icon = dock->icon_array[i];
-		if (!icon)
-			continue;
-
-		/* app is already attached to icon */
-		if (icon->main_window == window) {
-			found = True;
-			break;
-		}
-
-		if ((icon->wm_instance || icon->wm_class)
-		    && (icon->launching || !icon->running)) {
-
+	WM_ITERATE_ARRAY(candidates, icon, iter) {
+		if (icon->launching || !icon->running) {
 			if (icon->wm_instance && wm_instance && strcmp(icon->wm_instance, wm_instance) != 0)
 				continue;
 
@@ -3257,26 +3354,29 @@ void wDockTrackWindowLaunch(WDock *dock, Window window)
 			found = True;
 			if (!wPreferences.no_animations && !icon->launching &&
 			    !dock->screen_ptr->flags.startup && !dock->collapsed) {
-				WAppIcon *aicon;
+				WIcon *sicon;
 				int x0, y0;
 
 				icon->launching = 1;
 				dockIconPaint(icon);
 
-				aicon = wAppIconCreateForDock(dock->screen_ptr, NULL,
-							      wm_instance, wm_class, TILE_NORMAL);
-				/* XXX: can: aicon->icon == NULL ? */
-				PlaceIcon(dock->screen_ptr, &x0, &y0, wGetHeadForWindow(aicon->icon->owner));
-				wAppIconMove(aicon, x0, y0);
+				/*
+				 * Only an image is slid, not an appicon, so nothing else
+				 * finds it while it is on its way to the dock.
+				 */
+				sicon = icon_create_for_dock(dock->screen_ptr, NULL, wm_instance, wm_class, TILE_NORMAL);
+				sicon->core->descriptor.handle_mousedown = NULL;
+				AddToStackList(sicon->core);
+
+				PlaceIcon(dock->screen_ptr, &x0, &y0, 0);
+				XMoveWindow(dpy, sicon->core->window, x0, y0);
 				/* Should this always be lowered? -Dan */
 				if (dock->lowered)
-					wLowerFrame(aicon->icon->core);
-				XMapWindow(dpy, aicon->icon->core->window);
-				aicon->launching = 1;
-				wAppIconPaint(aicon);
-				slide_window(aicon->icon->core->window, x0, y0, icon->x_pos, icon->y_pos);
-				XUnmapWindow(dpy, aicon->icon->core->window);
-				wAppIconDestroy(aicon);
+					wLowerFrame(sicon->core);
+				XMapWindow(dpy, sicon->core->window);
+				wIconPaint(sicon);
+				slide_window(sicon->core->window, x0, y0, icon->x_pos, icon->y_pos,
+					     finishLaunchSlide, sicon);
 			}
 			wDockFinishLaunch(icon);
 			break;
@@ -3288,6 +3388,8 @@ void wDockTrackWindowLaunch(WDock *dock, Window window)
 		goto retry;
 	}
 
+	WMFreeArray(candidates);
+
 	if (command)
 		wfree(command);
 
@@ -3861,7 +3963,7 @@ static void handleDockMove(WDock *dock, WAppIcon *aicon, XEvent *event)
 					(dock->on_right_side ? x - (dock->icon_count - 1) * ICON_SIZE : x),
 					y,
 					(dock->on_right_side ? shad_x - (dock->icon_count - 1) * ICON_SIZE : shad_x),
-					shad_y);
+					shad_y, NULL, NULL);
 				XUnmapWindow(dpy, scr->dock_shadow);
 				moveDock(dock, shad_x, shad_y);
 				XResizeWindow(dpy, scr->dock_shadow, ICON_SIZE, ICON_SIZE);
@@ -4098,9 +4200,8 @@ static void clipLeave(WDock *dock)
 		return;
 
 	if (XCheckTypedEvent(dpy, EnterNotify, &event) != False) {
-		if (XFindContext(dpy, event.xcrossing.window, w_global.context.client_win,
-				 (XPointer *) & desc) != XCNOENT
-		    && desc && desc->parent_type == WCLASS_DOCK_ICON
+		if ((desc = wCoreFindDescriptor(event.xcrossing.window)) != NULL
+		    && desc->parent_type == WCLASS_DOCK_ICON
 		    && ((WAppIcon *) desc->parent)->dock == dock) {
 			/* We haven't left the dock/clip/drawer yet */
 			XPutBackEvent(dpy, &event);
@@ -4688,7 +4789,9 @@ void wSlideAppicons(WAppIcon **appicons, int n, int to_the_left)
 
 	for (i = 0; i < n; i++) {
 		aicon = appicons[i];
+		markSlot(aicon->dock, aicon, -1);
 		aicon->xindex += (to_the_left ? -1 : +1);
+		markSlot(aicon->dock, aicon, 1);
 		if (aicon->xindex < min_index) {
 			min_index = aicon->xindex;
 			leftmost = i;
@@ -4702,7 +4805,7 @@ void wSlideAppicons(WAppIcon **appicons, int n, int to_the_left)
 		wins[aicon->xindex - min_index] = aicon->icon->core->window;
 	}
 	aicon = appicons[leftmost];
-	slide_windows(wins, n, from_x, aicon->y_pos, aicon->x_pos, aicon->y_pos);
+	slide_windows(wins, n, from_x, aicon->y_pos, aicon->x_pos, aicon->y_pos, NULL, NULL);
 }
 
 
@@ -4914,6 +5017,8 @@ static WDock * drawerRestoreState(WScreen *scr, WMPropList *drawer_state)
 finish:
 	WMReleasePropList(drawer_state);
 
+	wDockRebuildIndex(drawer);
+
 	return drawer;
 }
 
@@ -58,6 +58,13 @@ typedef struct WDock {
     struct WMenu *menu;
 
     struct WDDomain *defaults;
+
+    /* Indexes kept up to date as icons are attached, moved and detached */
+    unsigned char *slot_map;	       /* icons in each slot around the
+                                        * main icon, see dockSlot() */
+    int slot_radius;
+    WMHashTable *launch_index;	       /* "instance.class" -> WMArray of icons */
+    WMArray *launch_wildcards;	       /* icons with only one of the two */
 } WDock;
 
 
@@ -82,6 +89,7 @@ Bool wDockFindFreeSlot(WDock *dock, int *req_x, int *req_y);
 void wDockDetach(WDock *dock, WAppIcon *icon);
 Bool wDockMoveIconBetweenDocks(WDock *src, WDock *dest, WAppIcon *icon, int x, int y);
 void wDockReattachIcon(WDock *dock, WAppIcon *icon, int x, int y);
+void wDockRebuildIndex(WDock *dock);
 
 void wSlideAppicons(WAppIcon **appicons, int n, int to_the_left);
 void wDrawerFillTheGap(WDock *drawer, WAppIcon *aicon, Bool redocking);
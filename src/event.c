@@ -714,7 +714,7 @@ static void handleExpose(XEvent * event)
 
 	while (XCheckTypedWindowEvent(dpy, event->xexpose.window, Expose, &ev)) ;
 
-	if (XFindContext(dpy, event->xexpose.window, w_global.context.client_win, (XPointer *) & desc) == XCNOENT) {
+	if ((desc = wCoreFindDescriptor(event->xexpose.window)) == NULL) {
 		return;
 	}
 
@@ -831,8 +831,8 @@ static void handleButtonPress(XEvent * event)
 	}
 
 	desc = NULL;
-	if (XFindContext(dpy, event->xbutton.subwindow, w_global.context.client_win, (XPointer *) & desc) == XCNOENT) {
-		if (XFindContext(dpy, event->xbutton.window, w_global.context.client_win, (XPointer *) & desc) == XCNOENT) {
+	if ((desc = wCoreFindDescriptor(event->xbutton.subwindow)) == NULL) {
+		if ((desc = wCoreFindDescriptor(event->xbutton.window)) == NULL) {
 			return;
 		}
 	}
@@ -1097,7 +1097,7 @@ static void handleClientMessage(XEvent * event)
 		 * For when the icon frame gets a ClientMessage
 		 * that should have gone to the icon_window.
 		 */
-		if (XFindContext(dpy, event->xbutton.window, w_global.context.client_win, (XPointer *) & desc) != XCNOENT) {
+		if ((desc = wCoreFindDescriptor(event->xbutton.window)) != NULL) {
 			struct WIcon *icon = NULL;
 
 			if (desc->parent_type == WCLASS_MINIWINDOW) {
@@ -1147,7 +1147,7 @@ static void handleEnterNotify(XEvent * event)
 		}
 	}
 
-	if (XFindContext(dpy, event->xcrossing.window, w_global.context.client_win, (XPointer *) & desc) != XCNOENT) {
+	if ((desc = wCoreFindDescriptor(event->xcrossing.window)) != NULL) {
 		if (desc->handle_enternotify)
 			(*desc->handle_enternotify) (desc, event);
 	}
@@ -1211,7 +1211,7 @@ static void handleLeaveNotify(XEvent * event)
 {
 	WObjDescriptor *desc = NULL;
 
-	if (XFindContext(dpy, event->xcrossing.window, w_global.context.client_win, (XPointer *) & desc) != XCNOENT) {
+	if ((desc = wCoreFindDescriptor(event->xcrossing.window)) != NULL) {
 		if (desc->handle_leavenotify)
 			(*desc->handle_leavenotify) (desc, event);
 	}
@@ -47,12 +47,12 @@
 #include "startup.h"
 #include "event.h"
 #include "winmenu.h"
+#include "balloon.h"
 
 /**** Global varianebles ****/
 
 #define MOD_MASK wPreferences.modifier_mask
 #define CACHE_ICON_PATH "/Library/WindowMaker/CachedPixmaps"
-#define ICON_BORDER 3
 
 static void miniwindowExpose(WObjDescriptor *desc, XEvent *event);
 static void miniwindowMouseDown(WObjDescriptor *desc, XEvent *event);
@@ -67,6 +67,7 @@ static void get_rimage_icon_from_default_icon(WIcon *icon);
 static void get_rimage_icon_from_x11(WIcon *icon);
 
 static void icon_update_pixmap(WIcon *icon, RImage *image);
+static void release_icon_pixmap(Pixmap pixmap);
 static void unset_icon_image(WIcon *icon);
 
 /****** Notification Observers ******/
@@ -209,6 +210,8 @@ void wIconDestroy(WIcon *icon)
 	if (icon->handlerID)
 		WMDeleteTimerHandler(icon->handlerID);
 
+	stop_window_slide(core->window);
+
 	if (icon->icon_win) {
 		int x = 0, y = 0;
 
@@ -223,10 +226,14 @@ void wIconDestroy(WIcon *icon)
 		XFree(icon->icon_name);
 
 	if (icon->pixmap)
-		XFreePixmap(dpy, icon->pixmap);
+		release_icon_pixmap(icon->pixmap);
 
-	if (icon->mini_preview)
+	if (icon->mini_preview) {
+#ifdef BALLOON_TEXT
+		wBalloonForgetPreview(scr, icon->mini_preview);
+#endif
 		XFreePixmap(dpy, icon->mini_preview);
+	}
 
 	unset_icon_image(icon);
 
@@ -243,9 +250,221 @@ static void drawIconTitleBackground(WScreen *scr, Pixmap pixmap, int height)
 		  wPreferences.icon_size - 1, 0, wPreferences.icon_size - 1, height + 1);
 }
 
+/*
+ * Composited icon pixmaps are shared between icons showing the same
+ * image on the same tile, so that a dock full of identical launchers or
+ * the miniwindows of several terminals hold a single server pixmap, and
+ * the variants a toggle of the highlight or the shadow switches to are
+ * kept around for a while after they are no longer used.
+ *
+ * Every icon loads its own copy of its image, so images are compared by
+ * content: entries are found through a hash of the pixels, and the image
+ * retained by the entry is compared with the one looked up. Everything
+ * else the composition depends on is part of the key too. The tile is
+ * retained by the cache, so its address cannot be reused by a different
+ * tile while an entry refers to it, and the colors of the title and
+ * shadow textures are compared by value, so appearance changes need no
+ * explicit invalidation.
+ */
+#define ICON_PIXMAP_MAX_UNUSED	32
+
+typedef struct IconPixmapKey {
+	RImage *tile;
+	RImage *image;
+	unsigned image_hash;
+	int icon_size;
+	int theight;
+	unsigned long title_pixel[3];	/* normal, light and dim, with show_title */
+	unsigned short shadow[3];	/* shadow color, when shadowed */
+	unsigned int show_title:1;
+	unsigned int shadowed:1;
+	unsigned int highlighted:1;
+} IconPixmapKey;
+
+typedef struct IconPixmapEntry {
+	IconPixmapKey key;
+	Pixmap pixmap;
+	int refcount;
+} IconPixmapEntry;
+
+static unsigned hashIconPixmapKey(const void *k);
+static Bool sameIconPixmapKey(const void *k1, const void *k2);
+
+static const WMHashTableCallbacks IconPixmapKeyCallbacks = {
+	hashIconPixmapKey,
+	sameIconPixmapKey,
+	NULL,
+	NULL
+};
+
+static struct {
+	WMHashTable *by_key;
+	WMHashTable *by_pixmap;
+	WMArray *unused;		/* entries no icon uses, oldest first */
+
+	unsigned long hits;
+	unsigned long misses;
+} icon_pixmaps;
+
+static unsigned hashIconImage(RImage *image)
+{
+	size_t i, size;
+	unsigned hash = 2166136261U;
+
+	if (!image)
+		return 0;
+
+	size = (size_t)image->width * image->height * (image->format == RRGBAFormat ? 4 : 3);
+	for (i = 0; i < size; i++) {
+		hash ^= image->data[i];
+		hash *= 16777619U;
+	}
+
+	return hash ^ image->width ^ (image->height << 16);
+}
+
+static unsigned hashIconPixmapKey(const void *k)
+{
+	const IconPixmapKey *key = k;
+	unsigned hash;
+	int i;
+
+	hash = key->image_hash ^ (unsigned)((uintptr_t)key->tile >> 4);
+	hash = hash * 31 + key->icon_size;
+	hash = hash * 31 + key->theight;
+	hash = hash * 31 + (key->show_title | key->shadowed << 1 | key->highlighted << 2);
+	for (i = 0; i < 3; i++) {
+		hash = hash * 31 + (unsigned)key->title_pixel[i];
+		hash = hash * 31 + key->shadow[i];
+	}
+
+	return hash;
+}
+
+static Bool sameIconImage(RImage *a, RImage *b)
+{
+	if (a == b)
+		return True;
+	if (!a || !b || a->width != b->width || a->height != b->height || a->format != b->format)
+		return False;
+
+	return memcmp(a->data, b->data,
+		      (size_t)a->width * a->height * (a->format == RRGBAFormat ? 4 : 3)) == 0;
+}
+
+/* The colors are only set in the keys when used, so they can be compared as they are */
+static Bool sameIconPixmapKey(const void *k1, const void *k2)
+{
+	const IconPixmapKey *a = k1, *b = k2;
+	int i;
+
+	if (a->tile != b->tile || a->image_hash != b->image_hash || a->icon_size != b->icon_size
+	    || a->theight != b->theight || a->show_title != b->show_title
+	    || a->shadowed != b->shadowed || a->highlighted != b->highlighted)
+		return False;
+
+	for (i = 0; i < 3; i++) {
+		if (a->title_pixel[i] != b->title_pixel[i] || a->shadow[i] != b->shadow[i])
+			return False;
+	}
+
+	return sameIconImage(a->image, b->image);
+}
+
+static void freeIconPixmapEntry(IconPixmapEntry *entry)
+{
+	WMHashRemove(icon_pixmaps.by_key, &entry->key);
+	WMHashRemove(icon_pixmaps.by_pixmap, (void *)(uintptr_t)entry->pixmap);
+
+	XFreePixmap(dpy, entry->pixmap);
+	RReleaseImage(entry->key.tile);
+	if (entry->key.image)
+		RReleaseImage(entry->key.image);
+	wfree(entry);
+}
+
+/* Frees the least recently used entries while too many are unused */
+static void trimIconPixmaps(void)
+{
+	while (WMGetArrayItemCount(icon_pixmaps.unused) > ICON_PIXMAP_MAX_UNUSED) {
+		freeIconPixmapEntry(WMGetFromArray(icon_pixmaps.unused, 0));
+		WMDeleteFromArray(icon_pixmaps.unused, 0);
+	}
+}
+
+static Pixmap acquire_icon_pixmap(const IconPixmapKey *key)
+{
+	IconPixmapEntry *entry;
+
+	if (!icon_pixmaps.by_key)
+		return None;
+
+	entry = WMHashGet(icon_pixmaps.by_key, key);
+	if (!entry)
+		return None;
+
+	if (entry->refcount++ == 0)
+		WMRemoveFromArray(icon_pixmaps.unused, entry);
+	icon_pixmaps.hits++;
+
+	return entry->pixmap;
+}
+
+static void store_icon_pixmap(const IconPixmapKey *key, Pixmap pixmap)
+{
+	IconPixmapEntry *entry;
+
+	if (!icon_pixmaps.by_key) {
+		icon_pixmaps.by_key = WMCreateHashTable(IconPixmapKeyCallbacks);
+		icon_pixmaps.by_pixmap = WMCreateHashTable(WMIntHashCallbacks);
+		icon_pixmaps.unused = WMCreateArray(ICON_PIXMAP_MAX_UNUSED + 1);
+	}
+
+	entry = wmalloc(sizeof(IconPixmapEntry));
+	entry->key = *key;
+	RRetainImage(entry->key.tile);
+	if (entry->key.image)
+		RRetainImage(entry->key.image);
+	entry->pixmap = pixmap;
+	entry->refcount = 1;
+
+	WMHashInsert(icon_pixmaps.by_key, &entry->key, entry);
+	WMHashInsert(icon_pixmaps.by_pixmap, (void *)(uintptr_t)pixmap, entry);
+}
+
+/* Gives back a pixmap obtained through icon_update_pixmap() */
+static void release_icon_pixmap(Pixmap pixmap)
+{
+	IconPixmapEntry *entry = NULL;
+
+	if (icon_pixmaps.by_pixmap)
+		entry = WMHashGet(icon_pixmaps.by_pixmap, (void *)(uintptr_t)pixmap);
+
+	if (!entry) {
+		XFreePixmap(dpy, pixmap);
+		return;
+	}
+
+	if (--entry->refcount == 0) {
+		WMAddToArray(icon_pixmaps.unused, entry);
+		trimIconPixmaps();
+	}
+}
+
+#ifdef DEBUG
+void wIconPrintPixmapStatistics(void)
+{
+	printf("icon pixmaps: %u cached, %d unused, %lu hits, %lu misses\n",
+	       icon_pixmaps.by_key ? WMCountHashTable(icon_pixmaps.by_key) : 0,
+	       icon_pixmaps.unused ? WMGetArrayItemCount(icon_pixmaps.unused) : 0,
+	       icon_pixmaps.hits, icon_pixmaps.misses);
+}
+#endif
+
 static void icon_update_pixmap(WIcon *icon, RImage *image)
 {
 	RImage *tile;
+	IconPixmapKey key;
 	Pixmap pixmap;
 	int x, y, sx, sy;
 	unsigned w, h;
@@ -254,13 +473,13 @@ static void icon_update_pixmap(WIcon *icon, RImage *image)
 
 	switch (icon->tile_type) {
 	case TILE_NORMAL:
-		tile = RCloneImage(scr->icon_tile);
+		tile = scr->icon_tile;
 		break;
 	case TILE_CLIP:
-		tile = RCloneImage(scr->clip_tile);
+		tile = scr->clip_tile;
 		break;
 	case TILE_DRAWER:
-		tile = RCloneImage(scr->drawer_tile);
+		tile = scr->drawer_tile;
 		break;
 	default:
 		/*
@@ -269,18 +488,47 @@ static void icon_update_pixmap(WIcon *icon, RImage *image)
 		 * "may be used uninitialized"
 		 */
 		wwarning("Unknown tile type: %d.\n", icon->tile_type);
-		tile = RCloneImage(scr->icon_tile);
+		tile = scr->icon_tile;
 	}
 
+	if (image && icon->show_title)
+		theight = WMFontHeight(scr->icon_title_font);
+
+	memset(&key, 0, sizeof(key));
+	key.tile = tile;
+	key.image = image;
+	key.image_hash = hashIconImage(image);
+	key.icon_size = wPreferences.icon_size;
+	key.theight = theight;
+	key.show_title = icon->show_title;
+	key.shadowed = icon->shadowed;
+	key.highlighted = icon->highlighted;
+	if (icon->show_title) {
+		key.title_pixel[0] = scr->icon_title_texture->normal.pixel;
+		key.title_pixel[1] = scr->icon_title_texture->light.pixel;
+		key.title_pixel[2] = scr->icon_title_texture->dim.pixel;
+	}
+	if (icon->shadowed) {
+		key.shadow[0] = scr->icon_back_texture->light.red;
+		key.shadow[1] = scr->icon_back_texture->light.green;
+		key.shadow[2] = scr->icon_back_texture->light.blue;
+	}
+
+	pixmap = acquire_icon_pixmap(&key);
+	if (pixmap != None) {
+		icon->pixmap = pixmap;
+		return;
+	}
+	icon_pixmaps.misses++;
+
+	tile = RCloneImage(tile);
+
 	if (image) {
 		w = (image->width > wPreferences.icon_size)
 		    ? wPreferences.icon_size : image->width;
 		x = (wPreferences.icon_size - w) / 2;
 		sx = (image->width - w) / 2;
 
-		if (icon->show_title)
-			theight = WMFontHeight(scr->icon_title_font);
-
 		h = (image->height + theight > wPreferences.icon_size
 		     ? wPreferences.icon_size - theight : image->height);
 		y = theight + (wPreferences.icon_size - theight - h) / 2;
@@ -307,8 +555,11 @@ static void icon_update_pixmap(WIcon *icon, RImage *image)
 		RLightImage(tile, &color);
 	}
 
-	if (!RConvertImage(scr->rcontext, tile, &pixmap))
+	if (!RConvertImage(scr->rcontext, tile, &pixmap)) {
 		wwarning(_("error rendering image:%s"), RMessageForError(RErrorCode));
+		RReleaseImage(tile);
+		return;
+	}
 
 	RReleaseImage(tile);
 
@@ -316,6 +567,7 @@ static void icon_update_pixmap(WIcon *icon, RImage *image)
 	if (icon->show_title)
 		drawIconTitleBackground(scr, pixmap, theight);
 
+	store_icon_pixmap(&key, pixmap);
 	icon->pixmap = pixmap;
 }
 
@@ -626,8 +878,12 @@ void set_icon_minipreview(WIcon *icon, RImage *image)
 	                                  wPreferences.minipreview_size - 2 * MINIPREVIEW_BORDER);
 
 	if (RConvertImage(scr->rcontext, scaled_mini_preview, &tmp)) {
-		if (icon->mini_preview != None)
+		if (icon->mini_preview != None) {
+#ifdef BALLOON_TEXT
+			wBalloonForgetPreview(scr, icon->mini_preview);
+#endif
 			XFreePixmap(dpy, icon->mini_preview);
+		}
 		icon->mini_preview = tmp;
 	}
 	RReleaseImage(scaled_mini_preview);
@@ -666,7 +922,7 @@ void wIconUpdate(WIcon *icon)
 void update_icon_pixmap(WIcon *icon)
 {
 	if (icon->pixmap != None)
-		XFreePixmap(dpy, icon->pixmap);
+		release_icon_pixmap(icon->pixmap);
 
 	icon->pixmap = None;
  
@@ -32,6 +32,9 @@
 /* This is the border, in pixel, drawn around a Mini-Preview */
 #define MINIPREVIEW_BORDER 1
 
+/* Room, in pixel, kept around images scaled down to the icon size */
+#define ICON_BORDER 3
+
 typedef struct WIcon {
 	WCoreWindow 	*core;
 	WWindow 	*owner;		/* owner window */
@@ -81,4 +84,9 @@ void set_icon_image_from_image(WIcon *icon, RImage *image);
 void set_icon_minipreview(WIcon *icon, RImage *image);
 
 void remove_cache_icon(char *filename);
+
+#ifdef DEBUG
+void wIconPrintPixmapStatistics(void);
+#endif
+
 #endif /* WMICON_H_ */
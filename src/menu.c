@@ -44,6 +44,7 @@
 #include "dialog.h"
 #include "rootmenu.h"
 #include "switchmenu.h"
+#include "animation.h"
 
 
 #define MOD_MASK wPreferences.modifier_mask
@@ -73,10 +74,34 @@ static void menuTitleDoubleClick(WCoreWindow * sender, void *data, XEvent * even
 static void menuTitleMouseDown(WCoreWindow * sender, void *data, XEvent * event);
 static void menuCloseClick(WCoreWindow * sender, void *data, XEvent * event);
 static void updateTexture(WMenu * menu);
+static void invalidateEntryCache(WMenu * menu);
+static void freeEntryCache(WMenu * menu);
 static int saveMenuRecurs(WMPropList * menus, WScreen * scr, WMenu * menu);
 static int restoreMenuRecurs(WScreen *scr, WMPropList *menus, WMenu *menu, const char *path);
 static void selectEntry(WMenu * menu, int entry_no);
 static void closeCascade(WMenu * menu);
+static void closeClickedMenu(WMenu *menu, Bool close, int old_x, int old_y);
+
+/*
+ * An entry chosen by the user blinks before its callback is called.
+ * The menus are left alone while it blinks and closed afterwards.
+ */
+typedef struct WMenuBlink {
+	WMenu *menu;			/* NULL if a menu went away meanwhile */
+	WMenuEntry *entry;
+	int index;
+	Bool keyboard;			/* chosen with the keyboard */
+	int old_x, old_y;		/* where menu was before it was made visible */
+
+	WMenu *top;			/* menu to close afterwards */
+	int top_x, top_y;		/* where to put back the menus */
+	Bool close_top;
+
+	WAnimation *animation;		/* NULL once it stopped blinking */
+	WMHandlerID idle;
+} WMenuBlink;
+
+static WMenuBlink *blink = NULL;
 
 /****** Notification Observers ******/
 
@@ -85,6 +110,10 @@ static void appearanceObserver(void *self, WMNotification * notif)
 	WMenu *menu = (WMenu *) self;
 	uintptr_t flags = (uintptr_t)WMGetNotificationClientData(notif);
 
+	/* the entries are drawn differently even if their size does not change */
+	if (WMGetNotificationName(notif) == WNMenuAppearanceSettingsChanged)
+		invalidateEntryCache(menu);
+
 	if (!menu->flags.realized)
 		return;
 
@@ -201,6 +230,7 @@ WMenu *wMenuCreate(WScreen *screen, const char *title, int main_menu)
 	menu->menu->descriptor.handle_mousedown = menuMouseDown;
 
 	menu->menu_texture_data = None;
+	menu->entry_cache = None;
 
 	XMapWindow(dpy, menu->menu->window);
 
@@ -545,6 +575,13 @@ void wMenuDestroy(WMenu * menu, int recurse)
 
 	WMRemoveNotificationObserver(menu);
 
+	/* forget the entry being chosen */
+	if (blink && (blink->menu == menu || blink->top == menu)) {
+		blink->menu = NULL;
+		if (blink->animation)
+			wAnimationStop(blink->animation);
+	}
+
 	/* remove any pending timers */
 	if (menu->timer)
 		WMDeleteTimerHandler(menu->timer);
@@ -594,6 +631,7 @@ void wMenuDestroy(WMenu * menu, int recurse)
 	}
 
 	FREE_PIXMAP(menu->menu_texture_data);
+	freeEntryCache(menu);
 
 	if (menu->cascades)
 		wfree(menu->cascades);
@@ -650,21 +688,47 @@ static void drawFrame(WScreen * scr, Drawable win, int y, int w, int h, int type
 		XDrawLine(dpy, win, scr->menu_item_auxtexture->dark_gc, 0, y + h - 1, w - 1, y + h - 1);
 }
 
-static void paintEntry(WMenu * menu, int index, int selected)
+/*
+ * Lays down the background of an entry drawn somewhere other than the
+ * menu window, where XClearArea() can't be used to bring back the
+ * window background.
+ */
+static void drawEntryBackground(WMenu * menu, Drawable d, int index, int y)
+{
+	WScreen *scr = menu->frame->screen_ptr;
+	Pixmap texture;
+	int w, h;
+
+	h = menu->entry_height;
+	w = menu->menu->width;
+
+	if (menu->flags.brother)
+		texture = menu->brother->menu_texture_data;
+	else
+		texture = menu->menu_texture_data;
+
+	if (scr->menu_item_texture->any.type == WTEX_SOLID || texture == None) {
+		XSetForeground(dpy, scr->copy_gc, scr->menu_item_texture->any.color.pixel);
+		XFillRectangle(dpy, d, scr->copy_gc, 0, y, w, h);
+	} else if (wPreferences.menu_style == MS_NORMAL) {
+		/* the texture is a single entry tiled down the window */
+		XCopyArea(dpy, texture, d, scr->copy_gc, 0, 0, w, h, 0, y);
+	} else {
+		XCopyArea(dpy, texture, d, scr->copy_gc, 0, index * h, w, h, 0, y);
+	}
+}
+
+static void drawEntry(WMenu * menu, Drawable win, int index, int y, int selected)
 {
 	WScreen *scr = menu->frame->screen_ptr;
-	Window win = menu->menu->window;
 	WMenuEntry *entry = menu->entries[index];
 	GC light, dim, dark;
 	WMColor *color;
-	int x, y, w, h, tw;
+	int x, w, h, tw;
 	int type;
 
-	if (!menu->flags.realized)
-		return;
 	h = menu->entry_height;
 	w = menu->menu->width;
-	y = index * h;
 
 	light = scr->menu_item_auxtexture->light_gc;
 	dim = scr->menu_item_auxtexture->dim_gc;
@@ -682,10 +746,16 @@ static void paintEntry(WMenu * menu, int index, int selected)
 	}
 
 	/* paint background */
+	if (win != menu->menu->window)
+		drawEntryBackground(menu, win, index, y);
+
 	if (selected) {
 		XFillRectangle(dpy, win, WMColorGC(scr->select_color), 1, y + 1, w - 2, h - 3);
 		if (scr->menu_item_texture->any.type == WTEX_SOLID)
 			drawFrame(scr, win, y, w, h, type);
+	} else if (win != menu->menu->window) {
+		if (scr->menu_item_texture->any.type == WTEX_SOLID)
+			drawFrame(scr, win, y, w, h, type);
 	} else {
 		if (scr->menu_item_texture->any.type == WTEX_SOLID) {
 			XClearArea(dpy, win, 0, y + 1, w - 1, h - 3, False);
@@ -780,6 +850,143 @@ static void paintEntry(WMenu * menu, int index, int selected)
 	}
 }
 
+/*
+ * Every realized menu keeps its entries pre-rendered in both states in
+ * entry_cache, so that moving the selection or handling an expose is
+ * just a copy from it. Callers change the entries directly and then
+ * repaint them, so each cached entry remembers what it was drawn from
+ * and is only redrawn when that differs. The appearance settings are
+ * not part of it, a change in them invalidates the whole cache.
+ */
+typedef struct WMenuCachedEntry {
+	char *text;			/* NULL if the entry must be redrawn */
+	char *rtext;
+	unsigned int flags;
+} WMenuCachedEntry;
+
+static unsigned int entryDrawFlags(WMenuEntry * entry)
+{
+	return entry->flags.enabled | entry->flags.indicator << 1 | entry->flags.indicator_on << 2
+		| entry->flags.indicator_type << 3 | (entry->cascade >= 0) << 6;
+}
+
+static void forgetCachedEntry(WMenuCachedEntry * cached)
+{
+	if (cached->text)
+		wfree(cached->text);
+	if (cached->rtext)
+		wfree(cached->rtext);
+	cached->text = NULL;
+	cached->rtext = NULL;
+}
+
+static void freeEntryCache(WMenu * menu)
+{
+	int i;
+
+	FREE_PIXMAP(menu->entry_cache);
+
+	if (menu->cached_entries) {
+		for (i = 0; i < menu->cache_entry_no; i++)
+			forgetCachedEntry(&menu->cached_entries[i]);
+		wfree(menu->cached_entries);
+		menu->cached_entries = NULL;
+	}
+}
+
+static void invalidateEntryCache(WMenu * menu)
+{
+	WMenu *copy = menu;
+	int i;
+
+	do {
+		if (copy->cached_entries) {
+			for (i = 0; i < copy->cache_entry_no; i++)
+				forgetCachedEntry(&copy->cached_entries[i]);
+		}
+		copy = copy->brother;
+	} while (copy && copy != menu);
+}
+
+/*
+ * Makes sure entry_cache fits the current entries, which are all drawn
+ * again if it has to be made anew. Returns False for menus too tall for
+ * a pixmap, which are drawn straight onto their window.
+ */
+static Bool checkEntryCache(WMenu * menu)
+{
+	WScreen *scr = menu->frame->screen_ptr;
+	int height;
+
+	if (menu->entry_cache != None && menu->cache_width == menu->menu->width
+	    && menu->cache_entry_height == menu->entry_height && menu->cache_entry_no == menu->entry_no)
+		return True;
+
+	freeEntryCache(menu);
+
+	height = menu->entry_no * menu->entry_height;
+	if (height <= 0 || 2 * height > 32767)
+		return False;
+
+	menu->entry_cache = XCreatePixmap(dpy, menu->menu->window, menu->menu->width,
+					  2 * height, scr->w_depth);
+	menu->cached_entries = wmalloc(menu->entry_no * sizeof(WMenuCachedEntry));
+	menu->cache_width = menu->menu->width;
+	menu->cache_entry_height = menu->entry_height;
+	menu->cache_entry_no = menu->entry_no;
+
+	return True;
+}
+
+static void updateCachedEntry(WMenu * menu, int index)
+{
+	WScreen *scr = menu->frame->screen_ptr;
+	WMenuCachedEntry *cached = &menu->cached_entries[index];
+	WMenuEntry *entry = menu->entries[index];
+	int y = index * menu->entry_height;
+
+	if (cached->text && strcmp(cached->text, entry->text) == 0
+	    && (cached->rtext ? entry->rtext && strcmp(cached->rtext, entry->rtext) == 0 : !entry->rtext)
+	    && cached->flags == entryDrawFlags(entry))
+		return;
+
+	XSetClipMask(dpy, scr->copy_gc, None);
+	drawEntry(menu, menu->entry_cache, index, y, False);
+	XSetClipMask(dpy, scr->copy_gc, None);
+	drawEntry(menu, menu->entry_cache, index, y + menu->entry_no * menu->entry_height, True);
+	XSetClipMask(dpy, scr->copy_gc, None);
+
+	forgetCachedEntry(cached);
+	cached->text = wstrdup(entry->text);
+	cached->rtext = entry->rtext ? wstrdup(entry->rtext) : NULL;
+	cached->flags = entryDrawFlags(entry);
+}
+
+static void paintEntry(WMenu * menu, int index, int selected)
+{
+	WScreen *scr = menu->frame->screen_ptr;
+	int y, h;
+
+	if (!menu->flags.realized)
+		return;
+
+	h = menu->entry_height;
+	y = index * h;
+
+	if (!checkEntryCache(menu)) {
+		drawEntry(menu, menu->menu->window, index, y, selected);
+		return;
+	}
+	updateCachedEntry(menu, index);
+
+	if (selected)
+		y += menu->entry_no * h;
+
+	XSetClipMask(dpy, scr->copy_gc, None);
+	XCopyArea(dpy, menu->entry_cache, menu->menu->window, scr->copy_gc,
+		  0, y, menu->menu->width, h, 0, index * h);
+}
+
 static void move_menus(WMenu * menu, int x, int y)
 {
 	while (menu->parent) {
@@ -851,6 +1058,111 @@ static int check_key(WMenu * menu, XKeyEvent * event)
 	return -1;
 }
 
+static Bool drawBlink(int frame, void *data)
+{
+	WMenuBlink *b = data;
+
+	/* the entries may have changed */
+	if (b->index >= b->menu->entry_no || b->menu->entries[b->index] != b->entry)
+		return False;
+
+	paintEntry(b->menu, b->index, frame % 2);
+
+	return True;
+}
+
+/* Closes the menus and calls the callback of the entry */
+static void chooseEntry(void *data)
+{
+	WMenuBlink *b = data;
+	WMenu *menu = b->menu;
+	WMenuEntry *entry = b->entry;
+	XEvent ev;
+	int i;
+
+	/* callbacks running a modal loop check the idle handlers again */
+	WMDeleteIdleHandler(b->idle);
+	blink = NULL;
+
+	if (!menu) {
+		wfree(b);
+		return;
+	}
+
+	for (i = 0; i < menu->entry_no; i++) {
+		if (menu->entries[i] == entry)
+			break;
+	}
+	if (i == menu->entry_no)
+		entry = NULL;
+
+	if (b->keyboard) {
+		selectEntry(menu, -1);
+
+		if (!menu->flags.buttoned) {
+			wMenuUnmap(menu);
+			move_menus(menu, b->old_x, b->old_y);
+		}
+		closeCascade(menu);
+
+		if (b->top) {
+			if (!b->top->flags.buttoned) {
+				wMenuUnmap(b->top);
+				move_menus(b->top, b->top_x, b->top_y);
+			}
+			selectEntry(b->top, -1);
+		}
+
+		if (entry)
+			(*entry->callback) (menu, entry);
+	} else {
+		/* unmap the menu, it's parents and call the callback */
+		if (!menu->flags.buttoned && (!menu->flags.app_menu || menu->parent != NULL)) {
+			closeCascade(menu);
+		} else {
+			selectEntry(menu, -1);
+		}
+		if (entry)
+			(*entry->callback) (menu, entry);
+
+		/* If the user double clicks an entry, the entry will
+		 * be executed twice, which is not good for things like
+		 * the root menu. So, ignore any clicks that were generated
+		 * while the entry was being executed */
+		while (XCheckTypedWindowEvent(dpy, menu->menu->window, ButtonPress, &ev)) ;
+
+		closeClickedMenu(b->top, b->close_top, b->top_x, b->top_y);
+	}
+	wfree(b);
+}
+
+/*
+ * The blink is over. The entry is chosen once the events are handled,
+ * as callbacks may run a modal loop, which cannot be done from a timer.
+ */
+static void finishBlink(void *data)
+{
+	WMenuBlink *b = data;
+
+	b->animation = NULL;
+	if (!b->menu) {
+		blink = NULL;
+		wfree(b);
+		return;
+	}
+	b->idle = WMAddIdleHandler(chooseEntry, b);
+}
+
+static void blinkEntry(WMenuBlink *b)
+{
+#if (MENU_BLINK_COUNT > 0 && MENU_BLINK_DELAY > 0)
+	blink = b;
+	b->animation = wAnimationStart(2 * MENU_BLINK_COUNT, MENU_BLINK_DELAY, drawBlink, finishBlink, b);
+#else
+	chooseEntry(b);
+#endif
+}
+
 static int keyboardMenu(WMenu * menu)
 {
 	XEvent event;
@@ -864,7 +1176,7 @@ static int keyboardMenu(WMenu * menu)
 	WMRect rect = wGetRectForHead(menu->frame->screen_ptr,
 				      wGetHeadForPointerLocation(menu->frame->screen_ptr));
 
-	if (menu->flags.editing)
+	if (menu->flags.editing || blink)
 		return False;
 
 	XGrabKeyboard(dpy, menu->frame->core->window, True, GrabModeAsync, GrabModeAsync, CurrentTime);
@@ -1016,28 +1328,20 @@ static int keyboardMenu(WMenu * menu)
 	}
 
 	if (entry && entry->callback != NULL && entry->flags.enabled && entry->cascade < 0) {
-#if (MENU_BLINK_COUNT > 0)
-		int sel = menu->selected_entry;
-		int i;
-
-		for (i = 0; i < MENU_BLINK_COUNT; i++) {
-			paintEntry(menu, sel, False);
-			XSync(dpy, 0);
-			wusleep(MENU_BLINK_DELAY);
-			paintEntry(menu, sel, True);
-			XSync(dpy, 0);
-			wusleep(MENU_BLINK_DELAY);
-		}
-#endif
-		selectEntry(menu, -1);
-
-		if (!menu->flags.buttoned) {
-			wMenuUnmap(menu);
-			move_menus(menu, old_pos_x, old_pos_y);
-		}
-		closeCascade(menu);
-
-		(*entry->callback) (menu, entry);
+		WMenuBlink *b = wmalloc(sizeof(WMenuBlink));
+
+		b->menu = menu;
+		b->entry = entry;
+		b->index = menu->selected_entry;
+		b->keyboard = True;
+		b->old_x = old_pos_x;
+		b->old_y = old_pos_y;
+		blinkEntry(b);
+	} else if (blink && blink->keyboard) {
+		/* an entry of a submenu is blinking, the menus are closed with it */
+		blink->top = menu;
+		blink->top_x = old_pos_x;
+		blink->top_y = old_pos_y;
 	} else {
 		if (!menu->flags.buttoned) {
 			wMenuUnmap(menu);
@@ -1276,7 +1580,7 @@ static WMenu *findMenu(WScreen * scr, int *x_ret, int *y_ret)
 	if (win == None)
 		return NULL;
 
-	if (XFindContext(dpy, win, w_global.context.client_win, (XPointer *) & desc) == XCNOENT)
+	if ((desc = wCoreFindDescriptor(win)) == NULL)
 		return NULL;
 
 	if (desc->parent_type == WCLASS_MENU) {
@@ -1398,7 +1702,7 @@ WMenu *wMenuUnderPointer(WScreen * screen)
 	if (win == None)
 		return NULL;
 
-	if (XFindContext(dpy, win, w_global.context.client_win, (XPointer *) & desc) == XCNOENT)
+	if ((desc = wCoreFindDescriptor(win)) == NULL)
 		return NULL;
 
 	if (desc->parent_type == WCLASS_MENU)
@@ -1673,10 +1977,20 @@ void wMenuScroll(WMenu *menu)
 
 static void menuExpose(WObjDescriptor * desc, XEvent * event)
 {
-	/* Parameter not used, but tell the compiler that it is ok */
-	(void) event;
+	WMenu *menu = desc->parent;
+	int i, first, last;
+
+	if (!menu->flags.mapped || menu->entry_height <= 0)
+		return;
+
+	/* repaint only the entries that were exposed */
+	first = event->xexpose.y / menu->entry_height;
+	last = (event->xexpose.y + event->xexpose.height - 1) / menu->entry_height;
+	if (last >= menu->entry_no)
+		last = menu->entry_no - 1;
 
-	wMenuPaint(desc->parent);
+	for (i = first; i <= last; i++)
+		paintEntry(menu, i, i == menu->selected_entry);
 }
 
 typedef struct {
@@ -1702,6 +2016,19 @@ static void delaySelection(void *data)
 		*(d->delayed_select) = 0;
 }
 
+/* Closes what should not stay opened after menu was clicked */
+static void closeClickedMenu(WMenu *menu, Bool close, int old_x, int old_y)
+{
+	if (close)
+		closeCascade(menu);
+
+	/* close the cascade windows that should not remain opened */
+	closeBrotherCascadesOf(menu);
+
+	if (!wPreferences.wrap_menus)
+		wMenuMove(parentMenu(menu), old_x, old_y, True);
+}
+
 static void menuMouseDown(WObjDescriptor * desc, XEvent * event)
 {
 	WWindow *wwin;
@@ -1721,6 +2048,10 @@ static void menuMouseDown(WObjDescriptor * desc, XEvent * event)
 	int old_frame_y = 0;
 	delay_data d_data = { NULL, NULL, NULL };
 
+	/* the menus are about to be closed */
+	if (blink)
+		return;
+
 	/* Doesn't seem to be needed anymore (if delayed selection handler is
 	 * added only if not present). there seem to be no other side effects
 	 * from removing this and it is also possible that it was only added
@@ -1978,33 +2309,18 @@ static void menuMouseDown(WObjDescriptor * desc, XEvent * event)
 	if (menu && menu->selected_entry >= 0) {
 		entry = menu->entries[menu->selected_entry];
 		if (entry->callback != NULL && entry->flags.enabled && entry->cascade < 0) {
-			/* blink and erase menu selection */
-#if (MENU_BLINK_DELAY > 0)
-			int sel = menu->selected_entry;
-			int i;
-
-			for (i = 0; i < MENU_BLINK_COUNT; i++) {
-				paintEntry(menu, sel, False);
-				XSync(dpy, 0);
-				wusleep(MENU_BLINK_DELAY);
-				paintEntry(menu, sel, True);
-				XSync(dpy, 0);
-				wusleep(MENU_BLINK_DELAY);
-			}
-#endif
-			/* unmap the menu, it's parents and call the callback */
-			if (!menu->flags.buttoned && (!menu->flags.app_menu || menu->parent != NULL)) {
-				closeCascade(menu);
-			} else {
-				selectEntry(menu, -1);
-			}
-			(*entry->callback) (menu, entry);
-
-			/* If the user double clicks an entry, the entry will
-			 * be executed twice, which is not good for things like
-			 * the root menu. So, ignore any clicks that were generated
-			 * while the entry was being executed */
-			while (XCheckTypedWindowEvent(dpy, menu->menu->window, ButtonPress, &ev)) ;
+			WMenuBlink *b = wmalloc(sizeof(WMenuBlink));
+
+			/* the menus are closed once the entry stops blinking */
+			b->menu = menu;
+			b->entry = entry;
+			b->index = menu->selected_entry;
+			b->top = desc->parent;
+			b->top_x = old_frame_x;
+			b->top_y = old_frame_y;
+			b->close_top = (b->top->flags.brother || close_on_exit || !smenu);
+			blinkEntry(b);
+			goto byebye;
 		} else if (entry->callback != NULL && entry->cascade < 0) {
 			selectEntry(menu, -1);
 		} else {
@@ -2014,14 +2330,8 @@ static void menuMouseDown(WObjDescriptor * desc, XEvent * event)
 		}
 	}
 
-	if (((WMenu *) desc->parent)->flags.brother || close_on_exit || !smenu)
-		closeCascade(desc->parent);
-
-	/* close the cascade windows that should not remain opened */
-	closeBrotherCascadesOf(desc->parent);
-
-	if (!wPreferences.wrap_menus)
-		wMenuMove(parentMenu(desc->parent), old_frame_x, old_frame_y, True);
+	closeClickedMenu(desc->parent, ((WMenu *) desc->parent)->flags.brother || close_on_exit || !smenu,
+			 old_frame_x, old_frame_y);
 
  byebye:
 	/* Just to be sure in case we skip the 2 above because of a goto byebye */
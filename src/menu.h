@@ -61,6 +61,13 @@ typedef struct WMenu {
 	struct WFrameWindow *frame;
 	WCoreWindow *menu;		       /* the window menu */
 	Pixmap menu_texture_data;
+	Pixmap entry_cache;		       /* entries pre-rendered unselected,
+					* then selected, one below the other */
+	struct WMenuCachedEntry *cached_entries; /* what each entry in
+					* entry_cache was drawn from */
+	short cache_width;		       /* size entry_cache was made for */
+	short cache_entry_height;
+	short cache_entry_no;
 	int frame_x, frame_y;	       /* position of the frame in root*/
 
 	WMenuEntry **entries;	       /* array of entries. This is shared
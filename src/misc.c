@@ -53,6 +53,7 @@
 #include "xmodifier.h"
 #include "main.h"
 #include "event.h"
+#include "animation.h"
 
 
 #define ICON_SIZE wPreferences.icon_size
@@ -145,7 +146,7 @@ void move_window(Window win, int from_x, int from_y, int to_x, int to_y)
 	if (wPreferences.no_animations)
 		XMoveWindow(dpy, win, to_x, to_y);
 	else
-		slide_window(win, from_x, from_y, to_x, to_y);
+		slide_window(win, from_x, from_y, to_x, to_y, NULL, NULL);
 #else
 	XMoveWindow(dpy, win, to_x, to_y);
 
@@ -155,12 +156,88 @@ void move_window(Window win, int from_x, int from_y, int to_x, int to_y)
 #endif
 }
 
+typedef struct SlideAnimation {
+	Window *wins;
+	int n;
+	XPoint *path;
+	int to_x, to_y;
+	time_t time0;
+
+	WAnimationProc *finish;
+	void *data;
+} SlideAnimation;
+
+/* the slides being played */
+static WMArray *slides = NULL;
+
+static Bool drawSlide(int frame, void *data)
+{
+	SlideAnimation *anim = data;
+	int i;
+
+	for (i = 0; i < anim->n; i++) {
+		if (anim->wins[i] != None)
+			XMoveWindow(dpy, anim->wins[i], anim->path[frame].x + i * ICON_SIZE, anim->path[frame].y);
+	}
+
+	return time(NULL) - anim->time0 <= MAX_ANIMATION_TIME;
+}
+
+static void finishSlide(void *data)
+{
+	SlideAnimation *anim = data;
+	int i;
+
+	/* the finish procedure may start another slide of the same windows */
+	if (slides)
+		WMRemoveFromArray(slides, anim);
+
+	for (i = 0; i < anim->n; i++) {
+		if (anim->wins[i] != None)
+			XMoveWindow(dpy, anim->wins[i], anim->to_x + i * ICON_SIZE, anim->to_y);
+	}
+
+	XSync(dpy, 0);
+	/* compress expose events */
+	eatExpose();
+
+	if (anim->finish)
+		(*anim->finish) (anim->data);
+
+	wfree(anim->path);
+	wfree(anim->wins);
+	wfree(anim);
+}
+
+/*
+ * Stops moving win, if it is being slid. The slide goes on with the
+ * other windows, and its finish procedure is still called when it ends.
+ */
+void stop_window_slide(Window win)
+{
+	SlideAnimation *anim;
+	int i, j;
+
+	for (i = 0; slides && i < WMGetArrayItemCount(slides); i++) {
+		anim = WMGetFromArray(slides, i);
+
+		for (j = 0; j < anim->n; j++) {
+			if (anim->wins[j] == win)
+				anim->wins[j] = None;
+		}
+	}
+}
+
 /* wins is an array of Window, sorted from left to right, the first is
  * going to be moved from (from_x,from_y) to (to_x,to_y) and the
- * following windows are going to be offset by (ICON_SIZE*i,0) */
-void slide_windows(Window wins[], int n, int from_x, int from_y, int to_x, int to_y)
+ * following windows are going to be offset by (ICON_SIZE*i,0).
+ * The windows are moved from timers, and finish is called with data
+ * once they are where they belong. */
+void slide_windows(Window wins[], int n, int from_x, int from_y, int to_x, int to_y,
+		   WAnimationProc *finish, void *data)
 {
-	time_t time0 = time(NULL);
+	SlideAnimation *anim;
+	int count, size;
 	float dx, dy, x = from_x, y = from_y, px, py;
 	Bool is_dx_nul, is_dy_nul;
 	int dx_is_bigger = 0, dx_int, dy_int;
@@ -211,6 +288,23 @@ void slide_windows(Window wins[], int n, int from_x, int from_y, int to_x, int t
 		px = (is_dy_nul ? 0.0F : py * dx / dy);
 	}
 
+	/* a window only follows the slide started last */
+	for (i = 0; i < n; i++)
+		stop_window_slide(wins[i]);
+
+	anim = wmalloc(sizeof(SlideAnimation));
+	anim->wins = wmalloc(n * sizeof(Window));
+	memcpy(anim->wins, wins, n * sizeof(Window));
+	anim->n = n;
+	anim->to_x = to_x;
+	anim->to_y = to_y;
+	anim->finish = finish;
+	anim->data = data;
+
+	count = 0;
+	size = 32;
+	anim->path = wmalloc(size * sizeof(XPoint));
+
 	while (((int)x) != to_x ||
 			 ((int)y) != to_y) {
 		x += px;
@@ -236,34 +330,35 @@ void slide_windows(Window wins[], int n, int from_x, int from_y, int to_x, int t
 			px = (is_dy_nul ? 0.0F : py * dx / dy);
 		}
 
-		for (i = 0; i < n; i++) {
-			XMoveWindow(dpy, wins[i], (int)x + i * ICON_SIZE, (int)y);
-		}
-		XFlush(dpy);
-		if (slide_delay > 0) {
-			wusleep(slide_delay * 1000L);
-		} else {
-			wusleep(1000L);
+		if (count == size) {
+			size *= 2;
+			anim->path = wrealloc(anim->path, size * sizeof(XPoint));
 		}
-		if (time(NULL) - time0 > MAX_ANIMATION_TIME)
-			break;
+		anim->path[count].x = (int)x;
+		anim->path[count].y = (int)y;
+		count++;
 	}
-	for (i = 0; i < n; i++) {
-		XMoveWindow(dpy, wins[i], to_x + i * ICON_SIZE, to_y);
+
+	if (count == 0) {
+		finishSlide(anim);
+		return;
 	}
 
-	XSync(dpy, 0);
-	/* compress expose events */
-	eatExpose();
+	/* the path is computed beforehand, so that frames can be dropped */
+	if (!slides)
+		slides = WMCreateArray(4);
+	WMAddToArray(slides, anim);
+
+	anim->time0 = time(NULL);
+	wAnimationStart(count, (slide_delay > 0 ? slide_delay : 1) * 1000L, drawSlide, finishSlide, anim);
 }
 
 char *ShrinkString(WMFont *font, const char *string, int width)
 {
 	int w, w1 = 0;
-	int p;
+	int p, skip;
 	char *pos;
 	char *text;
-	int p1, p2, t;
 
 	p = strlen(string);
 	w = WMWidthOfString(font, string, p);
@@ -297,21 +392,18 @@ char *ShrinkString(WMFont *font, const char *string, int width)
 	strcat(text, "...");
 	width -= WMWidthOfString(font, "...", 3);
 
-	p1 = 0;
-	p2 = p;
-	t = (p2 - p1) / 2;
-	while (p2 > p1 && p1 != t) {
-		w = WMWidthOfString(font, &string[p - t], t);
-		if (w > width) {
-			p2 = t;
-			t = p1 + (p2 - p1) / 2;
-		} else if (w < width) {
-			p1 = t;
-			t = p1 + (p2 - p1) / 2;
-		} else
-			p2 = p1 = t;
+	/*
+	 * Keep the longest end of the string that fits, that is drop the
+	 * shortest beginning that is at least as wide as the excess.
+	 */
+	w = WMWidthOfString(font, string, p);
+	skip = WMFitStringInWidth(font, string, p, w - width);
+	while (skip < p && WMWidthOfString(font, &string[skip], p - skip) > width) {
+		do {
+			skip++;
+		} while (skip < p && (string[skip] & 0xc0) == 0x80);
 	}
-	strcat(text, &string[p - p1]);
+	strcat(text, &string[skip]);
 
 	return text;
 }
@@ -24,18 +24,22 @@
 #include "defaults.h"
 #include "keybind.h"
 #include "appicon.h"
+#include "animation.h"
 
 Bool wFetchName(Display *dpy, Window win, char **winname);
 Bool wGetIconName(Display *dpy, Window win, char **iconname);
 Bool UpdateDomainFile(WDDomain * domain);
 
 void move_window(Window win, int from_x, int from_y, int to_x, int to_y);
-void slide_windows(Window wins[], int n, int from_x, int from_y, int to_x, int to_y);
+void slide_windows(Window wins[], int n, int from_x, int from_y, int to_x, int to_y,
+		   WAnimationProc *finish, void *data);
+void stop_window_slide(Window win);
 void ParseWindowName(WMPropList *value, char **winstance, char **wclass, const char *where);
 
-static inline void slide_window(Window win, int from_x, int from_y, int to_x, int to_y)
+static inline void slide_window(Window win, int from_x, int from_y, int to_x, int to_y,
+				WAnimationProc *finish, void *data)
 {
-	slide_windows(&win, 1, from_x, from_y, to_x, to_y);
+	slide_windows(&win, 1, from_x, from_y, to_x, to_y, finish, data);
 }
 
 /* Helper is a 'wmsetbg' subprocess with sets the background for the current workspace */
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "WindowMaker.h"
 #include "framewin.h"
@@ -61,23 +62,140 @@
 
 /*
  *----------------------------------------------------------------------
- * checkMouseSamplingRate-
- *      For lowering the mouse motion sampling rate for machines where
- * it's too high (SGIs). If it returns False then the event should be
- * ignored.
+ * Motion pacing for interactive move/resize.
+ *
+ * Pointers with high polling rates can deliver far more MotionNotify
+ * events than the display can show. Queued motion is compressed by the
+ * callers and the resulting geometry is applied at most once every
+ * 1/MoveResizeRate second. A motion that arrives too early is held back
+ * and replayed from a timer, so the window always ends up under the
+ * last pointer position even if the pointer stops moving.
  *----------------------------------------------------------------------
  */
-static Bool checkMouseSamplingRate(XEvent * ev)
+static struct {
+	struct timespec last_update;	/* when the last motion was accepted */
+	WMHandlerID timer;		/* replays the held back motion */
+	XEvent pending;			/* last motion that was held back */
+	Bool has_pending;
+	Bool flushing;			/* accept the next motion unconditionally */
+
+	unsigned int events;		/* motion events received */
+	unsigned int updates;		/* motion events acted upon */
+} pacer;
+
+static long pacerInterval(void)
 {
-	static Time previousMotion = 0;
+	if (wPreferences.move_resize_rate > 0)
+		return 1000L / wPreferences.move_resize_rate;
 
-	if (ev->type == MotionNotify) {
-		if (ev->xmotion.time - previousMotion < DELAY_BETWEEN_MOUSE_SAMPLING) {
-			return False;
-		} else {
-			previousMotion = ev->xmotion.time;
-		}
+	return DELAY_BETWEEN_MOUSE_SAMPLING;
+}
+
+static void pacerReplayMotion(void *data)
+{
+	/* Parameter not used, but tell the compiler that it is ok */
+	(void) data;
+
+	pacer.timer = NULL;
+	if (pacer.has_pending) {
+		pacer.has_pending = False;
+		XPutBackEvent(dpy, &pacer.pending);
+	}
+}
+
+static void pacerStart(void)
+{
+	memset(&pacer.last_update, 0, sizeof(pacer.last_update));
+	pacer.has_pending = False;
+	pacer.flushing = False;
+	pacer.events = 0;
+	pacer.updates = 0;
+}
+
+static void pacerStop(const char *what)
+{
+	if (pacer.timer) {
+		WMDeleteTimerHandler(pacer.timer);
+		pacer.timer = NULL;
+	}
+	pacer.has_pending = False;
+
+#ifdef DEBUG
+	wmessage("%s: %u motion events, %u geometry updates", what, pacer.events, pacer.updates);
+#else
+	/* Parameter only used for debugging */
+	(void) what;
+#endif
+}
+
+/*
+ * Count a motion event that was dropped because a newer one was
+ * already in the queue.
+ */
+static void pacerCompressed(void)
+{
+	pacer.events++;
+}
+
+/*
+ * Returns False if the event should be ignored for now. Non-motion
+ * events are always accepted.
+ */
+static Bool pacerAcceptMotion(XEvent *ev)
+{
+	struct timespec now;
+	long elapsed, interval;
+
+	if (ev->type != MotionNotify)
+		return True;
+
+	pacer.events++;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - pacer.last_update.tv_sec) * 1000L
+		+ (now.tv_nsec - pacer.last_update.tv_nsec) / 1000000L;
+	interval = pacerInterval();
+
+	if (!pacer.flushing && elapsed >= 0 && elapsed < interval) {
+		pacer.pending = *ev;
+		pacer.has_pending = True;
+		if (!pacer.timer)
+			pacer.timer = WMAddTimerHandler(interval - elapsed, pacerReplayMotion, NULL);
+		return False;
+	}
+
+	pacer.flushing = False;
+	pacer.has_pending = False;
+	if (pacer.timer) {
+		WMDeleteTimerHandler(pacer.timer);
+		pacer.timer = NULL;
 	}
+	pacer.last_update = now;
+	pacer.updates++;
+
+	return True;
+}
+
+/*
+ * If a motion is being held back, queue it in front of ev so that the
+ * final position is applied before ev gets handled. Returns True if the
+ * caller must fetch the next event again.
+ */
+static Bool pacerFlushBefore(XEvent *ev)
+{
+	if (!pacer.has_pending)
+		return False;
+
+	if (pacer.timer) {
+		WMDeleteTimerHandler(pacer.timer);
+		pacer.timer = NULL;
+	}
+	pacer.has_pending = False;
+	pacer.flushing = True;
+
+	XPutBackEvent(dpy, ev);
+	XPutBackEvent(dpy, &pacer.pending);
+
 	return True;
 }
 
@@ -450,6 +568,26 @@ static void doWindowMove(WWindow * wwin, WMArray * array, int dx, int dy)
 	}
 }
 
+/*
+ * Tell the moved window(s) about their final position. Only one
+ * synthetic ConfigureNotify is sent per window, however many
+ * intermediate moves happened.
+ */
+static void synthConfigureNotify(WWindow *wwin, WMArray *array)
+{
+	WWindow *tmpw;
+	WMArrayIterator iter;
+
+	if (!array || !WMGetArrayItemCount(array)) {
+		wWindowSynthConfigureNotify(wwin);
+		return;
+	}
+
+	WM_ITERATE_ARRAY(array, tmpw, iter) {
+		wWindowSynthConfigureNotify(tmpw);
+	}
+}
+
 static void drawTransparentFrame(WWindow * wwin, int x, int y, int width, int height)
 {
 	Window root = wwin->screen_ptr->root_win;
@@ -1635,14 +1773,8 @@ int wKeyboardMoveResizeWindow(WWindow * wwin)
 						wWindowMove(wwin, src_x + off_x, src_y + off_y);
 						wWindowSynthConfigureNotify(wwin);
 					} else {
-						WMArrayIterator iter;
-						WWindow *foo;
-
 						doWindowMove(wwin, scr->selected_windows, off_x, off_y);
-
-						WM_ITERATE_ARRAY(scr->selected_windows, foo, iter) {
-							wWindowSynthConfigureNotify(foo);
-						}
+						synthConfigureNotify(wwin, scr->selected_windows);
 					}
 				} else {
 					if (ww != original_w)
@@ -1727,6 +1859,7 @@ int wMouseMoveWindow(WWindow * wwin, XEvent * ev)
 	}
 	shiftl = XKeysymToKeycode(dpy, XK_Shift_L);
 	shiftr = XKeysymToKeycode(dpy, XK_Shift_R);
+	pacerStart();
 	while (!done) {
 		if (warped) {
 			int junk;
@@ -1743,9 +1876,12 @@ int wMouseMoveWindow(WWindow * wwin, XEvent * ev)
 
 			if (event.type == MotionNotify) {
 				/* compress MotionNotify events */
-				while (XCheckMaskEvent(dpy, ButtonMotionMask, &event)) ;
-				if (!checkMouseSamplingRate(&event))
+				while (XCheckMaskEvent(dpy, ButtonMotionMask, &event))
+					pacerCompressed();
+				if (!pacerAcceptMotion(&event))
 					continue;
+			} else if (event.type == ButtonRelease && pacerFlushBefore(&event)) {
+				continue;
 			}
 		}
 		switch (event.type) {
@@ -1914,7 +2050,7 @@ int wMouseMoveWindow(WWindow * wwin, XEvent * ev)
 						     moveData.realY - wwin->frame_y);
 				}
 #ifndef CONFIGURE_WINDOW_WHILE_MOVING
-				wWindowSynthConfigureNotify(wwin);
+				synthConfigureNotify(wwin, scr->selected_windows);
 #endif
 				XUngrabKeyboard(dpy, CurrentTime);
 				XUngrabServer(dpy);
@@ -1965,6 +2101,8 @@ int wMouseMoveWindow(WWindow * wwin, XEvent * ev)
 		}
 	}
 
+	pacerStop("move");
+
 	if (wPreferences.opaque_move && !wPreferences.use_saveunders) {
 		XSetWindowAttributes attr;
 
@@ -2093,11 +2231,18 @@ void wMouseResizeWindow(WWindow * wwin, XEvent * ev)
 	ry2 = fy + fh - 1;
 	shiftl = XKeysymToKeycode(dpy, XK_Shift_L);
 	shiftr = XKeysymToKeycode(dpy, XK_Shift_R);
+	pacerStart();
 
 	while (1) {
 		WMMaskEvent(dpy, KeyPressMask | ButtonMotionMask
 			    | ButtonReleaseMask | PointerMotionHintMask | ButtonPressMask | ExposureMask, &event);
-		if (!checkMouseSamplingRate(&event))
+		if (event.type == MotionNotify && started) {
+			while (XCheckMaskEvent(dpy, ButtonMotionMask, &event))
+				pacerCompressed();
+		}
+		if (!pacerAcceptMotion(&event))
+			continue;
+		if (event.type == ButtonRelease && pacerFlushBefore(&event))
 			continue;
 
 		switch (event.type) {
@@ -2116,8 +2261,6 @@ void wMouseResizeWindow(WWindow * wwin, XEvent * ev)
 
 		case MotionNotify:
 			if (started) {
-				while (XCheckMaskEvent(dpy, ButtonMotionMask, &event)) ;
-
 				dw = 0;
 				dh = 0;
 
@@ -2272,6 +2415,7 @@ void wMouseResizeWindow(WWindow * wwin, XEvent * ev)
 				wWindowConfigure(wwin, fx, fy, fw, fh - vert_border);
 				wWindowSynthConfigureNotify(wwin);
 			}
+			pacerStop("resize");
 			return;
 
 		default:
@@ -2429,10 +2573,13 @@ void InteractivePlaceWindow(WWindow * wwin, int *x_ret, int *y_ret, unsigned wid
 
 	shiftl = XKeysymToKeycode(dpy, XK_Shift_L);
 	shiftr = XKeysymToKeycode(dpy, XK_Shift_R);
+	pacerStart();
 	while (1) {
 		WMMaskEvent(dpy, PointerMotionMask | ButtonPressMask | ExposureMask | KeyPressMask, &event);
 
-		if (!checkMouseSamplingRate(&event))
+		if (!pacerAcceptMotion(&event))
+			continue;
+		if (event.type == ButtonPress && pacerFlushBefore(&event))
 			continue;
 
 		switch (event.type) {
@@ -2469,6 +2616,7 @@ void InteractivePlaceWindow(WWindow * wwin, int *x_ret, int *y_ret, unsigned wid
 			XUngrabKeyboard(dpy, CurrentTime);
 			/* get rid of the geometry window */
 			WMUnmapWidget(scr->gview);
+			pacerStop("place");
 			return;
 
 		default:
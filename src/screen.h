@@ -32,6 +32,15 @@ typedef struct {
     WMRect *screens;
     int count;                 /* screen count, 0 = inactive */
     int primary_head;	       /* main working screen */
+
+    /* head topology, built along with the screens */
+    int *xedges;	       /* sorted distinct head edges, columns + 1 */
+    int *yedges;	       /* sorted distinct head edges, rows + 1 */
+    int columns;
+    int rows;
+    short *cells;	       /* first head covering each cell, or -1 */
+    short (*neighbours)[4];    /* nearest head in each direction, or -1 */
+    Bool overlapping;	       /* some heads share an area (cloned outputs) */
 } WXineramaInfo;
 
 
@@ -115,6 +124,14 @@ typedef struct _WScreen {
 
     int window_count;		       /* number of windows in window_list */
 
+    struct {
+	Window *windows;	       /* stacking order we last gave the
+					* server, topmost first */
+	int count;
+	int size;
+	Bool valid;		       /* False until the order is known */
+    } committed_stacking;
+
     int workspace_count;	       /* number of workspaces */
 
     struct WWorkspace **workspaces;    /* workspace array */
@@ -303,6 +320,7 @@ typedef struct _WScreen {
         unsigned int doing_alt_tab:1;
         unsigned int jump_back_pending:1;
         unsigned int ignore_focus_events:1;
+        unsigned int workspace_menus_pending:1;
     } flags;
 } WScreen;
 
@@ -36,6 +36,10 @@
 #include "winspector.h"
 #include "wmspec.h"
 #include "colormap.h"
+#include "stacking.h"
+#include "workspace.h"
+#include "animation.h"
+#include "icon.h"
 #include "shutdown.h"
 
 
@@ -83,6 +87,13 @@ void Shutdown(WShutdownMode mode)
 					RestoreDesktop(scr);
 			}
 		}
+#ifdef DEBUG
+		wCorePrintRegistryStatistics();
+		PrintStackingStatistics();
+		wWorkspacePrintSwitchStatistics();
+		wAnimationPrintStatistics();
+		wIconPrintPixmapStatistics();
+#endif
 		ExecExitScript();
 		Exit(0);
 		break;
@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
@@ -36,6 +37,13 @@
 #include "workspace.h"
 
 
+static struct {
+	unsigned long commits;		/* calls to CommitStacking() */
+	unsigned long full_commits;	/* ... that had to restack everything */
+	unsigned long windows;		/* windows in the stacking lists at commit */
+	unsigned long restacked;	/* windows actually moved by commits */
+} stats;
+
 static void notifyStackChange(WCoreWindow * frame, char *detail)
 {
 	WWindow *wwin = wWindowFor(frame->window);
@@ -43,6 +51,117 @@ static void notifyStackChange(WCoreWindow * frame, char *detail)
 	WMPostNotificationName(WMNChangedStacking, wwin, detail);
 }
 
+/*
+ * The committed stacking is our idea of the order the server has for
+ * the windows in the stacking lists. It is kept up to date by every
+ * restacking request made from here, so that CommitStacking() only has
+ * to move the windows that are out of place.
+ */
+static int committedIndex(WScreen *scr, Window window)
+{
+	int i;
+
+	for (i = 0; i < scr->committed_stacking.count; i++)
+		if (scr->committed_stacking.windows[i] == window)
+			return i;
+
+	return -1;
+}
+
+static void committedRemove(WScreen *scr, Window window)
+{
+	int i = committedIndex(scr, window);
+
+	if (i < 0)
+		return;
+
+	scr->committed_stacking.count--;
+	memmove(&scr->committed_stacking.windows[i], &scr->committed_stacking.windows[i + 1],
+		sizeof(Window) * (scr->committed_stacking.count - i));
+}
+
+static void committedInsert(WScreen *scr, int index, Window window)
+{
+	if (scr->committed_stacking.count == scr->committed_stacking.size) {
+		scr->committed_stacking.size = scr->committed_stacking.size * 2 + 16;
+		scr->committed_stacking.windows = wrealloc(scr->committed_stacking.windows,
+							   sizeof(Window) * scr->committed_stacking.size);
+	}
+	memmove(&scr->committed_stacking.windows[index + 1], &scr->committed_stacking.windows[index],
+		sizeof(Window) * (scr->committed_stacking.count - index));
+	scr->committed_stacking.windows[index] = window;
+	scr->committed_stacking.count++;
+}
+
+/* Record that the server has put window right below sibling (or on top/bottom) */
+static void committedMoveBelow(WScreen *scr, Window window, Window sibling)
+{
+	int i;
+
+	if (!scr->committed_stacking.valid)
+		return;
+
+	committedRemove(scr, window);
+	i = committedIndex(scr, sibling);
+	if (i < 0) {
+		/* we don't know where that is, the next commit will be a full one */
+		scr->committed_stacking.valid = False;
+		return;
+	}
+	committedInsert(scr, i + 1, window);
+}
+
+static void committedRaise(WScreen *scr, Window window)
+{
+	if (!scr->committed_stacking.valid)
+		return;
+
+	committedRemove(scr, window);
+	committedInsert(scr, 0, window);
+}
+
+static void committedLower(WScreen *scr, Window window)
+{
+	if (!scr->committed_stacking.valid)
+		return;
+
+	committedRemove(scr, window);
+	committedInsert(scr, scr->committed_stacking.count, window);
+}
+
+static void raiseFrameWindow(WCoreWindow *frame)
+{
+	XRaiseWindow(dpy, frame->window);
+	committedRaise(frame->screen_ptr, frame->window);
+}
+
+static void lowerFrameWindow(WCoreWindow *frame)
+{
+	XLowerWindow(dpy, frame->window);
+	committedLower(frame->screen_ptr, frame->window);
+}
+
+/*
+ *----------------------------------------------------------------------
+ * ForgetStackingPosition--
+ * 	To be called after frame was restacked behind our back (with a
+ * direct XRaiseWindow() for example), so that the next CommitStacking()
+ * puts it back in place.
+ *----------------------------------------------------------------------
+ */
+void ForgetStackingPosition(WCoreWindow *frame)
+{
+	committedRemove(frame->screen_ptr, frame->window);
+}
+
+#ifdef DEBUG
+void PrintStackingStatistics(void)
+{
+	printf("stacking: %lu commits (%lu full), %lu windows, %lu restacked\n",
+	       stats.commits, stats.full_commits, stats.windows, stats.restacked);
+}
+#endif
+
 /*
  *----------------------------------------------------------------------
  * RemakeStackList--
@@ -72,6 +191,10 @@ void RemakeStackList(WScreen * scr)
 	} else {
 		WMEmptyBag(scr->stacking_list);
 
+		/* this is the order the server really has, topmost last */
+		scr->committed_stacking.count = 0;
+		scr->committed_stacking.valid = True;
+
 		/* verify list integrity */
 		c = 0;
 		for (i = 0; i < nwindows; i++) {
@@ -82,6 +205,7 @@ void RemakeStackList(WScreen * scr)
 			if (!frame)
 				continue;
 			c++;
+			committedInsert(scr, 0, frame->window);
 			level = frame->stacking->window_level;
 			tmp = WMGetFromBag(scr->stacking_list, level);
 			if (tmp)
@@ -97,12 +221,69 @@ void RemakeStackList(WScreen * scr)
 	CommitStacking(scr);
 }
 
+/*
+ * Find which windows of the wanted order can stay where they are: the
+ * longest subsequence of it that is already in the committed order.
+ * keep[i] is set for those, all the others must be moved.
+ */
+static int findStationaryWindows(WScreen *scr, Window *windows, int count, char *keep)
+{
+	WMHashTable *position;
+	int *pos, *tails, *prev;
+	int i, j, length;
+
+	position = WMCreateHashTable(WMIntHashCallbacks);
+	for (i = 0; i < scr->committed_stacking.count; i++)
+		WMHashInsert(position, (void *) scr->committed_stacking.windows[i], (void *) (intptr_t) (i + 1));
+
+	pos = wmalloc(sizeof(int) * count * 3);
+	tails = pos + count;
+	prev = tails + count;
+
+	/* patience sorting: tails[k] ends the best increasing run of length k + 1 */
+	length = 0;
+	for (i = 0; i < count; i++) {
+		int lo, hi;
+
+		pos[i] = (int) (intptr_t) WMHashGet(position, (void *) windows[i]) - 1;
+		keep[i] = 0;
+		if (pos[i] < 0)
+			continue;
+
+		lo = 0;
+		hi = length;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+
+			if (pos[tails[mid]] < pos[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		prev[i] = lo > 0 ? tails[lo - 1] : -1;
+		tails[lo] = i;
+		if (lo == length)
+			length++;
+	}
+
+	for (j = length > 0 ? tails[length - 1] : -1; j >= 0; j = prev[j])
+		keep[j] = 1;
+
+	wfree(pos);
+	WMFreeHashTable(position);
+
+	return length;
+}
+
 /*
  *----------------------------------------------------------------------
  * CommitStacking--
  * 	Reorders the actual window stacking, so that it has the stacking
  * order in the internal window stacking lists. It does the opposite
  * of RemakeStackList().
+ * 	Only the windows that are out of place relative to the others are
+ * restacked, each one right under the window that should be above it.
+ * When we don't know the current order everything is restacked.
  *
  * Side effects:
  * 	Windows may be restacked.
@@ -125,7 +306,54 @@ void CommitStacking(WScreen * scr)
 			tmp = tmp->stacking->under;
 		}
 	}
-	XRestackWindows(dpy, windows, i);
+	nwindows = i;
+
+	stats.commits++;
+	stats.windows += nwindows;
+
+	if (!scr->committed_stacking.valid) {
+		XRestackWindows(dpy, windows, nwindows);
+		stats.full_commits++;
+		stats.restacked += nwindows;
+	} else if (nwindows > 0) {
+		XWindowChanges xwc;
+		char *keep = wmalloc(nwindows);
+		int first;
+
+		if (findStationaryWindows(scr, windows, nwindows, keep) == 0)
+			keep[0] = 1;	/* nothing known, use the topmost as the anchor */
+
+		for (first = 0; !keep[first]; first++)
+			;
+
+		for (i = 0; i < nwindows; i++) {
+			if (keep[i])
+				continue;
+
+			if (i == 0) {
+				xwc.sibling = windows[first];
+				xwc.stack_mode = Above;
+			} else {
+				xwc.sibling = windows[i - 1];
+				xwc.stack_mode = Below;
+			}
+			XConfigureWindow(dpy, windows[i], CWSibling | CWStackMode, &xwc);
+			stats.restacked++;
+		}
+		wfree(keep);
+	}
+
+	/* the server has our order now */
+	if (scr->committed_stacking.size < nwindows) {
+		scr->committed_stacking.size = nwindows;
+		scr->committed_stacking.windows = wrealloc(scr->committed_stacking.windows,
+							   sizeof(Window) * nwindows);
+	}
+	if (nwindows > 0)
+		memcpy(scr->committed_stacking.windows, windows, sizeof(Window) * nwindows);
+	scr->committed_stacking.count = nwindows;
+	scr->committed_stacking.valid = True;
+
 	wfree(windows);
 	WMPostNotificationName(WMNResetStacking, scr, NULL);
 }
@@ -149,6 +377,7 @@ static void moveFrameToUnder(WCoreWindow * under, WCoreWindow * frame)
 	wins[0] = under->window;
 	wins[1] = frame->window;
 	XRestackWindows(dpy, wins, 2);
+	committedMoveBelow(frame->screen_ptr, frame->window, under->window);
 }
 
 /*
@@ -184,7 +413,7 @@ void CommitStackingForWindow(WCoreWindow * frame)
 			moveFrameToUnder(above, frame);
 		} else {
 			/* no window above us */
-			XRaiseWindow(dpy, frame->window);
+			raiseFrameWindow(frame);
 		}
 	} else {
 		moveFrameToUnder(frame->stacking->above, frame);
@@ -262,7 +491,7 @@ void wRaiseFrame(WCoreWindow * frame)
 		} else {
 			/* no window above us */
 			above = NULL;
-			XRaiseWindow(dpy, frame->window);
+			raiseFrameWindow(frame);
 		}
 	} else {
 		moveFrameToUnder(frame->stacking->above, frame);
@@ -372,7 +601,7 @@ void wLowerFrame(WCoreWindow * frame)
 			moveFrameToUnder(above, frame);
 		} else {
 			/* no window below us */
-			XLowerWindow(dpy, frame->window);
+			lowerFrameWindow(frame);
 		}
 	} else {
 		moveFrameToUnder(frame->stacking->above, frame);
@@ -499,7 +728,7 @@ void MoveInStackListAbove(WCoreWindow * next, WCoreWindow * frame)
 			break;
 		}
 		if (above == NULL) {
-			XRaiseWindow(dpy, frame->window);
+			raiseFrameWindow(frame);
 		} else {
 			moveFrameToUnder(above, frame);
 		}
@@ -571,6 +800,7 @@ void RemoveFromStackList(WCoreWindow * frame)
 		WMSetInBag(frame->screen_ptr->stacking_list, index, frame->stacking->under);
 
 	frame->screen_ptr->window_count--;
+	committedRemove(frame->screen_ptr, frame->window);
 
 	WMPostNotificationName(WMNResetStacking, frame->screen_ptr, NULL);
 }
@@ -32,4 +32,9 @@ void RemakeStackList(WScreen *scr);
 void CommitStacking(WScreen *scr);
 void CommitStackingForFrame(WCoreWindow *frame);
 void CommitStackingForWindow(WCoreWindow * frame);
+void ForgetStackingPosition(WCoreWindow *frame);
+
+#ifdef DEBUG
+void PrintStackingStatistics(void);
+#endif
 #endif
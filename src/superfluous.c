@@ -39,6 +39,7 @@
 #include "actions.h"
 #include "xinerama.h"
 #include "stacking.h"
+#include "animation.h"
 
 #define PIECES ((64/ICON_KABOOM_PIECE_SIZE)*(64/ICON_KABOOM_PIECE_SIZE))
 #define KAB_PRECISION		4
@@ -50,16 +51,72 @@
 #define URGENT_BOUNCE_DELAY	3000
 
 
+#ifdef NORMAL_ICON_KABOOM
+/*
+ * The pieces fly along parabolas, so where they are can be computed
+ * from the frame number alone and frames can be dropped when we lag
+ * behind.
+ */
+typedef struct KaboomData {
+	WScreen *scr;
+	Pixmap pixmap;
+	int count;			/* pieces still on screen */
+	int ax[PIECES], ay[PIECES];	/* piece position in the icon */
+	int px[PIECES], py[PIECES];	/* start position */
+	int pvx[PIECES], pvy[PIECES];	/* start speed */
+	int lx[PIECES], ly[PIECES];	/* where it was last drawn */
+} KaboomData;
+
+static Bool drawKaboom(int frame, void *data)
+{
+	KaboomData *kab = data;
+	WScreen *scr = kab->scr;
+	int i, n, _px, _py;
+
+	/* frame 0 is the icon itself, which was unmapped */
+	n = frame + 1;
+
+	/* the event handlers may have used the GC since the last frame */
+	XSetClipMask(dpy, scr->copy_gc, None);
+
+	for (i = 0; i < PIECES; i++) {
+		if (kab->ax[i] < 0)
+			continue;
+
+		XClearArea(dpy, scr->root_win, kab->lx[i], kab->ly[i],
+			   ICON_KABOOM_PIECE_SIZE, ICON_KABOOM_PIECE_SIZE, False);
+
+		_px = (kab->px[i] + n * kab->pvx[i]) >> KAB_PRECISION;
+		_py = kab->py[i] + n * kab->pvy[i] + n * (n - 1) / 2;
+		if (_px < -wPreferences.icon_size || _px > scr->scr_width || _py >= scr->scr_height) {
+			kab->ax[i] = -1;
+			kab->count--;
+		} else {
+			XCopyArea(dpy, kab->pixmap, scr->root_win, scr->copy_gc,
+				  kab->ax[i] * ICON_KABOOM_PIECE_SIZE, kab->ay[i] * ICON_KABOOM_PIECE_SIZE,
+				  ICON_KABOOM_PIECE_SIZE, ICON_KABOOM_PIECE_SIZE, _px, _py);
+			kab->lx[i] = _px;
+			kab->ly[i] = _py;
+		}
+	}
+
+	return kab->count > 0;
+}
+
+static void finishKaboom(void *data)
+{
+	KaboomData *kab = data;
+
+	XFreePixmap(dpy, kab->pixmap);
+	wfree(kab);
+}
+#endif	/* NORMAL_ICON_KABOOM */
+
 void DoKaboom(WScreen * scr, Window win, int x, int y)
 {
 #ifdef NORMAL_ICON_KABOOM
 	int i, j, k;
-	int sw = scr->scr_width, sh = scr->scr_height;
-	int px[PIECES];
-	short py[PIECES];
-	char pvx[PIECES], pvy[PIECES];
-	/* in MkLinux/PPC gcc seems to think that char is unsigned? */
-	signed char ax[PIECES], ay[PIECES];
+	KaboomData *kab;
 	Pixmap tmp;
 
 	XSetClipMask(dpy, scr->copy_gc, None);
@@ -72,6 +129,7 @@ void DoKaboom(WScreen * scr, Window win, int x, int y)
 		image = XGetImage(dpy, win, 0, 0, wPreferences.icon_size,
 				  wPreferences.icon_size, AllPlanes, ZPixmap);
 		if (!image) {
+			XFreePixmap(dpy, tmp);
 			XUnmapWindow(dpy, win);
 			return;
 		}
@@ -80,59 +138,34 @@ void DoKaboom(WScreen * scr, Window win, int x, int y)
 		XDestroyImage(image);
 	}
 
+	kab = wmalloc(sizeof(KaboomData));
+	kab->scr = scr;
+	kab->pixmap = tmp;
+
+	for (k = 0; k < PIECES; k++)
+		kab->ax[k] = -1;
+
 	for (i = 0, k = 0; i < wPreferences.icon_size / ICON_KABOOM_PIECE_SIZE && k < PIECES; i++) {
 		for (j = 0; j < wPreferences.icon_size / ICON_KABOOM_PIECE_SIZE && k < PIECES; j++) {
 			if (rand() % 2) {
-				ax[k] = i;
-				ay[k] = j;
-				px[k] = (x + i * ICON_KABOOM_PIECE_SIZE) << KAB_PRECISION;
-				py[k] = y + j * ICON_KABOOM_PIECE_SIZE;
-				pvx[k] = rand() % (1 << (KAB_PRECISION + 3)) - (1 << (KAB_PRECISION + 3)) / 2;
-				pvy[k] = -15 - rand() % 7;
+				kab->ax[k] = i;
+				kab->ay[k] = j;
+				kab->px[k] = (x + i * ICON_KABOOM_PIECE_SIZE) << KAB_PRECISION;
+				kab->py[k] = y + j * ICON_KABOOM_PIECE_SIZE;
+				kab->pvx[k] = rand() % (1 << (KAB_PRECISION + 3)) - (1 << (KAB_PRECISION + 3)) / 2;
+				kab->pvy[k] = -15 - rand() % 7;
+				kab->lx[k] = kab->px[k] >> KAB_PRECISION;
+				kab->ly[k] = kab->py[k];
+				kab->count++;
 				k++;
-			} else {
-				ax[k] = -1;
 			}
 		}
 	}
 
 	XUnmapWindow(dpy, win);
 
-	j = k;
-	while (k > 0) {
-		XEvent foo;
-
-		if (XCheckTypedEvent(dpy, ButtonPress, &foo)) {
-			XPutBackEvent(dpy, &foo);
-			XClearWindow(dpy, scr->root_win);
-			break;
-		}
-
-		for (i = 0; i < j; i++) {
-			if (ax[i] >= 0) {
-				int _px = px[i] >> KAB_PRECISION;
-				XClearArea(dpy, scr->root_win, _px, py[i],
-					   ICON_KABOOM_PIECE_SIZE, ICON_KABOOM_PIECE_SIZE, False);
-				px[i] += pvx[i];
-				py[i] += pvy[i];
-				_px = px[i] >> KAB_PRECISION;
-				pvy[i]++;
-				if (_px < -wPreferences.icon_size || _px > sw || py[i] >= sh) {
-					ax[i] = -1;
-					k--;
-				} else {
-					XCopyArea(dpy, tmp, scr->root_win, scr->copy_gc,
-						  ax[i] * ICON_KABOOM_PIECE_SIZE, ay[i] * ICON_KABOOM_PIECE_SIZE,
-						  ICON_KABOOM_PIECE_SIZE, ICON_KABOOM_PIECE_SIZE, _px, py[i]);
-				}
-			}
-		}
-
-		XFlush(dpy);
-		wusleep(MINIATURIZE_ANIMATION_DELAY_Z * 2);
-	}
-
-	XFreePixmap(dpy, tmp);
+	/* the pieces fly while other events keep being handled */
+	wAnimationStart(0, MINIATURIZE_ANIMATION_DELAY_Z * 2, drawKaboom, finishKaboom, kab);
 #endif	/* NORMAL_ICON_KABOOM */
 }
 
@@ -200,8 +233,10 @@ static void doAppBounce(void *arg)
 
 reinit:
 	if (data->wapp->refcount > 1) {
-		if (wPreferences.raise_appicons_when_bouncing)
+		if (wPreferences.raise_appicons_when_bouncing) {
 			XRaiseWindow(dpy, aicon->icon->core->window);
+			ForgetStackingPosition(aicon->icon->core);
+		}
 
 		const double ticks = BOUNCE_HZ * BOUNCE_LENGTH;
 		const double s = sqrt(BOUNCE_HEIGHT)/(ticks/2);
@@ -23,13 +23,164 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "WindowMaker.h"
 #include "wcore.h"
 
 
+/*
+ * Registry of the windows we own or manage, mapping a window ID to its
+ * object descriptor. It replaces XFindContext() on the event paths: an
+ * open addressing table with linear probing, without the display lock
+ * and the fixed bucket count of the Xlib context manager.
+ */
+#define REGISTRY_INITIAL_BITS	8
+
+typedef struct RegistrySlot {
+	Window window;			/* None for an empty slot */
+	WObjDescriptor *desc;
+} RegistrySlot;
+
+static struct {
+	RegistrySlot *slots;
+	unsigned int bits;		/* the table has 1 << bits slots */
+	unsigned int count;
+
+	unsigned long hits;
+	unsigned long misses;
+} registry;
+
+static inline unsigned int registryHash(Window window, unsigned int bits)
+{
+	/* window IDs are mostly sequential, spread them with a multiplicative hash */
+	return (unsigned int) (((uint64_t) window * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+static void registryGrow(void)
+{
+	RegistrySlot *old_slots = registry.slots;
+	unsigned int old_size = old_slots ? 1U << registry.bits : 0;
+	unsigned int i, mask;
+
+	registry.bits = old_slots ? registry.bits + 1 : REGISTRY_INITIAL_BITS;
+	registry.slots = wmalloc(sizeof(RegistrySlot) << registry.bits);
+	mask = (1U << registry.bits) - 1;
+
+	for (i = 0; i < old_size; i++) {
+		unsigned int j;
+
+		if (old_slots[i].window == None)
+			continue;
+
+		j = registryHash(old_slots[i].window, registry.bits);
+		while (registry.slots[j].window != None)
+			j = (j + 1) & mask;
+		registry.slots[j] = old_slots[i];
+	}
+
+	if (old_slots)
+		wfree(old_slots);
+}
+
+/* Associate the descriptor with the window, replacing any previous one */
+void wCoreRegisterWindow(Window window, WObjDescriptor *desc)
+{
+	unsigned int i, mask;
+
+	if (window == None)
+		return;
+
+	/* keep the load under 1/2 so that probe sequences stay short */
+	if (!registry.slots || (registry.count + 1) * 2 > (1U << registry.bits))
+		registryGrow();
+
+	mask = (1U << registry.bits) - 1;
+	i = registryHash(window, registry.bits);
+	while (registry.slots[i].window != None) {
+		if (registry.slots[i].window == window) {
+			registry.slots[i].desc = desc;
+			return;
+		}
+		i = (i + 1) & mask;
+	}
+	registry.slots[i].window = window;
+	registry.slots[i].desc = desc;
+	registry.count++;
+}
+
+void wCoreUnregisterWindow(Window window)
+{
+	unsigned int i, j, mask;
+
+	if (window == None || !registry.slots)
+		return;
+
+	mask = (1U << registry.bits) - 1;
+	i = registryHash(window, registry.bits);
+	while (registry.slots[i].window != window) {
+		if (registry.slots[i].window == None)
+			return;
+		i = (i + 1) & mask;
+	}
+
+	/*
+	 * Shift back the entries that follow, so lookups never need to go
+	 * past an empty slot and no tombstones are left behind.
+	 */
+	j = i;
+	for (;;) {
+		unsigned int home;
+
+		j = (j + 1) & mask;
+		if (registry.slots[j].window == None)
+			break;
+
+		home = registryHash(registry.slots[j].window, registry.bits);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			registry.slots[i] = registry.slots[j];
+			i = j;
+		}
+	}
+	registry.slots[i].window = None;
+	registry.slots[i].desc = NULL;
+	registry.count--;
+}
+
+/* Returns the descriptor of the window, or NULL if it is not one of ours */
+WObjDescriptor *wCoreFindDescriptor(Window window)
+{
+	unsigned int i, mask;
+
+	if (window != None && registry.slots) {
+		mask = (1U << registry.bits) - 1;
+		i = registryHash(window, registry.bits);
+		while (registry.slots[i].window != None) {
+			if (registry.slots[i].window == window) {
+				registry.hits++;
+				return registry.slots[i].desc;
+			}
+			i = (i + 1) & mask;
+		}
+	}
+	registry.misses++;
+
+	return NULL;
+}
+
+#ifdef DEBUG
+void wCorePrintRegistryStatistics(void)
+{
+	printf("window registry: %u windows in %u slots, %lu hits, %lu misses\n",
+	       registry.count, registry.slots ? 1U << registry.bits : 0,
+	       registry.hits, registry.misses);
+}
+#endif
+
+
 /*----------------------------------------------------------------------
  * wCoreCreateTopLevel--
  * 	Creates a toplevel window used for icons, menus and dialogs.
@@ -70,7 +221,7 @@ WCoreWindow *wCoreCreateTopLevel(WScreen *screen, int x, int y, int width, int h
 	core->descriptor.self = core;
 
 	XClearWindow(dpy, core->window);
-	XSaveContext(dpy, core->window, w_global.context.client_win, (XPointer) & core->descriptor);
+	wCoreRegisterWindow(core->window, &core->descriptor);
 
 	return core;
 }
@@ -84,7 +235,7 @@ WCoreWindow *wCoreCreateTopLevel(WScreen *screen, int x, int y, int width, int h
  * 	A initialized core window structure.
  *
  * Side effects:
- * 	A window context for the created window is saved.
+ * 	The created window is added to the window registry.
  *
  * Notes:
  * 	The event mask is initialized to a default value.
@@ -114,7 +265,7 @@ WCoreWindow *wCoreCreate(WCoreWindow *parent, int x, int y, int width, int heigh
 	core->screen_ptr = parent->screen_ptr;
 	core->descriptor.self = core;
 
-	XSaveContext(dpy, core->window, w_global.context.client_win, (XPointer) & core->descriptor);
+	wCoreRegisterWindow(core->window, &core->descriptor);
 	return core;
 }
 
@@ -123,7 +274,7 @@ void wCoreDestroy(WCoreWindow * core)
 	if (core->stacking)
 		wfree(core->stacking);
 
-	XDeleteContext(dpy, core->window, w_global.context.client_win);
+	wCoreUnregisterWindow(core->window);
 	XDestroyWindow(dpy, core->window);
 	wfree(core);
 }
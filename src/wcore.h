@@ -52,4 +52,12 @@ WCoreWindow *wCoreCreate(WCoreWindow *parent, int x, int y,
 void wCoreDestroy(WCoreWindow *core);
 void wCoreConfigure(WCoreWindow *core, int req_x, int req_y,
 		    int req_w, int req_h);
+
+void wCoreRegisterWindow(Window window, WObjDescriptor *desc);
+void wCoreUnregisterWindow(Window window);
+WObjDescriptor *wCoreFindDescriptor(Window window);
+
+#ifdef DEBUG
+void wCorePrintRegistryStatistics(void);
+#endif
 #endif
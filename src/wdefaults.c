@@ -430,7 +430,11 @@ RImage *get_rimage_from_file(WScreen *scr, const char *file_name, int max_size)
 	if (!file_name)
 		return NULL;
 
-	image = RLoadImage(scr->rcontext, file_name, 0);
+	/*
+	 * Large images may be decoded at a reduced size, but not below what
+	 * wIconValidateIconSize() would still scale down
+	 */
+	image = RLoadImageForSize(scr->rcontext, file_name, 0, max_size + ICON_BORDER + 1, max_size + ICON_BORDER + 1);
 	if (!image)
 		wwarning(_("error loading image file \"%s\": %s"), file_name,
 			 RMessageForError(RErrorCode));
@@ -137,7 +137,7 @@ WWindow *wWindowFor(Window window)
 	if (window == None)
 		return NULL;
 
-	if (XFindContext(dpy, window, w_global.context.client_win, (XPointer *) & desc) == XCNOENT)
+	if ((desc = wCoreFindDescriptor(window)) == NULL)
 		return NULL;
 
 	if (desc->parent_type == WCLASS_WINDOW)
@@ -217,7 +217,7 @@ void wWindowDestroy(WWindow *wwin)
 	if (wwin->cmap_windows)
 		XFree(wwin->cmap_windows);
 
-	XDeleteContext(dpy, wwin->client_win, w_global.context.client_win);
+	wCoreUnregisterWindow(wwin->client_win);
 
 	if (wwin->frame)
 		wFrameWindowDestroy(wwin->frame);
@@ -658,7 +658,7 @@ WWindow *wManageWindow(WScreen *scr, Window window)
 	else if (!wFetchName(dpy, window, &title))
 		title = NULL;
 
-	XSaveContext(dpy, window, w_global.context.client_win, (XPointer) & wwin->client_descriptor);
+	wCoreRegisterWindow(window, &wwin->client_descriptor);
 
 #ifdef USE_XSHAPE
 	if (w_global.xext.shape.supported) {
@@ -1397,7 +1397,7 @@ WWindow *wManageInternalWindow(WScreen *scr, Window window, Window owner,
 					 scr->resizebar_texture, scr->window_title_color, &scr->title_font,
 					 scr->w_depth, scr->w_visual, scr->w_colormap);
 
-	XSaveContext(dpy, window, w_global.context.client_win, (XPointer) & wwin->client_descriptor);
+	wCoreRegisterWindow(window, &wwin->client_descriptor);
 
 	wwin->frame->flags.is_client_window_frame = 1;
 	wwin->frame->flags.justification = wPreferences.title_justification;
@@ -1507,6 +1507,8 @@ void wUnmanageWindow(WWindow *wwin, Bool restore, Bool destroyed)
 	if (scr->bfs_focused_window == wwin)
 		scr->bfs_focused_window = NULL;
 
+	wStopShadeAnimation(wwin, False);
+
 	if (!destroyed) {
 		if (!wwin->flags.internal_window)
 			XRemoveFromSaveSet(dpy, wwin->client_win);
@@ -191,6 +191,8 @@ typedef struct WWindow {
 	struct WFrameWindow *frame;		/* the frame window */
 	int frame_x, frame_y;			/* position of the frame in root*/
 
+	struct ShadeAnimation *shade_animation;	/* (un)shading in progress */
+
 	struct {
 		int x, y;
 		unsigned int width, height;	/* original geometry of the window */
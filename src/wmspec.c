@@ -389,40 +389,116 @@ int wNETWMGetCurrentDesktopFromHint(WScreen *scr)
 }
 
 /*
- * Find the best icon to be used by Window Maker for appicon/miniwindows.
- * Currently the algorithm is to take the image with the size closest
- * to icon_size x icon_size, but never bigger than that.
- *
- * This algorithm is very poorly implemented and needs to be redone (it can
- * easily select images with very large widths and very small heights over
- * square images, if the area of the former is closer to the desired one).
- *
- * The logic can also be changed to accept bigger images and scale them down.
+ * _NET_WM_ICON holds any number of icons, each one being its width and
+ * height followed by width * height ARGB pixels. Applications often set
+ * several of them, up to 512x512, so only the headers are read first,
+ * and then just the pixels of the icon that was chosen.
+ */
+
+/*
+ * Converted icons are remembered by window and by a hash of the pixels
+ * they were made from, as X properties carry no serial number. Clients
+ * that set the same icons over and over again, and icon windows that
+ * are looked at on every icon update, then don't go through conversion
+ * and scaling again.
+ */
+#define NET_ICON_CACHE_SIZE	32
+
+static struct {
+	Window window;
+	unsigned long width, height;
+	unsigned long hash;
+	int icon_size;			/* the size it was scaled for */
+	RImage *image;
+	unsigned long used;
+} icon_cache[NET_ICON_CACHE_SIZE];
+
+static unsigned long icon_cache_clock;
+
+/*
+ * Tells whether an icon of the given size fits icon_size better than
+ * the best one found so far. The smallest icon that is not smaller than
+ * icon_size is preferred, as it can be scaled down. Otherwise the biggest
+ * one is taken.
  */
-static unsigned long *findBestIcon(unsigned long *data, unsigned long items)
+static Bool isBetterIcon(unsigned long width, unsigned long height,
+			 unsigned long best_width, unsigned long best_height)
 {
-	int size, wanted, d;
-	unsigned long i, distance;
-	unsigned long *icon;
-
-	/* better use only 75% of icon_size. For 64x64 this means 48x48
-	 * This leaves room around the icon for the miniwindow title and
-	 * results in better overall aesthetics -Dan */
-	wanted = wPreferences.icon_size * wPreferences.icon_size;
-
-	for (icon = NULL, distance = wanted, i = 0L; i < items - 1;) {
-		size = data[i] * data[i + 1];
-		if (size == 0)
+	unsigned long side, best_side, wanted;
+
+	wanted = wPreferences.icon_size;
+	side = WMAX(width, height);
+	best_side = WMAX(best_width, best_height);
+
+	if (side == best_side)
+		return width * height > best_width * best_height;
+
+	if (side >= wanted && best_side >= wanted)
+		return side < best_side;
+
+	if (side >= wanted || best_side >= wanted)
+		return side >= wanted;
+
+	return side > best_side;
+}
+
+/*
+ * Walks the icon headers of the property and returns the offset, in
+ * 32-bit units, of the best icon. Returns -1 if there is no usable icon.
+ */
+static long findBestIcon(Window window, unsigned long *width, unsigned long *height)
+{
+	Atom type;
+	int format;
+	unsigned long items, rest, w, h;
+	unsigned long *header;
+	long offset, best;
+
+	best = -1;
+	*width = *height = 0;
+
+	for (offset = 0;; offset += 2 + w * h) {
+		if (XGetWindowProperty(dpy, window, net_wm_icon, offset, 2,
+				       False, XA_CARDINAL, &type, &format, &items, &rest,
+				       (unsigned char **)&header) != Success || !header)
+			break;
+
+		if (type != XA_CARDINAL || format != 32 || items < 2) {
+			XFree(header);
 			break;
-		d = wanted - size;
-		if (d >= 0 && d <= distance && (i + size + 2) <= items) {
-			distance = d;
-			icon = &data[i];
 		}
-		i += size + 2;
+		w = header[0];
+		h = header[1];
+		XFree(header);
+
+		/* the pixels must be there, which also keeps w * h in range */
+		if (w == 0 || h == 0 || w > 0xffff || h > 0xffff || w * h > rest / 4)
+			break;
+
+		if (best < 0 || isBetterIcon(w, h, *width, *height)) {
+			best = offset;
+			*width = w;
+			*height = h;
+		}
+
+		if (rest == w * h * 4)
+			break;
+	}
+
+	return best;
+}
+
+static unsigned long hashIconData(const unsigned long *data, unsigned long size)
+{
+	unsigned long hash = 2166136261UL;
+	unsigned long i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= data[i] & 0xffffffff;
+		hash *= 16777619UL;
 	}
 
-	return icon;
+	return hash;
 }
 
 static RImage *makeRImageFromARGBData(unsigned long *data)
@@ -430,7 +506,7 @@ static RImage *makeRImageFromARGBData(unsigned long *data)
 	int size, width, height, i;
 	RImage *image;
 	unsigned char *imgdata;
-	unsigned long pixel;
+	const unsigned long *pixels;
 
 	width = data[0];
 	height = data[1];
@@ -440,52 +516,138 @@ static RImage *makeRImageFromARGBData(unsigned long *data)
 		return NULL;
 
 	image = RCreateImage(width, height, True);
+	if (!image)
+		return NULL;
+
+	/* kept free of branches and loop-carried pointers, so it vectorizes */
+	imgdata = image->data;
+	pixels = data + 2;
+	for (i = 0; i < size; i++) {
+		unsigned long pixel = pixels[i];
 
-	for (imgdata = image->data, i = 2; i < size + 2; i++, imgdata += 4) {
-		pixel = data[i];
-		imgdata[3] = (pixel >> 24) & 0xff;	/* A */
-		imgdata[0] = (pixel >> 16) & 0xff;	/* R */
-		imgdata[1] = (pixel >> 8) & 0xff;	/* G */
-		imgdata[2] = (pixel >> 0) & 0xff;	/* B */
+		imgdata[4 * i + 0] = (pixel >> 16) & 0xff;	/* R */
+		imgdata[4 * i + 1] = (pixel >> 8) & 0xff;	/* G */
+		imgdata[4 * i + 2] = (pixel >> 0) & 0xff;	/* B */
+		imgdata[4 * i + 3] = (pixel >> 24) & 0xff;	/* A */
 	}
 
 	return image;
 }
 
+/* Scales icons bigger than icon_size down to it, with the smoothing filter */
+static RImage *scaleDownIcon(RImage *image)
+{
+	RImage *scaled;
+	int size = wPreferences.icon_size;
+
+	if (image->width <= size && image->height <= size)
+		return image;
+
+	if (image->width > image->height)
+		scaled = RSmoothScaleImage(image, size, WMAX(1, image->height * size / image->width));
+	else
+		scaled = RSmoothScaleImage(image, WMAX(1, image->width * size / image->height), size);
+
+	if (!scaled)
+		return image;
+
+	RReleaseImage(image);
+	return scaled;
+}
+
+static RImage *findCachedIcon(Window window, unsigned long width, unsigned long height, unsigned long hash)
+{
+	int i;
+
+	for (i = 0; i < NET_ICON_CACHE_SIZE; i++) {
+		if (icon_cache[i].image && icon_cache[i].window == window
+		    && icon_cache[i].width == width && icon_cache[i].height == height
+		    && icon_cache[i].hash == hash && icon_cache[i].icon_size == wPreferences.icon_size) {
+			icon_cache[i].used = ++icon_cache_clock;
+			return RRetainImage(icon_cache[i].image);
+		}
+	}
+
+	return NULL;
+}
+
+static void cacheIcon(Window window, unsigned long width, unsigned long height, unsigned long hash, RImage *image)
+{
+	int i, slot;
+
+	/* a window keeps a single entry, else the least recently used one goes */
+	for (slot = 0; slot < NET_ICON_CACHE_SIZE; slot++) {
+		if (icon_cache[slot].image && icon_cache[slot].window == window)
+			break;
+	}
+	if (slot == NET_ICON_CACHE_SIZE) {
+		slot = 0;
+		for (i = 1; i < NET_ICON_CACHE_SIZE && icon_cache[slot].image; i++) {
+			if (!icon_cache[i].image || icon_cache[i].used < icon_cache[slot].used)
+				slot = i;
+		}
+	}
+
+	if (icon_cache[slot].image)
+		RReleaseImage(icon_cache[slot].image);
+
+	icon_cache[slot].window = window;
+	icon_cache[slot].width = width;
+	icon_cache[slot].height = height;
+	icon_cache[slot].hash = hash;
+	icon_cache[slot].icon_size = wPreferences.icon_size;
+	icon_cache[slot].image = RRetainImage(image);
+	icon_cache[slot].used = ++icon_cache_clock;
+}
+
 RImage *get_window_image_from_x11(Window window)
 {
 	RImage *image;
 	Atom type;
 	int format;
-	unsigned long items, rest;
-	unsigned long *property, *data;
+	unsigned long items, rest, width, height, hash;
+	unsigned long *property;
+	long offset;
 
-	/* Get the icon from X11 Window */
-	if (XGetWindowProperty(dpy, window, net_wm_icon, 0L, LONG_MAX,
+	/* Find the best icon */
+	offset = findBestIcon(window, &width, &height);
+	if (offset < 0)
+		return NULL;
+
+	/* Get just that icon from X11 Window */
+	if (XGetWindowProperty(dpy, window, net_wm_icon, offset, 2 + width * height,
 			       False, XA_CARDINAL, &type, &format, &items, &rest,
 			       (unsigned char **)&property) != Success || !property)
 		return NULL;
 
-	if (type != XA_CARDINAL || format != 32 || items < 2) {
+	/* the property might have changed in the meantime */
+	if (type != XA_CARDINAL || format != 32 || items != 2 + width * height
+	    || property[0] != width || property[1] != height) {
 		XFree(property);
 		return NULL;
 	}
 
-	/* Find the best icon */
-	data = findBestIcon(property, items);
-	if (!data) {
+	hash = hashIconData(property + 2, width * height);
+	image = findCachedIcon(window, width, height, hash);
+	if (image) {
 		XFree(property);
-		return NULL;
+		return image;
 	}
 
 	/* Save the best icon in the X11 icon */
-	image = makeRImageFromARGBData(data);
+	image = makeRImageFromARGBData(property);
 
 	XFree(property);
 
+	if (!image)
+		return NULL;
+
 	/* Resize the image to the correct value */
+	image = scaleDownIcon(image);
 	image = wIconValidateIconSize(image, wPreferences.icon_size);
 
+	cacheIcon(window, width, height, hash, image);
+
 	return image;
 }
 
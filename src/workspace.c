@@ -62,6 +62,14 @@
 static WMPropList *dWorkspaces = NULL;
 static WMPropList *dClip, *dName;
 
+/*
+ * Histogram of the time taken by workspace switches: bucket i counts
+ * the switches that took less than 2^i ms, the last one the others.
+ */
+#define SWITCH_LATENCY_BUCKETS	11
+
+static unsigned long switch_latency[SWITCH_LATENCY_BUCKETS];
+
 static void make_keys(void)
 {
 	if (dWorkspaces != NULL)
@@ -473,13 +481,61 @@ void wWorkspaceRelativeChange(WScreen * scr, int amount)
 	}
 }
 
+static void updateWorkspaceMenus(void *data)
+{
+	WScreen *scr = (WScreen *) data;
+
+	scr->flags.workspace_menus_pending = 0;
+
+	wWorkspaceMenuUpdate(scr, scr->workspace_menu);
+	wWorkspaceMenuUpdate(scr, scr->clip_ws_menu);
+}
+
+static void recordSwitchLatency(const struct timespec *start)
+{
+	struct timespec now;
+	long elapsed;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - start->tv_sec) * 1000L + (now.tv_nsec - start->tv_nsec) / 1000000L;
+
+	for (i = 0; i < SWITCH_LATENCY_BUCKETS - 1; i++)
+		if (elapsed < (1L << i))
+			break;
+	switch_latency[i]++;
+}
+
+#ifdef DEBUG
+void wWorkspacePrintSwitchStatistics(void)
+{
+	int i;
+
+	printf("workspace switch latency:");
+	for (i = 0; i < SWITCH_LATENCY_BUCKETS - 1; i++)
+		printf(" <%ldms: %lu", 1L << i, switch_latency[i]);
+	printf(" more: %lu\n", switch_latency[i]);
+}
+#endif
+
+/*
+ * Switching is done in two steps: first we find out what must be
+ * mapped and unmapped, without talking to the server, then all the
+ * requests are sent at once with the server grabbed, so that clients
+ * don't get to redraw in the middle of the change. The workspace menus
+ * are only updated once we're idle again.
+ */
 void wWorkspaceForceChange(WScreen * scr, int workspace)
 {
 	WWindow *tmp, *foc = NULL, *foc2 = NULL;
+	struct timespec start;
 
 	if (workspace >= MAX_WORKSPACES || workspace < 0)
 		return;
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* the pager shows what the workspace we're leaving looked like */
 	if (wPreferences.enable_workspace_pager && !w_global.process_workspacemap_event)
 		wWorkspaceMapUpdate(scr);
 
@@ -493,23 +549,26 @@ void wWorkspaceForceChange(WScreen * scr, int workspace)
 	scr->last_workspace = scr->current_workspace;
 	scr->current_workspace = workspace;
 
-	wWorkspaceMenuUpdate(scr, scr->workspace_menu);
-
-	wWorkspaceMenuUpdate(scr, scr->clip_ws_menu);
+	if (!scr->flags.workspace_menus_pending) {
+		scr->flags.workspace_menus_pending = 1;
+		WMAddIdleHandler(updateWorkspaceMenus, scr);
+	}
 
 	tmp = scr->focused_window;
 	if (tmp != NULL) {
-		WWindow **toUnmap;
-		int toUnmapSize, toUnmapCount;
+		WMArray *toMap, *toUnmap, *iconsToMap, *iconsToUnmap;
+		WMArrayIterator iter;
+		WWindow *wwin;
 
 		if ((IS_OMNIPRESENT(tmp) && (tmp->flags.mapped || tmp->flags.shaded) &&
 		     !WFLAGP(tmp, no_focusable)) || tmp->flags.changing_workspace) {
 			foc = tmp;
 		}
 
-		toUnmapSize = 16;
-		toUnmapCount = 0;
-		toUnmap = wmalloc(toUnmapSize * sizeof(WWindow *));
+		toMap = WMCreateArray(16);
+		toUnmap = WMCreateArray(16);
+		iconsToMap = WMCreateArray(0);
+		iconsToUnmap = WMCreateArray(0);
 
 		/* foc2 = tmp; will fix annoyance with gnome panel
 		 * but will create annoyance for every other application
@@ -519,17 +578,12 @@ void wWorkspaceForceChange(WScreen * scr, int workspace)
 				/* unmap windows not on this workspace */
 				if ((tmp->flags.mapped || tmp->flags.shaded) &&
 				    !IS_OMNIPRESENT(tmp) && !tmp->flags.changing_workspace) {
-					if (toUnmapCount == toUnmapSize)
-					{
-						toUnmapSize *= 2;
-						toUnmap = wrealloc(toUnmap, toUnmapSize * sizeof(WWindow *));
-					}
-					toUnmap[toUnmapCount++] = tmp;
+					WMAddToArray(toUnmap, tmp);
 				}
 				/* also unmap miniwindows not on this workspace */
 				if (!wPreferences.sticky_icons && tmp->flags.miniaturized &&
 				    tmp->icon && !IS_OMNIPRESENT(tmp)) {
-					XUnmapWindow(dpy, tmp->icon->core->window);
+					WMAddToArray(iconsToUnmap, tmp);
 					tmp->icon->mapped = 0;
 				}
 				/* update current workspace of omnipresent windows */
@@ -556,7 +610,7 @@ void wWorkspaceForceChange(WScreen * scr, int workspace)
 					if (!tmp->flags.hidden) {
 						if (!(tmp->flags.mapped || tmp->flags.miniaturized)) {
 							/* remap windows that are on this workspace */
-							wWindowMap(tmp);
+							WMAddToArray(toMap, tmp);
 							if (!foc && !WFLAGP(tmp, no_focusable)) {
 								foc = tmp;
 							}
@@ -565,7 +619,7 @@ void wWorkspaceForceChange(WScreen * scr, int workspace)
 						if (!wPreferences.sticky_icons &&
 						    tmp->flags.miniaturized && !IS_OMNIPRESENT(tmp) && tmp->icon) {
 							tmp->icon->mapped = 1;
-							XMapWindow(dpy, tmp->icon->core->window);
+							WMAddToArray(iconsToMap, tmp);
 						}
 					}
 				}
@@ -573,11 +627,26 @@ void wWorkspaceForceChange(WScreen * scr, int workspace)
 			tmp = tmp->prev;
 		}
 
-		while (toUnmapCount > 0)
-		{
-			wWindowUnmap(toUnmap[--toUnmapCount]);
-		}
-		wfree(toUnmap);
+		/*
+		 * Map the new windows before unmapping the old ones, so the
+		 * root window is not uncovered in between.
+		 */
+		XGrabServer(dpy);
+		WM_ITERATE_ARRAY(toMap, wwin, iter)
+			wWindowMap(wwin);
+		WM_ITERATE_ARRAY(iconsToMap, wwin, iter)
+			XMapWindow(dpy, wwin->icon->core->window);
+		WM_ETARETI_ARRAY(toUnmap, wwin, iter)
+			wWindowUnmap(wwin);
+		WM_ITERATE_ARRAY(iconsToUnmap, wwin, iter)
+			XUnmapWindow(dpy, wwin->icon->core->window);
+		XUngrabServer(dpy);
+		XFlush(dpy);
+
+		WMFreeArray(toMap);
+		WMFreeArray(toUnmap);
+		WMFreeArray(iconsToMap);
+		WMFreeArray(iconsToUnmap);
 
 		/* Gobble up events unleashed by our mapping & unmapping.
 		 * These may trigger various grab-initiated focus &
@@ -667,7 +736,7 @@ void wWorkspaceForceChange(WScreen * scr, int workspace)
 
 	WMPostNotificationName(WMNWorkspaceChanged, scr, (void *)(uintptr_t) workspace);
 
-	/*   XSync(dpy, False); */
+	recordSwitchLatency(&start);
 }
 
 static void switchWSCommand(WMenu * menu, WMenuEntry * entry)
@@ -953,6 +1022,10 @@ void wWorkspaceRestoreState(WScreen *scr)
 				aicon->dock = scr->workspaces[0]->clip;
 			}
 			scr->workspaces[0]->clip->icon_count += added_omnipresent_icons;
+			if (added_omnipresent_icons > 0) {
+				wDockRebuildIndex(scr->workspaces[i]->clip);
+				wDockRebuildIndex(scr->workspaces[0]->clip);
+			}
 		}
 
 		WMPostNotificationName(WMNWorkspaceNameChanged, scr, (void *)(uintptr_t) i);
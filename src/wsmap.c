@@ -96,22 +96,28 @@ void wWorkspaceMapUpdate(WScreen *scr)
 static void workspace_map_slide(WWorkspaceMap *wsmap)
 {
 	if (wsmap->edge == WD_TOP)
-		slide_window(WMWidgetXID(wsmap->win), 0, -1 * wsmap->wsheight, wsmap->xcount, wsmap->ycount);
+		slide_window(WMWidgetXID(wsmap->win), 0, -1 * wsmap->wsheight, wsmap->xcount, wsmap->ycount,
+			     NULL, NULL);
 	else
-		slide_window(WMWidgetXID(wsmap->win), 0, wsmap->scr->scr_height, wsmap->xcount, wsmap->ycount);
+		slide_window(WMWidgetXID(wsmap->win), 0, wsmap->scr->scr_height, wsmap->xcount, wsmap->ycount,
+			     NULL, NULL);
 }
 
-static void workspace_map_unslide(WWorkspaceMap *wsmap)
+static void workspace_map_unslide(WWorkspaceMap *wsmap, WAnimationProc *finish)
 {
 	if (wsmap->edge == WD_TOP)
-		slide_window(WMWidgetXID(wsmap->win), wsmap->xcount, wsmap->ycount, 0, -1 * wsmap->wsheight);
+		slide_window(WMWidgetXID(wsmap->win), wsmap->xcount, wsmap->ycount, 0, -1 * wsmap->wsheight,
+			     finish, wsmap);
 	else
-		slide_window(WMWidgetXID(wsmap->win), wsmap->xcount, wsmap->ycount, 0, wsmap->scr->scr_height);
+		slide_window(WMWidgetXID(wsmap->win), wsmap->xcount, wsmap->ycount, 0, wsmap->scr->scr_height,
+			     finish, wsmap);
 }
 
-static void workspace_map_destroy(WWorkspaceMap *wsmap)
+/* Called once the map slid out of the screen */
+static void workspace_map_release(void *data)
 {
-	workspace_map_unslide(wsmap);
+	WWorkspaceMap *wsmap = data;
+
 	WMUnmapWidget(wsmap->win);
 
 	if (wsmap->win) {
@@ -129,15 +135,26 @@ static void workspace_map_destroy(WWorkspaceMap *wsmap)
 		ev.xclient.data.l[0] = False;
 		XSendEvent(dpy, info_win, True, EnterWindowMask, &ev);
 		WMDestroyWidget(wsmap->win);
-
-		if (frame_bg_focused)
-			WMReleasePixmap(frame_bg_focused);
-		if (frame_bg_unfocused)
-			WMReleasePixmap(frame_bg_unfocused);
 	}
 	wfree(wsmap);
 }
 
+static void workspace_map_destroy(WWorkspaceMap *wsmap)
+{
+	/*
+	 * The labels keep the backgrounds they use, release them now in
+	 * case another map is shown before this one is gone.
+	 */
+	if (frame_bg_focused)
+		WMReleasePixmap(frame_bg_focused);
+	if (frame_bg_unfocused)
+		WMReleasePixmap(frame_bg_unfocused);
+	frame_bg_focused = NULL;
+	frame_bg_unfocused = NULL;
+
+	workspace_map_unslide(wsmap, workspace_map_release);
+}
+
 static void selected_workspace_callback(WMWidget *w, void *data)
 {
 	WWorkspaceMap *wsmap = (WWorkspaceMap *) data;
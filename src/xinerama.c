@@ -38,11 +38,166 @@
 # endif
 #endif
 
+/*
+ * The head edges split the screen into a grid of cells that no head
+ * boundary crosses, so every point of a cell is covered by the same
+ * heads. Each cell records the first of them, which makes finding the
+ * head under a point two binary searches instead of a walk over all
+ * heads. The grid, and the nearest head in each direction, are built
+ * once with the head list; RandR changes restart the window manager.
+ */
+
+static int compareEdges(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* sorts the edges and drops duplicates, returns how many are left */
+static int sortEdges(int *edges, int count)
+{
+	int i, n;
+
+	qsort(edges, count, sizeof(int), compareEdges);
+
+	n = 0;
+	for (i = 0; i < count; i++) {
+		if (n == 0 || edges[i] != edges[n - 1])
+			edges[n++] = edges[i];
+	}
+
+	return n;
+}
+
+/* returns the cell containing value, or -1 if it is outside the grid */
+static int findCell(const int *edges, int cells, int value)
+{
+	int lo, hi, mid;
+
+	if (cells <= 0 || value < edges[0] || value >= edges[cells])
+		return -1;
+
+	lo = 0;
+	hi = cells;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (edges[mid] <= value)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* returns the first head containing the point, or -1 if none does */
+static int findHeadForPoint(WXineramaInfo *info, int x, int y)
+{
+	int column, row;
+
+	column = findCell(info->xedges, info->columns, x);
+	row = findCell(info->yedges, info->rows, y);
+	if (column < 0 || row < 0)
+		return -1;
+
+	return info->cells[row * info->columns + column];
+}
+
+static Bool headContainsRect(WMRect *head, int x, int y, int width, int height)
+{
+	return (x >= head->pos.x && y >= head->pos.y
+		&& x + width <= head->pos.x + (int)head->size.width
+		&& y + height <= head->pos.y + (int)head->size.height);
+}
+
+/*
+ * Returns the head wholly containing the rectangle when heads do not
+ * overlap, in which case it is also the one covering most of it, or -1.
+ */
+static int findHeadContainingRect(WXineramaInfo *info, int x, int y, int width, int height)
+{
+	int head;
+
+	if (info->overlapping || !info->cells || width <= 0 || height <= 0)
+		return -1;
+
+	head = findHeadForPoint(info, x, y);
+	if (head < 0 || !headContainsRect(&info->screens[head], x, y, width, height))
+		return -1;
+
+	return head;
+}
+
+static int findRelativeHead(WScreen *scr, int current_head, int direction);
+
+static void buildHeadIndex(WScreen *scr)
+{
+	WXineramaInfo *info = &scr->xine_info;
+	int count = info->count;
+	int i, j, column, row;
+
+	if (count == 0)
+		return;
+
+	info->xedges = wmalloc(sizeof(int) * 2 * count);
+	info->yedges = wmalloc(sizeof(int) * 2 * count);
+	for (i = 0; i < count; i++) {
+		info->xedges[2 * i] = info->screens[i].pos.x;
+		info->xedges[2 * i + 1] = info->screens[i].pos.x + info->screens[i].size.width;
+		info->yedges[2 * i] = info->screens[i].pos.y;
+		info->yedges[2 * i + 1] = info->screens[i].pos.y + info->screens[i].size.height;
+	}
+	info->columns = sortEdges(info->xedges, 2 * count) - 1;
+	info->rows = sortEdges(info->yedges, 2 * count) - 1;
+
+	info->cells = wmalloc(sizeof(short) * info->columns * info->rows);
+	for (row = 0; row < info->rows; row++) {
+		for (column = 0; column < info->columns; column++) {
+			short head = -1;
+
+			for (i = 0; i < count; i++) {
+				if (headContainsRect(&info->screens[i], info->xedges[column], info->yedges[row],
+						     info->xedges[column + 1] - info->xedges[column],
+						     info->yedges[row + 1] - info->yedges[row])) {
+					head = i;
+					break;
+				}
+			}
+			info->cells[row * info->columns + column] = head;
+		}
+	}
+
+	info->overlapping = False;
+	for (i = 0; i < count && !info->overlapping; i++) {
+		for (j = i + 1; j < count; j++) {
+			if (calcIntersectionArea(info->screens[i].pos.x, info->screens[i].pos.y,
+						 info->screens[i].size.width, info->screens[i].size.height,
+						 info->screens[j].pos.x, info->screens[j].pos.y,
+						 info->screens[j].size.width, info->screens[j].size.height) != 0) {
+				info->overlapping = True;
+				break;
+			}
+		}
+	}
+
+	info->neighbours = wmalloc(sizeof(*info->neighbours) * count);
+	for (i = 0; i < count; i++) {
+		for (j = DIRECTION_LEFT; j <= DIRECTION_DOWN; j++)
+			info->neighbours[i][j] = findRelativeHead(scr, i, j);
+	}
+}
+
 void wInitXinerama(WScreen * scr)
 {
 	scr->xine_info.primary_head = 0;
 	scr->xine_info.screens = NULL;
 	scr->xine_info.count = 0;
+	scr->xine_info.xedges = NULL;
+	scr->xine_info.yedges = NULL;
+	scr->xine_info.columns = 0;
+	scr->xine_info.rows = 0;
+	scr->xine_info.cells = NULL;
+	scr->xine_info.neighbours = NULL;
+	scr->xine_info.overlapping = False;
 #ifdef USE_XINERAMA
 # ifdef SOLARIS_XINERAMA
 	if (XineramaGetState(dpy, scr->screen)) {
@@ -83,6 +238,8 @@ void wInitXinerama(WScreen * scr)
 	}
 # endif				/* !SOLARIS_XINERAMA */
 #endif				/* USE_XINERAMA */
+
+	buildHeadIndex(scr);
 }
 
 int wGetRectPlacementInfo(WScreen * scr, WMRect rect, int *flags)
@@ -117,6 +274,10 @@ int wGetRectPlacementInfo(WScreen * scr, WMRect rect, int *flags)
 		return scr->xine_info.primary_head;
 	}
 
+	best = findHeadContainingRect(&scr->xine_info, rx, ry, rw, rh);
+	if (best >= 0)
+		return best;
+
 	for (i = 0; i < wXineramaHeads(scr); i++) {
 		unsigned long a;
 
@@ -158,7 +319,10 @@ int wGetHeadForRect(WScreen * scr, WMRect rect)
 	if (!scr->xine_info.count)
 		return scr->xine_info.primary_head;
 
-	best = -1;
+	best = findHeadContainingRect(&scr->xine_info, rx, ry, rw, rh);
+	if (best >= 0)
+		return best;
+
 	area = 0;
 
 	for (i = 0; i < wXineramaHeads(scr); i++) {
@@ -242,6 +406,15 @@ int wGetHeadForWindow(WWindow * wwin)
 head. If there is no screen available on pointed direction, -1 will be
 returned.*/
 int wGetHeadRelativeToCurrentHead(WScreen *scr, int current_head, int direction)
+{
+	if (scr->xine_info.neighbours && current_head >= 0 && current_head < scr->xine_info.count
+	    && direction >= DIRECTION_LEFT && direction <= DIRECTION_DOWN)
+		return scr->xine_info.neighbours[current_head][direction];
+
+	return findRelativeHead(scr, current_head, direction);
+}
+
+static int findRelativeHead(WScreen *scr, int current_head, int direction)
 {
 	short int found = 0;
 	int i;
@@ -308,16 +481,16 @@ int wGetHeadRelativeToCurrentHead(WScreen *scr, int current_head, int direction)
 
 int wGetHeadForPoint(WScreen * scr, WMPoint point)
 {
-	int i;
+	int head;
 
-	for (i = 0; i < scr->xine_info.count; i++) {
-		WMRect *rect = &scr->xine_info.screens[i];
+	if (!scr->xine_info.cells)
+		return scr->xine_info.primary_head;
 
-		if ((unsigned)(point.x - rect->pos.x) < rect->size.width &&
-		    (unsigned)(point.y - rect->pos.y) < rect->size.height)
-			return i;
-	}
-	return scr->xine_info.primary_head;
+	head = findHeadForPoint(&scr->xine_info, point.x, point.y);
+	if (head < 0)
+		return scr->xine_info.primary_head;
+
+	return head;
 }
 
 int wGetHeadForPointerLocation(WScreen * scr)
@@ -8,11 +8,19 @@
 #include <config.h>
 
 #include <X11/Xproto.h>
+#include <X11/Xutil.h>
+
+#ifdef USE_XSHM
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
 
 #include <WINGs/WINGs.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 /*
  * TODO:
@@ -23,12 +31,19 @@
 
 int refreshrate = 200;
 
+typedef struct {
+	XImage *image;
+#ifdef USE_XSHM
+	XShmSegmentInfo info;
+	Bool shared;
+#endif
+} SharedImage;
+
 typedef struct {
 	Drawable d;
-	XRectangle *rects;
-	int rectP;
-	unsigned long lastpixel;
-	unsigned long *buffer;
+	SharedImage source;	/* captured region of the viewed display */
+	SharedImage scaled;	/* magnified image, pushed to the pixmap */
+	char *buffer;		/* previous capture, to skip unchanged frames */
 	int width, height;
 	int rwidth, rheight;	/* size of window in real pixels */
 	int magfactor;
@@ -50,6 +65,12 @@ typedef struct {
 	Bool frozen;
 	Bool firstDraw;
 	Bool markPointerHotspot;
+	Bool smooth;
+	Bool showFps;
+
+	int frames;
+	struct timespec fpsStart;
+	double fps;
 
 	WMHandlerID tid;
 } BufferData;
@@ -58,12 +79,127 @@ static BufferData *newWindow(int magfactor);
 
 int windowCount = 0;
 
-int rectBufferSize = 32;
+Bool smoothScaling = False;
+Bool showFps = False;
 Display *dpy, *vdpy;
 WMScreen *scr;
 unsigned int black;
 WMColor *cursorColor1;
 WMColor *cursorColor2;
+GC copyGC;
+
+#ifdef USE_XSHM
+static int shmError;
+
+static int (*oldErrorHandler)(Display *dpy, XErrorEvent *err);
+
+static int errorHandler(Display *d, XErrorEvent *err)
+{
+	shmError = 1;
+	if (err->error_code != BadAccess)
+		(*oldErrorHandler) (d, err);
+
+	return 0;
+}
+#endif
+
+/*
+ * Create an image for the given display, in a shared memory segment
+ * when the MIT-SHM extension is usable, so that it can be filled or
+ * pushed without copying it through the X connection.
+ */
+static Bool createSharedImage(SharedImage *simg, Display *d, Visual *visual, int depth, int width, int height)
+{
+#ifdef USE_XSHM
+	simg->shared = False;
+
+	if (XShmQueryExtension(d)) {
+		simg->image = XShmCreateImage(d, visual, depth, ZPixmap, NULL, &simg->info, width, height);
+		if (simg->image) {
+			simg->info.readOnly = False;
+			simg->info.shmid = shmget(IPC_PRIVATE, simg->image->bytes_per_line * height, IPC_CREAT | 0600);
+			if (simg->info.shmid >= 0) {
+				simg->info.shmaddr = shmat(simg->info.shmid, NULL, 0);
+				if (simg->info.shmaddr != (void *)-1) {
+					simg->image->data = simg->info.shmaddr;
+
+					shmError = 0;
+					XSync(d, False);
+					oldErrorHandler = XSetErrorHandler(errorHandler);
+					XShmAttach(d, &simg->info);
+					XSync(d, False);
+					XSetErrorHandler(oldErrorHandler);
+
+					/* the segment goes away once both sides detached */
+					shmctl(simg->info.shmid, IPC_RMID, NULL);
+
+					if (!shmError) {
+						simg->shared = True;
+						return True;
+					}
+					shmdt(simg->info.shmaddr);
+				} else {
+					shmctl(simg->info.shmid, IPC_RMID, NULL);
+				}
+			}
+			simg->image->data = NULL;
+			XDestroyImage(simg->image);
+		}
+	}
+#endif
+
+	simg->image = XCreateImage(d, visual, depth, ZPixmap, 0, NULL, width, height, 32, 0);
+	if (!simg->image)
+		return False;
+	simg->image->data = wmalloc(simg->image->bytes_per_line * height);
+
+	return True;
+}
+
+static void destroySharedImage(SharedImage *simg, Display *d)
+{
+	if (!simg->image)
+		return;
+
+#ifdef USE_XSHM
+	if (simg->shared) {
+		XSync(d, False);
+		XShmDetach(d, &simg->info);
+		shmdt(simg->info.shmaddr);
+		simg->image->data = NULL;
+		simg->shared = False;
+	}
+#else
+	/* Parameter not used, but tell the compiler that it is ok */
+	(void) d;
+#endif
+	XDestroyImage(simg->image);
+	simg->image = NULL;
+}
+
+static void setupImages(BufferData *data)
+{
+	int vscreen = DefaultScreen(vdpy);
+
+	if (data->width < 1)
+		data->width = 1;
+	if (data->height < 1)
+		data->height = 1;
+
+	destroySharedImage(&data->source, vdpy);
+	destroySharedImage(&data->scaled, dpy);
+
+	if (!createSharedImage(&data->source, vdpy, DefaultVisual(vdpy, vscreen), DefaultDepth(vdpy, vscreen),
+			       data->width, data->height)
+	    || !createSharedImage(&data->scaled, dpy, WMScreenRContext(scr)->visual, WMScreenDepth(scr),
+				  data->width * data->magfactor, data->height * data->magfactor)) {
+		puts("could not create image buffers");
+		exit(1);
+	}
+
+	data->buffer = wrealloc(data->buffer, data->source.image->bytes_per_line * data->height);
+	memset(data->buffer, 0, data->source.image->bytes_per_line * data->height);
+}
 
 
 static BufferData *makeBufferData(WMWindow * win, WMLabel * label, int width, int height, int magfactor)
@@ -81,9 +217,6 @@ static BufferData *makeBufferData(WMWindow * win, WMLabel * label, int width, in
 
 	data->magfactor = magfactor;
 
-	data->rects = wmalloc(sizeof(XRectangle) * rectBufferSize);
-	data->rectP = 0;
-
 	data->win = win;
 	data->label = label;
 
@@ -93,29 +226,28 @@ static BufferData *makeBufferData(WMWindow * win, WMLabel * label, int width, in
 	data->d = WMGetPixmapXID(data->pixmap);
 
 	data->frozen = False;
+	data->smooth = smoothScaling;
+	data->showFps = showFps;
+	clock_gettime(CLOCK_MONOTONIC, &data->fpsStart);
+
+	data->width = width / magfactor;
+	data->height = height / magfactor;
 
-	width /= magfactor;
-	height /= magfactor;
-	data->buffer = wmalloc(sizeof(unsigned long) * width * height);
-	data->width = width;
-	data->height = height;
+	setupImages(data);
 
 	return data;
 }
 
 static void resizeBufferData(BufferData * data, int width, int height, int magfactor)
 {
-	int w = width / magfactor;
-	int h = height / magfactor;
-
 	data->rwidth = width;
 	data->rheight = height;
 	data->firstDraw = True;
 	data->magfactor = magfactor;
-	data->buffer = wrealloc(data->buffer, sizeof(unsigned long) * w * h);
-	data->width = w;
-	data->height = h;
-	memset(data->buffer, 0, w * h * sizeof(unsigned long));
+	data->width = width / magfactor;
+	data->height = height / magfactor;
+
+	setupImages(data);
 
 	WMResizeWidget(data->label, width, height);
 
@@ -126,100 +258,240 @@ static void resizeBufferData(BufferData * data, int width, int height, int magfa
 	data->d = WMGetPixmapXID(data->pixmap);
 }
 
-static int drawpoint(BufferData * data, unsigned long pixel, int x, int y)
+static void updateTitle(BufferData *data)
 {
-	static GC gc = NULL;
-	Bool flush = (x < 0);
+	char buf[64];
+	int len;
 
-	if (!flush) {
-		if (data->buffer[x + data->width * y] == pixel && !data->firstDraw)
-			return 0;
+	if (data->frozen)
+		len = snprintf(buf, sizeof(buf), "[Magnify %ix]", data->magfactor);
+	else
+		len = snprintf(buf, sizeof(buf), "Magnify %ix", data->magfactor);
 
-		data->buffer[x + data->width * y] = pixel;
-	}
-	if (gc == NULL) {
-		gc = XCreateGC(dpy, DefaultRootWindow(dpy), 0, NULL);
-	}
-
-	if (!flush && data->lastpixel == pixel && data->rectP < rectBufferSize) {
-		data->rects[data->rectP].x = x * data->magfactor;
-		data->rects[data->rectP].y = y * data->magfactor;
-		data->rects[data->rectP].width = data->magfactor;
-		data->rects[data->rectP].height = data->magfactor;
-		data->rectP++;
+	if (data->showFps && len > 0 && len < sizeof(buf))
+		snprintf(buf + len, sizeof(buf) - len, " %.1f fps", data->fps);
 
-		return 0;
-	}
-	XSetForeground(dpy, gc, data->lastpixel);
-	XFillRectangles(dpy, data->d, gc, data->rects, data->rectP);
-	data->rectP = 0;
-	data->rects[data->rectP].x = x * data->magfactor;
-	data->rects[data->rectP].y = y * data->magfactor;
-	data->rects[data->rectP].width = data->magfactor;
-	data->rects[data->rectP].height = data->magfactor;
-	data->rectP++;
-
-	data->lastpixel = pixel;
-
-	return 1;
+	WMSetWindowTitle(data->win, buf);
 }
 
-static inline unsigned long getpix(XImage * image, int x, int y, int xoffs, int yoffs)
+/*
+ * Updates the frame rate once a second, from the number of frames that
+ * were actually drawn in the window since the last update.
+ */
+static void updateFps(BufferData *data)
 {
-	if (x < xoffs || y < yoffs || x >= xoffs + image->width || y >= yoffs + image->height) {
-		return black;
-	}
-	return XGetPixel(image, x - xoffs, y - yoffs);
+	struct timespec now;
+	long elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - data->fpsStart.tv_sec) * 1000L
+		+ (now.tv_nsec - data->fpsStart.tv_nsec) / 1000000L;
+	if (elapsed < 1000)
+		return;
+
+	data->fps = data->frames * 1000.0 / elapsed;
+	data->frames = 0;
+	data->fpsStart = now;
+
+	if (data->showFps)
+		updateTitle(data);
 }
 
-static void updateImage(BufferData * data, int rx, int ry)
+/*
+ * Capture the area around (gx, gy) into the source image. Parts that
+ * fall outside of the viewed screen are left black.
+ */
+static void captureSource(BufferData *data, int gx, int gy)
 {
-	int gx, gy, gw, gh;
+	XImage *image = data->source.image;
+	Window root = DefaultRootWindow(vdpy);
+	int swidth = WidthOfScreen(DefaultScreenOfDisplay(vdpy));
+	int sheight = HeightOfScreen(DefaultScreenOfDisplay(vdpy));
+	int gw = data->width;
+	int gh = data->height;
+	int xoffs = 0, yoffs = 0;
 	int x, y;
-	int xoffs, yoffs;
-	int changedPixels = 0;
-	XImage *image;
 
-	gw = data->width;
-	gh = data->height;
-
-	gx = rx - gw / 2;
-	gy = ry - gh / 2;
+#ifdef USE_XSHM
+	if (data->source.shared && gx >= 0 && gy >= 0 && gx + gw <= swidth && gy + gh <= sheight) {
+		XShmGetImage(vdpy, root, image, gx, gy, AllPlanes);
+		return;
+	}
+#endif
 
-	xoffs = yoffs = 0;
 	if (gx < 0) {
-		xoffs = abs(gx);
+		xoffs = -gx;
 		gw += gx;
 		gx = 0;
 	}
-	if (gx + gw >= WidthOfScreen(DefaultScreenOfDisplay(vdpy))) {
-		gw = WidthOfScreen(DefaultScreenOfDisplay(vdpy)) - gx;
-	}
+	if (gx + gw > swidth)
+		gw = swidth - gx;
 	if (gy < 0) {
-		yoffs = abs(gy);
+		yoffs = -gy;
 		gh += gy;
 		gy = 0;
 	}
-	if (gy + gh >= HeightOfScreen(DefaultScreenOfDisplay(vdpy))) {
-		gh = HeightOfScreen(DefaultScreenOfDisplay(vdpy)) - gy;
+	if (gy + gh > sheight)
+		gh = sheight - gy;
+
+	if (xoffs > 0 || yoffs > 0 || gw < data->width || gh < data->height) {
+		for (y = 0; y < data->height; y++)
+			for (x = 0; x < data->width; x++)
+				XPutPixel(image, x, y, black);
 	}
+	if (gw > 0 && gh > 0)
+		XGetSubImage(vdpy, root, gx, gy, gw, gh, AllPlanes, ZPixmap, image, xoffs, yoffs);
+}
 
-	image = XGetImage(vdpy, DefaultRootWindow(vdpy), gx, gy, gw, gh, AllPlanes, ZPixmap);
+static int maskShift(unsigned long mask)
+{
+	int shift = 0;
 
-	for (y = 0; y < data->height; y++) {
-		for (x = 0; x < data->width; x++) {
-			unsigned long pixel;
+	if (mask == 0)
+		return 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		shift++;
+	}
+	return shift;
+}
 
-			pixel = getpix(image, x, y, xoffs, yoffs);
+/* True if pixels can be handled as 32 bit words with 8 bit channels */
+static Bool isDirect32(XImage *src, XImage *dst)
+{
+	if (src->bits_per_pixel != 32 || dst->bits_per_pixel != 32)
+		return False;
+
+	if (src->byte_order != dst->byte_order || src->red_mask != dst->red_mask
+	    || src->green_mask != dst->green_mask || src->blue_mask != dst->blue_mask)
+		return False;
 
-			if (drawpoint(data, pixel, x, y))
-				changedPixels++;
+	return (src->red_mask >> maskShift(src->red_mask)) == 0xff
+		&& (src->green_mask >> maskShift(src->green_mask)) == 0xff
+		&& (src->blue_mask >> maskShift(src->blue_mask)) == 0xff;
+}
+
+static void scaleNearest(BufferData *data, XImage *src, XImage *dst)
+{
+	int mag = data->magfactor;
+	int x, y, i;
+
+	if (isDirect32(src, dst)) {
+		for (y = 0; y < data->height; y++) {
+			unsigned int *sptr = (unsigned int *)(src->data + y * src->bytes_per_line);
+			unsigned int *dptr = (unsigned int *)(dst->data + y * mag * dst->bytes_per_line);
+
+			for (x = 0; x < data->width; x++)
+				for (i = 0; i < mag; i++)
+					*dptr++ = sptr[x];
+
+			/* the other rows of the block are copies of the first one */
+			for (i = 1; i < mag; i++)
+				memcpy(dst->data + (y * mag + i) * dst->bytes_per_line,
+				       dst->data + y * mag * dst->bytes_per_line, data->width * mag * 4);
 		}
+		return;
 	}
-	/* flush the point cache */
-	drawpoint(data, 0, -1, -1);
 
-	XDestroyImage(image);
+	for (y = 0; y < data->height * mag; y++)
+		for (x = 0; x < data->width * mag; x++)
+			XPutPixel(dst, x, y, XGetPixel(src, x / mag, y / mag));
+}
+
+/*
+ * Bilinear interpolation between the source pixels, only available
+ * for 32 bit true color images.
+ */
+static void scaleSmooth(BufferData *data, XImage *src, XImage *dst)
+{
+	int mag = data->magfactor;
+	int shift[3], chan;
+	unsigned long mask[3];
+	int x, y;
+
+	mask[0] = src->red_mask;
+	mask[1] = src->green_mask;
+	mask[2] = src->blue_mask;
+	for (chan = 0; chan < 3; chan++)
+		shift[chan] = maskShift(mask[chan]);
+
+	for (y = 0; y < data->height * mag; y++) {
+		/* position in the source, in 1/256th of a pixel */
+		int fy = ((2 * y + 1) * 256) / (2 * mag) - 128;
+		int y0, y1, wy;
+		unsigned int *row0, *row1;
+		unsigned int *dptr = (unsigned int *)(dst->data + y * dst->bytes_per_line);
+
+		if (fy < 0)
+			fy = 0;
+		y0 = fy >> 8;
+		wy = fy & 0xff;
+		y1 = (y0 + 1 < data->height) ? y0 + 1 : y0;
+		row0 = (unsigned int *)(src->data + y0 * src->bytes_per_line);
+		row1 = (unsigned int *)(src->data + y1 * src->bytes_per_line);
+
+		for (x = 0; x < data->width * mag; x++) {
+			int fx = ((2 * x + 1) * 256) / (2 * mag) - 128;
+			int x0, x1, wx;
+			unsigned int p00, p01, p10, p11, pixel;
+
+			if (fx < 0)
+				fx = 0;
+			x0 = fx >> 8;
+			wx = fx & 0xff;
+			x1 = (x0 + 1 < data->width) ? x0 + 1 : x0;
+
+			p00 = row0[x0];
+			p01 = row0[x1];
+			p10 = row1[x0];
+			p11 = row1[x1];
+
+			pixel = 0;
+			for (chan = 0; chan < 3; chan++) {
+				int c00 = (p00 & mask[chan]) >> shift[chan];
+				int c01 = (p01 & mask[chan]) >> shift[chan];
+				int c10 = (p10 & mask[chan]) >> shift[chan];
+				int c11 = (p11 & mask[chan]) >> shift[chan];
+				int top = c00 * (256 - wx) + c01 * wx;
+				int bottom = c10 * (256 - wx) + c11 * wx;
+				int c = (top * (256 - wy) + bottom * wy) >> 16;
+
+				pixel |= (unsigned int)c << shift[chan];
+			}
+			*dptr++ = pixel;
+		}
+	}
+}
+
+static void updateImage(BufferData * data, int rx, int ry)
+{
+	XImage *src = data->source.image;
+	XImage *dst = data->scaled.image;
+	int size = src->bytes_per_line * data->height;
+
+	captureSource(data, rx - data->width / 2, ry - data->height / 2);
+
+	updateFps(data);
+
+	/* nothing to do if the area did not change since the last time */
+	if (!data->firstDraw && memcmp(data->buffer, src->data, size) == 0)
+		return;
+	memcpy(data->buffer, src->data, size);
+
+	if (data->smooth && data->magfactor > 1 && isDirect32(src, dst))
+		scaleSmooth(data, src, dst);
+	else
+		scaleNearest(data, src, dst);
+
+#ifdef USE_XSHM
+	if (data->scaled.shared)
+		XShmPutImage(dpy, data->d, copyGC, dst, 0, 0, 0, 0,
+			     data->width * data->magfactor, data->height * data->magfactor, False);
+	else
+#endif
+		XPutImage(dpy, data->d, copyGC, dst, 0, 0, 0, 0,
+			  data->width * data->magfactor, data->height * data->magfactor);
+	data->frames++;
 
 	if (data->markPointerHotspot && !data->frozen) {
 		XRectangle rects[4];
@@ -249,9 +521,7 @@ static void updateImage(BufferData * data, int rx, int ry)
 		XFillRectangles(dpy, data->d, WMColorGC(cursorColor2), rects + 2, 2);
 	}
 
-	if (changedPixels > 0) {
-		WMRedisplayWidget(data->label);
-	}
+	WMRedisplayWidget(data->label);
 
 	data->firstDraw = False;
 }
@@ -297,8 +567,9 @@ static void closeWindow(WMWidget * w, void *d)
 	} else {
 		WMDeleteTimerHandler(data->tid);
 		WMDestroyWidget(w);
+		destroySharedImage(&data->source, vdpy);
+		destroySharedImage(&data->scaled, dpy);
 		wfree(data->buffer);
-		wfree(data->rects);
 		WMReleasePixmap(data->pixmap);
 		wfree(data);
 	}
@@ -321,18 +592,25 @@ static void keyHandler(XEvent * event, void *d)
 			break;
 		case 'm':
 			data->markPointerHotspot = !data->markPointerHotspot;
+			data->firstDraw = True;
+			break;
+		case 's':
+			data->smooth = !data->smooth;
+			data->firstDraw = True;
+			break;
+		case 'r':
+			data->showFps = !data->showFps;
+			updateTitle(data);
 			break;
 		case 'f':
 		case ' ':
 			data->frozen = !data->frozen;
+			data->firstDraw = True;
 			if (data->frozen) {
 				data->x = event->xkey.x_root;
 				data->y = event->xkey.y_root;
-				sprintf(buf, "[Magnify %ix]", data->magfactor);
-			} else {
-				sprintf(buf, "Magnify %ix", data->magfactor);
 			}
-			WMSetWindowTitle(data->win, buf);
+			updateTitle(data);
 			break;
 		case '1':
 		case '2':
@@ -344,12 +622,7 @@ static void keyHandler(XEvent * event, void *d)
 		case '8':
 		case '9':
 			resizeBufferData(data, size.width, size.height, buf[0] - '0');
-			if (data->frozen) {
-				sprintf(buf, "[Magnify %ix]", data->magfactor);
-			} else {
-				sprintf(buf, "Magnify %ix", data->magfactor);
-			}
-			WMSetWindowTitle(data->win, buf);
+			updateTitle(data);
 			break;
 		}
 	}
@@ -360,14 +633,11 @@ static BufferData *newWindow(int magfactor)
 	WMWindow *win;
 	WMLabel *label;
 	BufferData *data;
-	char buf[32];
 
 	windowCount++;
 
 	win = WMCreateWindow(scr, "magnify");
 	WMResizeWidget(win, 300, 200);
-	sprintf(buf, "Magnify %ix", magfactor);
-	WMSetWindowTitle(win, buf);
 	WMSetViewNotifySizeChanges(WMWidgetView(win), True);
 
 	label = WMCreateLabel(win);
@@ -377,6 +647,7 @@ static BufferData *newWindow(int magfactor)
 	WMSetLabelImagePosition(label, WIPImageOnly);
 
 	data = makeBufferData(win, label, 300, 200, magfactor);
+	updateTitle(data);
 
 	WMCreateEventHandler(WMWidgetView(win), KeyReleaseMask, keyHandler, data);
 
@@ -431,6 +702,10 @@ int main(int argc, char **argv)
 				printf("%s:invalid refresh rate ``%s''\n", argv[0], argv[i]);
 				exit(1);
 			}
+		} else if (strcmp(argv[i], "-s") == 0) {
+			smoothScaling = True;
+		} else if (strcmp(argv[i], "-fps") == 0) {
+			showFps = True;
 		} else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
  help:
 
@@ -439,6 +714,8 @@ int main(int argc, char **argv)
 			puts("  -display <display>\tdisplay where to magnification is shown");
 			puts("  -m <number>\t\tchange magnification factor (default 2)");
 			puts("  -r <number>\t\tchange refresh delay, in milliseconds (default 200)");
+			puts("  -s\t\t\tsmooth the magnified image instead of showing square pixels");
+			puts("  -fps\t\t\tshow the number of frames per second in the title");
 			puts("  -vdisplay <display>\tdisplay from which the magnification is taken");
 			puts("  -h, --help\t\tdisplay this help page");
 			puts("Keys:");
@@ -447,6 +724,8 @@ int main(int argc, char **argv)
 			     "			position");
 			puts("  n			create a new window");
 			puts("  m			show/hide the pointer hotspot mark");
+			puts("  s			toggle smooth scaling");
+			puts("  r			show/hide the frames per second");
 			exit(0);
 		}
 	}
@@ -467,12 +746,6 @@ int main(int argc, char **argv)
 		vdpy = dpy;
 	}
 
-	/* calculate how many rectangles we can send in a trip to the server */
-	rectBufferSize = XMaxRequestSize(dpy) - 128;
-	rectBufferSize /= sizeof(XRectangle);
-	if (rectBufferSize < 1)
-		rectBufferSize = 1;
-
 	black = BlackPixel(dpy, DefaultScreen(dpy));
 
 	scr = WMCreateScreen(dpy, 0);
@@ -480,6 +753,8 @@ int main(int argc, char **argv)
 	cursorColor1 = WMCreateNamedColor(scr, "#ff0000", False);
 	cursorColor2 = WMCreateNamedColor(scr, "#00ff00", False);
 
+	copyGC = XCreateGC(dpy, DefaultRootWindow(dpy), 0, NULL);
+
 	newWindow(magfactor);
 
 	WMScreenMainLoop(scr);
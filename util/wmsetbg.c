@@ -38,6 +38,7 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <ctype.h>
+#include <poll.h>
 
 #ifdef USE_XINERAMA
 # ifdef SOLARIS_XINERAMA	/* sucks */
@@ -95,8 +96,21 @@ typedef struct BackgroundTexture {
 	Pixmap pixmap;		/* for all textures, including solid */
 	int width;		/* size of the pixmap */
 	int height;
+
+	/* In helper mode textures are rendered on first use */
+	Bool rendered;		/* color and pixmap are valid */
+	Bool invalid;		/* rendering failed, do not retry */
+	unsigned long size;	/* approximate server memory used by the pixmap */
+	unsigned long lastUse;	/* for the LRU eviction */
 } BackgroundTexture;
 
+/* Memory budget for rendered workspace backgrounds in helper mode */
+#define DEFAULT_CACHE_SIZE 64	/* in MB */
+
+unsigned long cacheBudget = DEFAULT_CACHE_SIZE * 1024 * 1024;
+unsigned long cacheUsed = 0;
+unsigned long cacheClock = 0;
+
 static noreturn void quit(int rcode)
 {
 	WMReleaseApplication();
@@ -697,7 +711,7 @@ static BackgroundTexture *parseTexture(RContext * rc, char *text)
 	return NULL;
 }
 
-static void freeTexture(BackgroundTexture * texture)
+static void releaseTextureData(BackgroundTexture * texture)
 {
 	if (texture->solid) {
 		unsigned long pixel[1];
@@ -707,19 +721,96 @@ static void freeTexture(BackgroundTexture * texture)
 		if (pixel[0] != BlackPixelOfScreen(DefaultScreenOfDisplay(dpy))
 		    && pixel[0] != WhitePixelOfScreen(DefaultScreenOfDisplay(dpy)))
 			XFreeColors(dpy, DefaultColormap(dpy, scr), pixel, 1, 0);
+		/* the colour is allocated again if the texture is rendered again */
+		texture->solid = 0;
 	}
 	if (texture->pixmap) {
 		XFreePixmap(dpy, texture->pixmap);
+		texture->pixmap = None;
+	}
+	if (texture->rendered) {
+		cacheUsed -= texture->size;
+		texture->rendered = False;
 	}
+}
+
+static void freeTexture(BackgroundTexture * texture)
+{
+	releaseTextureData(texture);
 	wfree(texture->spec);
 	wfree(texture);
 }
 
+/*
+ * Render a texture that was only recorded by setupTexture(). Returns
+ * False if the texture cannot be rendered.
+ */
+static Bool renderTexture(RContext * rc, BackgroundTexture * texture)
+{
+	BackgroundTexture *tmp;
+	int depth, bpp;
+
+	if (texture->rendered)
+		return True;
+	if (texture->invalid)
+		return False;
+
+	tmp = parseTexture(rc, texture->spec);
+	if (!tmp) {
+		texture->invalid = True;
+		return False;
+	}
+
+	texture->solid = tmp->solid;
+	texture->color = tmp->color;
+	texture->pixmap = tmp->pixmap;
+	texture->width = tmp->width;
+	texture->height = tmp->height;
+	wfree(tmp->spec);
+	wfree(tmp);
+
+	depth = DefaultDepth(dpy, scr);
+	bpp = (depth > 16) ? 4 : (depth > 8) ? 2 : 1;
+	texture->size = (unsigned long)texture->width * texture->height * bpp;
+	texture->rendered = True;
+	cacheUsed += texture->size;
+
+	return True;
+}
+
+/*
+ * Free the rendering of the least recently used textures until the
+ * cache fits in its budget again. The texture being shown is kept.
+ */
+static void trimTextureCache(BackgroundTexture ** textures, BackgroundTexture * keep)
+{
+	while (cacheUsed > cacheBudget) {
+		BackgroundTexture *oldest = NULL;
+		int i;
+
+		for (i = 0; i < WORKSPACE_COUNT; i++) {
+			if (textures[i] && textures[i] != keep && textures[i]->rendered
+			    && (!oldest || textures[i]->lastUse < oldest->lastUse))
+				oldest = textures[i];
+		}
+		if (!oldest)
+			break;
+
+#ifdef DEBUG
+		printf("evict texture %s\n", oldest->spec);
+#endif
+		releaseTextureData(oldest);
+	}
+}
+
 static void setupTexture(RContext * rc, BackgroundTexture ** textures, int *maxTextures, int workspace, char *texture)
 {
 	BackgroundTexture *newTexture = NULL;
 	int i;
 
+	/* Argument is not used anymore, rendering is done on first use */
+	(void) rc;
+
 	/* unset the texture */
 	if (!texture) {
 		if (textures[workspace] != NULL) {
@@ -738,8 +829,8 @@ static void setupTexture(RContext * rc, BackgroundTexture ** textures, int *maxT
 		return;
 	}
 
-	/* check if the same texture is already created */
-	for (i = 0; i < *maxTextures; i++) {
+	/* check if the same texture is already known */
+	for (i = 0; i <= *maxTextures; i++) {
 		if (textures[i] && strcasecmp(textures[i]->spec, texture) == 0) {
 			newTexture = textures[i];
 			break;
@@ -747,11 +838,10 @@ static void setupTexture(RContext * rc, BackgroundTexture ** textures, int *maxT
 	}
 
 	if (!newTexture) {
-		/* create the texture */
-		newTexture = parseTexture(rc, texture);
+		/* only remember it, it will be rendered when needed */
+		newTexture = wmalloc(sizeof(BackgroundTexture));
+		newTexture->spec = wstrdup(texture);
 	}
-	if (!newTexture)
-		return;
 
 	if (textures[workspace] != NULL) {
 
@@ -768,6 +858,36 @@ static void setupTexture(RContext * rc, BackgroundTexture ** textures, int *maxT
 		*maxTextures = workspace;
 }
 
+/*
+ * Find the texture to show for the workspace, rendering it if needed.
+ * Falls back to the default texture (workspace 0) if the workspace has
+ * none or if it cannot be rendered.
+ */
+static BackgroundTexture *getTexture(RContext * rc, BackgroundTexture ** textures, int workspace)
+{
+	BackgroundTexture *texture = textures[workspace];
+
+	if (!texture || !renderTexture(rc, texture)) {
+		texture = textures[0];
+		if (!texture || !renderTexture(rc, texture))
+			return NULL;
+	}
+	texture->lastUse = ++cacheClock;
+
+	return texture;
+}
+
+static Bool inputPending(int fd)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	return poll(&pfd, 1, 0) > 0;
+}
+
 static Pixmap duplicatePixmap(Pixmap pixmap, int width, int height)
 {
 	Display *tmpDpy;
@@ -892,9 +1012,11 @@ static int readmsg(int fd, char *buffer, int size)
 static noreturn void helperLoop(RContext * rc)
 {
 	BackgroundTexture *textures[WORKSPACE_COUNT];
+	BackgroundTexture *current = NULL;
 	int maxTextures = 0;
+	int prerender[2], prerenderCount = 0;
 	char buffer[2048], buf[8];
-	int size;
+	int size, i;
 	int errcount = 4;
 
 	memset(textures, 0, WORKSPACE_COUNT * sizeof(BackgroundTexture *));
@@ -902,6 +1024,25 @@ static noreturn void helperLoop(RContext * rc)
 	while (1) {
 		int workspace = -1;
 
+		/*
+		 * While Window Maker has nothing to say, render the backgrounds
+		 * of the workspaces next to the current one, as long as there
+		 * is room for them in the cache.
+		 */
+		while (prerenderCount > 0 && !inputPending(0)) {
+			BackgroundTexture *texture = textures[prerender[--prerenderCount]];
+
+			if (texture && !texture->rendered && !texture->invalid && cacheUsed < cacheBudget) {
+#ifdef DEBUG
+				printf("prerender texture %s\n", texture->spec);
+#endif
+				if (renderTexture(rc, texture)) {
+					texture->lastUse = cacheClock;
+					trimTextureCache(textures, current);
+				}
+			}
+		}
+
 		/* get length of message */
 		if (readmsg(0, buffer, 4) < 0) {
 			werror("error reading message from Window Maker");
@@ -952,6 +1093,8 @@ static noreturn void helperLoop(RContext * rc)
 #ifdef DEBUG
 			printf("set texture %s\n", &buffer[5]);
 #endif
+			if (textures[workspace] == current && current && current->refcount == 1)
+				current = NULL;
 			setupTexture(rc, textures, &maxTextures, workspace, &buffer[5]);
 			break;
 
@@ -959,11 +1102,15 @@ static noreturn void helperLoop(RContext * rc)
 #ifdef DEBUG
 			printf("change texture %i\n", workspace);
 #endif
-			if (!textures[workspace]) {
-				changeTexture(textures[0]);
-			} else {
-				changeTexture(textures[workspace]);
-			}
+			current = getTexture(rc, textures, workspace);
+			trimTextureCache(textures, current);
+			changeTexture(current);
+
+			prerenderCount = 0;
+			if (workspace + 1 <= maxTextures)
+				prerender[prerenderCount++] = workspace + 1;
+			if (workspace - 1 > 0)
+				prerender[prerenderCount++] = workspace - 1;
 			break;
 
 		case 'P':
@@ -973,12 +1120,20 @@ static noreturn void helperLoop(RContext * rc)
 			if (PixmapPath)
 				wfree(PixmapPath);
 			PixmapPath = wstrdup(&buffer[1]);
+
+			/* images that were not found may be in the new path */
+			for (i = 0; i < WORKSPACE_COUNT; i++) {
+				if (textures[i])
+					textures[i]->invalid = False;
+			}
 			break;
 
 		case 'U':
 #ifdef DEBUG
 			printf("unset workspace %i\n", workspace);
 #endif
+			if (textures[workspace] == current && current && current->refcount == 1)
+				current = NULL;
 			setupTexture(rc, textures, &maxTextures, workspace, NULL);
 			break;
 
@@ -1395,8 +1550,21 @@ int main(int argc, char **argv)
 	}
 
 	if (helperMode) {
+		WMPropList *val;
 		int result;
 
+		val = getValueForKey(domain, "WorkspaceBackCacheSize");
+		if (val && WMIsPLString(val)) {
+			int megabytes;
+
+			if (sscanf(WMGetFromPLString(val), "%i", &megabytes) == 1 && megabytes >= 0)
+				cacheBudget = (unsigned long)megabytes * 1024 * 1024;
+			else
+				wwarning("bad value for WorkspaceBackCacheSize: \"%s\"", WMGetFromPLString(val));
+		}
+		if (val)
+			WMReleasePropList(val);
+
 		/* lower priority, so that it wont use all the CPU */
 		result = nice(15);
 		if (result == -1)
@@ -96,19 +96,10 @@ RImage *RRenderGradient(unsigned width, unsigned height, const RColor *from, con
  * 	None
  *----------------------------------------------------------------------
  */
-static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0, int b0, int rf, int gf, int bf)
+static void renderHLine(unsigned char *ptr, unsigned width, int r0, int g0, int b0, int rf, int gf, int bf)
 {
 	int i;
 	long r, g, b, dr, dg, db;
-	unsigned lineSize = width * 3;
-	RImage *image;
-	unsigned char *ptr;
-
-	image = RCreateImage(width, height, False);
-	if (!image) {
-		return NULL;
-	}
-	ptr = image->data;
 
 	r = r0 << 16;
 	g = g0 << 16;
@@ -117,7 +108,7 @@ static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0,
 	dr = ((rf - r0) << 16) / (int)width;
 	dg = ((gf - g0) << 16) / (int)width;
 	db = ((bf - b0) << 16) / (int)width;
-	/* render the first line */
+
 	for (i = 0; i < width; i++) {
 		*(ptr++) = (unsigned char)(r >> 16);
 		*(ptr++) = (unsigned char)(g >> 16);
@@ -126,6 +117,21 @@ static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0,
 		g += dg;
 		b += db;
 	}
+}
+
+static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0, int b0, int rf, int gf, int bf)
+{
+	int i;
+	unsigned lineSize = width * 3;
+	RImage *image;
+
+	image = RCreateImage(width, height, False);
+	if (!image) {
+		return NULL;
+	}
+
+	/* render the first line */
+	renderHLine(image->data, width, r0, g0, b0, rf, gf, bf);
 
 	/* copy the first line to the other lines */
 	for (i = 1; i < height; i++) {
@@ -134,42 +140,27 @@ static RImage *renderHGradient(unsigned width, unsigned height, int r0, int g0,
 	return image;
 }
 
+/*
+ * Fills a line of the given width with one color: the first pixel is
+ * written and then copied over, doubling the filled part each time, so
+ * wide lines cost a few memcpy() calls instead of a store per byte
+ */
 static inline unsigned char *renderGradientWidth(unsigned char *ptr, unsigned width, unsigned char r, unsigned char g, unsigned char b)
 {
-	int i;
+	unsigned lineSize = width * 3;
+	unsigned done;
 
-	for (i = width / 4; i--;) {
-		*ptr++ = r;
-		*ptr++ = g;
-		*ptr++ = b;
+	if (width == 0)
+		return ptr;
 
-		*ptr++ = r;
-		*ptr++ = g;
-		*ptr++ = b;
+	ptr[0] = r;
+	ptr[1] = g;
+	ptr[2] = b;
 
-		*ptr++ = r;
-		*ptr++ = g;
-		*ptr++ = b;
+	for (done = 3; done < lineSize; done *= 2)
+		memcpy(ptr + done, ptr, (done < lineSize - done) ? done : lineSize - done);
 
-		*ptr++ = r;
-		*ptr++ = g;
-		*ptr++ = b;
-	}
-	switch (width % 4) {
-	case 3:
-		*ptr++ = r;
-		*ptr++ = g;
-		*ptr++ = b;
-	case 2:
-		*ptr++ = r;
-		*ptr++ = g;
-		*ptr++ = b;
-	case 1:
-		*ptr++ = r;
-		*ptr++ = g;
-		*ptr++ = b;
-	}
-	return ptr;
+	return ptr + lineSize;
 }
 
 /*
@@ -189,6 +180,7 @@ static RImage *renderVGradient(unsigned width, unsigned height, int r0, int g0,
 {
 	int i;
 	long r, g, b, dr, dg, db;
+	unsigned lineSize = width * 3;
 	RImage *image;
 	unsigned char *ptr;
 
@@ -207,7 +199,16 @@ static RImage *renderVGradient(unsigned width, unsigned height, int r0, int g0,
 	db = ((bf - b0) << 16) / (int)height;
 
 	for (i = 0; i < height; i++) {
-		ptr = renderGradientWidth(ptr, width, r >> 16, g >> 16, b >> 16);
+		/* tall gradients repeat colors on consecutive lines, which
+		 * are then copied from the previous (uniform) line */
+		if (i > 0 && ptr[-3] == (unsigned char)(r >> 16)
+		    && ptr[-2] == (unsigned char)(g >> 16)
+		    && ptr[-1] == (unsigned char)(b >> 16)) {
+			memcpy(ptr, ptr - lineSize, lineSize);
+			ptr += lineSize;
+		} else {
+			ptr = renderGradientWidth(ptr, width, r >> 16, g >> 16, b >> 16);
+		}
 		r += dr;
 		g += dg;
 		b += db;
@@ -215,6 +216,28 @@ static RImage *renderVGradient(unsigned width, unsigned height, int r0, int g0,
 	return image;
 }
 
+/*
+ * Fills the lines of a diagonal gradient: each one is the part of a
+ * horizontal gradient twice as wide (less one pixel) that starts at an
+ * offset growing with the line number, so all of them are copied from
+ * that single rendered line.
+ */
+static void renderDiagonalLines(RImage *image, const unsigned char *line)
+{
+	unsigned lineSize = image->width * 3;
+	unsigned char *ptr = image->data;
+	float a, offset;
+	int j;
+
+	a = ((float)(image->width - 1)) / ((float)(image->height - 1));
+
+	for (j = 0, offset = 0.0; j < image->height; j++) {
+		memcpy(ptr, &line[3 * (int)offset], lineSize);
+		ptr += lineSize;
+		offset += a;
+	}
+}
+
 /*
  *----------------------------------------------------------------------
  * renderDGradient--
@@ -231,59 +254,39 @@ static RImage *renderVGradient(unsigned width, unsigned height, int r0, int g0,
 
 static RImage *renderDGradient(unsigned width, unsigned height, int r0, int g0, int b0, int rf, int gf, int bf)
 {
-	RImage *image, *tmp;
-	int j;
-	float a, offset;
-	unsigned char *ptr;
+	RImage *image;
+	unsigned char *line;
 
 	if (width == 1)
 		return renderVGradient(width, height, r0, g0, b0, rf, gf, bf);
 	else if (height == 1)
 		return renderHGradient(width, height, r0, g0, b0, rf, gf, bf);
 
-	image = RCreateImage(width, height, False);
-	if (!image) {
+	line = malloc((2 * width - 1) * 3);
+	if (!line) {
+		RErrorCode = RERR_NOMEMORY;
 		return NULL;
 	}
 
-	tmp = renderHGradient(2 * width - 1, 1, r0, g0, b0, rf, gf, bf);
-	if (!tmp) {
-		RReleaseImage(image);
+	image = RCreateImage(width, height, False);
+	if (!image) {
+		free(line);
 		return NULL;
 	}
 
-	ptr = tmp->data;
-
-	a = ((float)(width - 1)) / ((float)(height - 1));
-	width = width * 3;
+	renderHLine(line, 2 * width - 1, r0, g0, b0, rf, gf, bf);
+	renderDiagonalLines(image, line);
 
-	/* copy the first line to the other lines with corresponding offset */
-	for (j = 0, offset = 0.0; j < width * height; j += width) {
-		memcpy(&(image->data[j]), &ptr[3 * (int)offset], width);
-		offset += a;
-	}
-
-	RReleaseImage(tmp);
+	free(line);
 	return image;
 }
 
-static RImage *renderMHGradient(unsigned width, unsigned height, RColor ** colors, int count)
+static void renderMHLine(unsigned char *ptr, unsigned width, RColor ** colors, int count)
 {
 	int i, j, k;
 	long r, g, b, dr, dg, db;
-	unsigned lineSize = width * 3;
-	RImage *image;
-	unsigned char *ptr;
 	unsigned width2;
 
-	assert(count > 2);
-
-	image = RCreateImage(width, height, False);
-	if (!image) {
-		return NULL;
-	}
-	ptr = image->data;
-
 	if (count > width)
 		count = width;
 
@@ -298,7 +301,6 @@ static RImage *renderMHGradient(unsigned width, unsigned height, RColor ** color
 	g = colors[0]->green << 16;
 	b = colors[0]->blue << 16;
 
-	/* render the first line */
 	for (i = 1; i < count; i++) {
 		dr = ((int)(colors[i]->red - colors[i - 1]->red) << 16) / (int)width2;
 		dg = ((int)(colors[i]->green - colors[i - 1]->green) << 16) / (int)width2;
@@ -321,6 +323,23 @@ static RImage *renderMHGradient(unsigned width, unsigned height, RColor ** color
 		*ptr++ = (unsigned char)(g >> 16);
 		*ptr++ = (unsigned char)(b >> 16);
 	}
+}
+
+static RImage *renderMHGradient(unsigned width, unsigned height, RColor ** colors, int count)
+{
+	int i;
+	unsigned lineSize = width * 3;
+	RImage *image;
+
+	assert(count > 2);
+
+	image = RCreateImage(width, height, False);
+	if (!image) {
+		return NULL;
+	}
+
+	/* render the first line */
+	renderMHLine(image->data, width, colors, count);
 
 	/* copy the first line to the other lines */
 	for (i = 1; i < height; i++) {
@@ -391,10 +410,8 @@ static RImage *renderMVGradient(unsigned width, unsigned height, RColor ** color
 
 static RImage *renderMDGradient(unsigned width, unsigned height, RColor ** colors, int count)
 {
-	RImage *image, *tmp;
-	float a, offset;
-	int j;
-	unsigned char *ptr;
+	RImage *image;
+	unsigned char *line;
 
 	assert(count > 2);
 
@@ -403,8 +420,15 @@ static RImage *renderMDGradient(unsigned width, unsigned height, RColor ** color
 	else if (height == 1)
 		return renderMHGradient(width, height, colors, count);
 
+	line = malloc((2 * width - 1) * 3);
+	if (!line) {
+		RErrorCode = RERR_NOMEMORY;
+		return NULL;
+	}
+
 	image = RCreateImage(width, height, False);
 	if (!image) {
+		free(line);
 		return NULL;
 	}
 
@@ -414,27 +438,15 @@ static RImage *renderMDGradient(unsigned width, unsigned height, RColor ** color
 		count = height;
 
 	if (count > 2)
-		tmp = renderMHGradient(2 * width - 1, 1, colors, count);
+		renderMHLine(line, 2 * width - 1, colors, count);
 	else
-		tmp = renderHGradient(2 * width - 1, 1, colors[0]->red << 8,
-				      colors[0]->green << 8, colors[0]->blue << 8,
-				      colors[1]->red << 8, colors[1]->green << 8, colors[1]->blue << 8);
-
-	if (!tmp) {
-		RReleaseImage(image);
-		return NULL;
-	}
-	ptr = tmp->data;
+		renderHLine(line, 2 * width - 1, colors[0]->red << 8,
+			    colors[0]->green << 8, colors[0]->blue << 8,
+			    colors[1]->red << 8, colors[1]->green << 8, colors[1]->blue << 8);
 
-	a = ((float)(width - 1)) / ((float)(height - 1));
-	width = width * 3;
+	renderDiagonalLines(image, line);
 
-	/* copy the first line to the other lines with corresponding offset */
-	for (j = 0, offset = 0; j < width * height; j += width) {
-		memcpy(&(image->data[j]), &ptr[3 * (int)offset], width);
-		offset += a;
-	}
-	RReleaseImage(tmp);
+	free(line);
 	return image;
 }
 
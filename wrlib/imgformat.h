@@ -48,21 +48,32 @@ typedef enum {
 
 /*
  * Function for Loading in a specific format
+ *
+ * Loaders taking a max_width x max_height box may return an image smaller
+ * than the file's, down to the size it has once scaled to fit in the box
+ * (see wraster_fit_size); a box of 0 x 0 means full size
  */
+Bool wraster_fit_size(unsigned width, unsigned height, unsigned max_width, unsigned max_height,
+                      unsigned *fit_width, unsigned *fit_height);
+
+double wraster_display_gamma(RContext *context);
+
 RImage *RLoadPPM(const char *file);
 
 RImage *RLoadXPM(RContext *context, const char *file);
 
+RImage *RLoadNativeXPM(const char *file);
+
 #ifdef USE_TIFF
 RImage *RLoadTIFF(const char *file, int index);
 #endif
 
 #ifdef USE_PNG
-RImage *RLoadPNG(RContext *context, const char *file);
+RImage *RLoadPNG(RContext *context, const char *file, unsigned max_width, unsigned max_height);
 #endif
 
 #ifdef USE_JPEG
-RImage *RLoadJPEG(const char *file);
+RImage *RLoadJPEG(const char *file, unsigned max_width, unsigned max_height);
 #endif
 
 #ifdef USE_GIF
@@ -70,7 +81,7 @@ RImage *RLoadGIF(const char *file, int index);
 #endif
 
 #ifdef USE_WEBP
-RImage *RLoadWEBP(const char *file);
+RImage *RLoadWEBP(const char *file, unsigned max_width, unsigned max_height);
 #endif
 
 #ifdef USE_MAGICK
@@ -36,11 +36,14 @@
 
 #include "wraster.h"
 #include "imgformat.h"
+#include "shared_cache.h"
 
 
 typedef struct RCachedImage {
 	RImage *image;
 	char *file;
+	unsigned max_width;	/* size the image was loaded for */
+	unsigned max_height;
 	time_t last_modif;	/* last time file was modified */
 	time_t last_use;	/* last time image was used */
 } RCachedImage;
@@ -150,35 +153,71 @@ void RReleaseCache(void)
 	}
 }
 
-RImage *RLoadImage(RContext *context, const char *file, int index)
+/*
+ * Computes the size of a width x height image scaled down to keep its
+ * aspect and fit in max_width x max_height. Loaders given such a box can
+ * decode the image at any size that is not smaller than that. Returns
+ * False when there is no box or the image already fits in it.
+ */
+Bool wraster_fit_size(unsigned width, unsigned height, unsigned max_width, unsigned max_height,
+                      unsigned *fit_width, unsigned *fit_height)
 {
-	RImage *image = NULL;
-	int i;
-	struct stat st;
+	unsigned long long w = width, h = height;
 
-	assert(file != NULL);
+	if (max_width == 0 || max_height == 0 || width == 0 || height == 0)
+		return False;
 
-	if (RImageCacheSize < 0)
-		init_cache();
+	if (width <= max_width && height <= max_height)
+		return False;
 
-	if (RImageCacheSize > 0) {
+	if (w * max_height >= h * max_width) {
+		*fit_width = max_width;
+		*fit_height = (h * max_width + w - 1) / w;
+	} else {
+		*fit_width = (w * max_height + h - 1) / h;
+		*fit_height = max_height;
+	}
 
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (RImageCache[i].file && strcmp(file, RImageCache[i].file) == 0) {
+	if (*fit_width < 1)
+		*fit_width = 1;
+	if (*fit_height < 1)
+		*fit_height = 1;
 
-				if (stat(file, &st) == 0 && st.st_mtime == RImageCache[i].last_modif) {
-					RImageCache[i].last_use = time(NULL);
+	return True;
+}
 
-					return RCloneImage(RImageCache[i].image);
+/*
+ * Returns the gamma of the display that loaders correct images for,
+ * which depends on the context and the environment
+ */
+double wraster_display_gamma(RContext *context)
+{
+	char *tmp;
+	double gamma;
 
-				} else {
-					free(RImageCache[i].file);
-					RImageCache[i].file = NULL;
-					RReleaseImage(RImageCache[i].image);
-				}
-			}
-		}
-	}
+	if ((context->attribs->flags & RC_GammaCorrection) && context->depth != 8)
+		return (context->attribs->rgamma + context->attribs->ggamma + context->attribs->bgamma) / 3;
+
+	tmp = getenv("DISPLAY_GAMMA");
+	if (!tmp)
+		return 2.2;
+
+	gamma = atof(tmp);
+	if (gamma < 1.0E-3)
+		gamma = 1;
+
+	return gamma;
+}
+
+RImage *RLoadImage(RContext *context, const char *file, int index)
+{
+	return RLoadImageForSize(context, file, index, 0, 0);
+}
+
+static RImage *load_image_file(RContext *context, const char *file, int index,
+                               unsigned max_width, unsigned max_height)
+{
+	RImage *image = NULL;
 
 	switch (identFile(file)) {
 	case IM_ERROR:
@@ -208,13 +247,13 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 
 #ifdef USE_PNG
 	case IM_PNG:
-		image = RLoadPNG(context, file);
+		image = RLoadPNG(context, file, max_width, max_height);
 		break;
 #endif				/* USE_PNG */
 
 #ifdef USE_JPEG
 	case IM_JPEG:
-		image = RLoadJPEG(file);
+		image = RLoadJPEG(file, max_width, max_height);
 		break;
 #endif				/* USE_JPEG */
 
@@ -226,7 +265,7 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 
 #ifdef USE_WEBP
 	case IM_WEBP:
-		image = RLoadWEBP(file);
+		image = RLoadWEBP(file, max_width, max_height);
 		break;
 #endif				/* USE_WEBP */
 
@@ -239,8 +278,59 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 		return NULL;
 	}
 
+	return image;
+}
+
+RImage *RLoadImageForSize(RContext *context, const char *file, int index,
+                          unsigned max_width, unsigned max_height)
+{
+	RImage *image = NULL;
+	int i;
+	struct stat st;
+	Bool have_stat;
+
+	assert(file != NULL);
+
+	if (RImageCacheSize < 0)
+		init_cache();
+
+	/* the caches need to know whether the file changed */
+	have_stat = (stat(file, &st) == 0);
+
+	if (RImageCacheSize > 0 && have_stat) {
+
+		for (i = 0; i < RImageCacheSize; i++) {
+			if (RImageCache[i].file && strcmp(file, RImageCache[i].file) == 0
+			    && RImageCache[i].max_width == max_width && RImageCache[i].max_height == max_height) {
+
+				if (st.st_mtime == RImageCache[i].last_modif) {
+					RImageCache[i].last_use = time(NULL);
+
+					return RCloneImage(RImageCache[i].image);
+
+				} else {
+					free(RImageCache[i].file);
+					RImageCache[i].file = NULL;
+					RReleaseImage(RImageCache[i].image);
+				}
+			}
+		}
+	}
+
+	/* other processes may correct the images for another display */
+	if (have_stat)
+		image = r_shared_cache_load(file, &st, index, max_width, max_height,
+		                            wraster_display_gamma(context));
+
+	if (!image) {
+		image = load_image_file(context, file, index, max_width, max_height);
+		if (image && have_stat)
+			r_shared_cache_store(file, &st, index, max_width, max_height,
+			                     wraster_display_gamma(context), image);
+	}
+
 	/* store image in cache */
-	if (RImageCacheSize > 0 && image &&
+	if (RImageCacheSize > 0 && image && have_stat &&
 	    (RImageCacheMaxImage == 0 || RImageCacheMaxImage >= image->width * image->height)) {
 		time_t oldest = time(NULL);
 		int oldest_idx = 0;
@@ -251,6 +341,8 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 				RImageCache[i].file = malloc(strlen(file) + 1);
 				strcpy(RImageCache[i].file, file);
 				RImageCache[i].image = RCloneImage(image);
+				RImageCache[i].max_width = max_width;
+				RImageCache[i].max_height = max_height;
 				RImageCache[i].last_modif = st.st_mtime;
 				RImageCache[i].last_use = time(NULL);
 				done = 1;
@@ -270,6 +362,8 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 			RImageCache[oldest_idx].file = malloc(strlen(file) + 1);
 			strcpy(RImageCache[oldest_idx].file, file);
 			RImageCache[oldest_idx].image = RCloneImage(image);
+			RImageCache[oldest_idx].max_width = max_width;
+			RImageCache[oldest_idx].max_height = max_height;
 			RImageCache[oldest_idx].last_modif = st.st_mtime;
 			RImageCache[oldest_idx].last_use = time(NULL);
 		}
@@ -93,7 +93,27 @@ static noreturn void my_error_exit(j_common_ptr cinfo)
 	longjmp(myerr->setjmp_buffer, 1);
 }
 
-RImage *RLoadJPEG(const char *file_name)
+/*
+ * Picks the largest DCT scaling that keeps the image at least as large
+ * as the fitted size: decoding at 1/2, 1/4 or 1/8 skips most of the work
+ * for pictures that are about to be shrunk anyway
+ */
+static unsigned get_scale_denom(unsigned width, unsigned height, unsigned max_width, unsigned max_height)
+{
+	unsigned fit_width, fit_height, denom;
+
+	if (!wraster_fit_size(width, height, max_width, max_height, &fit_width, &fit_height))
+		return 1;
+
+	for (denom = 8; denom > 1; denom /= 2) {
+		if ((width + denom - 1) / denom >= fit_width && (height + denom - 1) / denom >= fit_height)
+			break;
+	}
+
+	return denom;
+}
+
+RImage *RLoadJPEG(const char *file_name, unsigned max_width, unsigned max_height)
 {
 	RImage *image = NULL;
 	struct jpeg_decompress_struct cinfo;
@@ -113,6 +133,8 @@ RImage *RLoadJPEG(const char *file_name)
 		return NULL;
 	}
 
+	buffer[0] = NULL;	/* Initialize pointer to avoid spurious free in cleanup code */
+
 	cinfo.err = jpeg_std_error(&jerr.pub);
 	jerr.pub.error_exit = my_error_exit;
 	/* Establish the setjmp return context for my_error_exit to use. */
@@ -132,18 +154,10 @@ RImage *RLoadJPEG(const char *file_name)
 	jpeg_read_header(&cinfo, TRUE);
 
 	if (cinfo.image_width < 1 || cinfo.image_height < 1) {
-		buffer[0] = NULL;	/* Initialize pointer to avoid spurious free in cleanup code */
 		RErrorCode = RERR_BADIMAGEFILE;
 		goto bye;
 	}
 
-	buffer[0] = (JSAMPROW) malloc(cinfo.image_width * cinfo.num_components);
-
-	if (!buffer[0]) {
-		RErrorCode = RERR_NOMEMORY;
-		goto bye;
-	}
-
 	if (cinfo.jpeg_color_space == JCS_GRAYSCALE) {
 		cinfo.out_color_space = JCS_GRAYSCALE;
 	} else
@@ -151,9 +165,18 @@ RImage *RLoadJPEG(const char *file_name)
 	cinfo.quantize_colors = FALSE;
 	cinfo.do_fancy_upsampling = FALSE;
 	cinfo.do_block_smoothing = FALSE;
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = get_scale_denom(cinfo.image_width, cinfo.image_height, max_width, max_height);
 	jpeg_calc_output_dimensions(&cinfo);
 
-	image = RCreateImage(cinfo.image_width, cinfo.image_height, False);
+	buffer[0] = (JSAMPROW) malloc(cinfo.output_width * cinfo.output_components);
+
+	if (!buffer[0]) {
+		RErrorCode = RERR_NOMEMORY;
+		goto bye;
+	}
+
+	image = RCreateImage(cinfo.output_width, cinfo.output_height, False);
 
 	if (!image) {
 		RErrorCode = RERR_NOMEMORY;
@@ -167,14 +190,14 @@ RImage *RLoadJPEG(const char *file_name)
 		while (cinfo.output_scanline < cinfo.output_height) {
 			jpeg_read_scanlines(&cinfo, buffer, (JDIMENSION) 1);
 			bptr = buffer[0];
-			memcpy(ptr, bptr, cinfo.image_width * 3);
-			ptr += cinfo.image_width * 3;
+			memcpy(ptr, bptr, cinfo.output_width * 3);
+			ptr += cinfo.output_width * 3;
 		}
 	} else {
 		while (cinfo.output_scanline < cinfo.output_height) {
 			jpeg_read_scanlines(&cinfo, buffer, (JDIMENSION) 1);
 			bptr = buffer[0];
-			for (i = 0; i < cinfo.image_width; i++) {
+			for (i = 0; i < cinfo.output_width; i++) {
 				*ptr++ = *bptr;
 				*ptr++ = *bptr;
 				*ptr++ = *bptr++;
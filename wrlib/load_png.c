@@ -31,9 +31,85 @@
 #include "wraster.h"
 #include "imgformat.h"
 
-RImage *RLoadPNG(RContext *context, const char *file)
+/*
+ * Images that are going to be scaled down are shrunk by an integer factor
+ * while they are read, one row at a time, so neither the full size image
+ * nor its rows are ever held in memory. Each pixel of the result is the
+ * average of a factor x factor block; with alpha, colors are weighted by
+ * their opacity so transparent pixels do not bleed into their neighbours.
+ */
+static unsigned get_reduce_factor(png_uint_32 width, png_uint_32 height, unsigned max_width, unsigned max_height)
+{
+	unsigned fit_width, fit_height, factor;
+
+	if (!wraster_fit_size(width, height, max_width, max_height, &fit_width, &fit_height))
+		return 1;
+
+	factor = width / fit_width;
+	if (height / fit_height < factor)
+		factor = height / fit_height;
+
+	return (factor < 1) ? 1 : factor;
+}
+
+static void accumulate_row(unsigned long *sums, const unsigned char *row, png_uint_32 width,
+                           unsigned factor, int alpha)
+{
+	png_uint_32 x;
+
+	if (alpha) {
+		for (x = 0; x < width; x++, row += 4) {
+			unsigned long *sum = sums + (x / factor) * 4;
+
+			sum[0] += row[0] * row[3];
+			sum[1] += row[1] * row[3];
+			sum[2] += row[2] * row[3];
+			sum[3] += row[3];
+		}
+	} else {
+		for (x = 0; x < width; x++, row += 3) {
+			unsigned long *sum = sums + (x / factor) * 3;
+
+			sum[0] += row[0];
+			sum[1] += row[1];
+			sum[2] += row[2];
+		}
+	}
+}
+
+static void emit_row(unsigned long *sums, unsigned char *ptr, png_uint_32 width, unsigned factor,
+                     unsigned rows, int alpha)
+{
+	png_uint_32 x, columns;
+	unsigned long count;
+
+	for (x = 0; x * factor < width; x++) {
+		columns = (width - x * factor < factor) ? width - x * factor : factor;
+		count = columns * rows;
+
+		if (alpha) {
+			if (sums[3] > 0) {
+				*ptr++ = sums[0] / sums[3];
+				*ptr++ = sums[1] / sums[3];
+				*ptr++ = sums[2] / sums[3];
+			} else {
+				*ptr++ = 0;
+				*ptr++ = 0;
+				*ptr++ = 0;
+			}
+			*ptr++ = sums[3] / count;
+			sums += 4;
+		} else {
+			*ptr++ = sums[0] / count;
+			*ptr++ = sums[1] / count;
+			*ptr++ = sums[2] / count;
+			sums += 3;
+		}
+	}
+}
+
+RImage *RLoadPNG(RContext *context, const char *file, unsigned max_width, unsigned max_height)
 {
-	char *tmp;
 	RImage *image = NULL;
 	FILE *f;
 	png_structp png;
@@ -43,9 +119,13 @@ RImage *RLoadPNG(RContext *context, const char *file)
 	int x, y, i;
 	double gamma, sgamma;
 	png_uint_32 width, height;
-	int depth, junk, color_type;
+	int depth, junk, color_type, interlace;
+	unsigned factor;
 	png_bytep *png_rows;
 	unsigned char *ptr;
+	/* read by the error handler, hence volatile */
+	unsigned char *volatile row = NULL;
+	unsigned long *volatile sums = NULL;
 
 	f = fopen(file, "rb");
 	if (!f) {
@@ -85,6 +165,10 @@ RImage *RLoadPNG(RContext *context, const char *file)
 		png_destroy_read_struct(&png, &pinfo, &einfo);
 		if (image)
 			RReleaseImage(image);
+		if (row)
+			free(row);
+		if (sums)
+			free(sums);
 		return NULL;
 	}
 
@@ -92,7 +176,7 @@ RImage *RLoadPNG(RContext *context, const char *file)
 
 	png_read_info(png, pinfo);
 
-	png_get_IHDR(png, pinfo, &width, &height, &depth, &color_type, &junk, &junk, &junk);
+	png_get_IHDR(png, pinfo, &width, &height, &depth, &color_type, &interlace, &junk, &junk);
 
 	/* sanity check */
 	if (width < 1 || height < 1) {
@@ -108,8 +192,14 @@ RImage *RLoadPNG(RContext *context, const char *file)
 	else
 		alpha = (color_type & PNG_COLOR_MASK_ALPHA);
 
+	/* interlaced images need all their rows before any is complete */
+	if (interlace == PNG_INTERLACE_NONE)
+		factor = get_reduce_factor(width, height, max_width, max_height);
+	else
+		factor = 1;
+
 	/* allocate RImage */
-	image = RCreateImage(width, height, alpha);
+	image = RCreateImage((width + factor - 1) / factor, (height + factor - 1) / factor, alpha);
 	if (!image) {
 		fclose(f);
 		png_destroy_read_struct(&png, &pinfo, &einfo);
@@ -133,17 +223,7 @@ RImage *RLoadPNG(RContext *context, const char *file)
 		png_set_gray_to_rgb(png);
 
 	/* set gamma correction */
-	if ((context->attribs->flags & RC_GammaCorrection)
-	    && context->depth != 8) {
-		sgamma = (context->attribs->rgamma + context->attribs->ggamma + context->attribs->bgamma) / 3;
-	} else if ((tmp = getenv("DISPLAY_GAMMA")) != NULL) {
-		sgamma = atof(tmp);
-		if (sgamma < 1.0E-3)
-			sgamma = 1;
-	} else {
-		/* blah */
-		sgamma = 2.2;
-	}
+	sgamma = wraster_display_gamma(context);
 
 	if (png_get_gAMA(png, pinfo, &gamma))
 		png_set_gamma(png, sgamma, gamma);
@@ -160,6 +240,47 @@ RImage *RLoadPNG(RContext *context, const char *file)
 		image->background.blue = bkcolor->blue >> 8;
 	}
 
+	if (factor > 1) {
+		unsigned channels = alpha ? 4 : 3;
+		size_t sums_size = image->width * channels * sizeof(unsigned long);
+
+		row = malloc(png_get_rowbytes(png, pinfo));
+		sums = calloc(1, sums_size);
+		if (!row || !sums) {
+			RErrorCode = RERR_NOMEMORY;
+			fclose(f);
+			RReleaseImage(image);
+			png_destroy_read_struct(&png, &pinfo, &einfo);
+			if (row)
+				free(row);
+			if (sums)
+				free(sums);
+			return NULL;
+		}
+
+		ptr = image->data;
+		for (y = 0; y < height; y++) {
+			png_read_row(png, row, NULL);
+			accumulate_row(sums, row, width, factor, alpha);
+
+			if ((y + 1) % factor == 0 || y + 1 == height) {
+				emit_row(sums, ptr, width, factor, y % factor + 1, alpha);
+				ptr += image->width * channels;
+				memset(sums, 0, sums_size);
+			}
+		}
+
+		png_read_end(png, einfo);
+
+		png_destroy_read_struct(&png, &pinfo, &einfo);
+
+		fclose(f);
+
+		free(row);
+		free(sums);
+		return image;
+	}
+
 	png_rows = calloc(height, sizeof(png_bytep));
 	if (!png_rows) {
 		RErrorCode = RERR_NOMEMORY;
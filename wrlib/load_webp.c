@@ -32,7 +32,7 @@
 #include "imgformat.h"
 
 
-RImage *RLoadWEBP(const char *file_name)
+RImage *RLoadWEBP(const char *file_name, unsigned max_width, unsigned max_height)
 {
 	FILE *file;
 	RImage *image = NULL;
@@ -40,8 +40,9 @@ RImage *RLoadWEBP(const char *file_name)
 	int raw_data_size;
 	int r;
 	uint8_t *raw_data;
-	WebPBitstreamFeatures features;
-	uint8_t *ret = NULL;
+	WebPDecoderConfig config;
+	unsigned width, height, stride;
+	VP8StatusCode status;
 
 	file = fopen(file_name, "rb");
 	if (!file) {
@@ -96,38 +97,48 @@ RImage *RLoadWEBP(const char *file_name)
 		return NULL;
 	}
 
-	if (WebPGetFeatures(raw_data, raw_data_size, &features) != VP8_STATUS_OK) {
+	if (!WebPInitDecoderConfig(&config)) {
+		RErrorCode = RERR_INTERNAL;
+		free(raw_data);
+		return NULL;
+	}
+
+	if (WebPGetFeatures(raw_data, raw_data_size, &config.input) != VP8_STATUS_OK) {
 		fprintf(stderr, "wrlib: WebPGetFeatures has failed on \"%s\"\n", file_name);
 		RErrorCode = RERR_BADIMAGEFILE;
 		free(raw_data);
 		return NULL;
 	}
 
-	if (features.has_alpha) {
-		image = RCreateImage(features.width, features.height, True);
-		if (!image) {
-			RErrorCode = RERR_NOMEMORY;
-			free(raw_data);
-			return NULL;
-		}
-		ret = WebPDecodeRGBAInto(raw_data, raw_data_size, image->data,
-		                         features.width * features.height * 4,
-		                         features.width * 4);
-	} else {
-		image = RCreateImage(features.width, features.height, False);
-		if (!image) {
-			RErrorCode = RERR_NOMEMORY;
-			free(raw_data);
-			return NULL;
-		}
-		ret = WebPDecodeRGBInto(raw_data, raw_data_size, image->data,
-		                        features.width * features.height * 3,
-		                        features.width * 3);
+	/* let the decoder scale down images that are going to be shrunk anyway */
+	width = config.input.width;
+	height = config.input.height;
+	if (wraster_fit_size(width, height, max_width, max_height, &width, &height)) {
+		config.options.use_scaling = 1;
+		config.options.scaled_width = width;
+		config.options.scaled_height = height;
 	}
 
+	image = RCreateImage(width, height, config.input.has_alpha ? True : False);
+	if (!image) {
+		RErrorCode = RERR_NOMEMORY;
+		free(raw_data);
+		return NULL;
+	}
+
+	stride = width * (config.input.has_alpha ? 4 : 3);
+	config.output.colorspace = config.input.has_alpha ? MODE_RGBA : MODE_RGB;
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = image->data;
+	config.output.u.RGBA.stride = stride;
+	config.output.u.RGBA.size = stride * height;
+
+	status = WebPDecode(raw_data, raw_data_size, &config);
+	WebPFreeDecBuffer(&config.output);
+
 	free(raw_data);
 
-	if (!ret) {
+	if (status != VP8_STATUS_OK) {
 		fprintf(stderr, "wrlib: Failed to decode WEBP from file \"%s\"\n", file_name);
 		RErrorCode = RERR_BADIMAGEFILE;
 		RReleaseImage(image);
@@ -168,6 +168,11 @@ RImage *RLoadXPM(RContext *context, const char *file)
 	XpmImage xpm;
 	int status;
 
+	/* libXpm is only needed for what the built-in reader cannot handle */
+	image = RLoadNativeXPM(file);
+	if (image || RErrorCode != RERR_BADFORMAT)
+		return image;
+
 	status = XpmReadFileToXpmImage((char *)file, &xpm, (XpmInfo *) NULL);
 	if (is_xpm_error(status))
 		return NULL;
@@ -0,0 +1,469 @@
+/* load_xpm_native.c - load XPM image from file without libXpm
+ *
+ * Raster graphics library
+ *
+ * Copyright (c) 2014 Window Maker Team
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <X11/Xlib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wraster.h"
+#include "imgformat.h"
+#include "rgb_names.h"
+
+/*
+ * Reader for XPM 3 files, the format of nearly all the icons around.
+ *
+ * The file is mapped in memory and parsed in place: colors are parsed once
+ * into a table indexed directly by the pixel characters (or hashed, when
+ * there are more than two per pixel), names are looked up in a built-in
+ * copy of the X color database instead of asking the server, and rows are
+ * decoded straight into the image.
+ *
+ * Anything it does not understand (other XPM versions, color specs other
+ * than names and #rgb forms) makes it fail with RERR_BADFORMAT, so the
+ * caller can hand the file to a more complete reader.
+ */
+
+#define XPM_MAX_CPP	31
+
+typedef struct {
+	const char *ptr;
+	const char *end;
+} XPMParser;
+
+typedef struct {
+	const char *key;		/* cpp characters, in the mapped file */
+	unsigned char red, green, blue, alpha;
+} XPMColor;
+
+
+/* skips blanks, separating commas and comments */
+static void skip_space(XPMParser *p)
+{
+	while (p->ptr < p->end) {
+		if (isspace((unsigned char)*p->ptr) || *p->ptr == ',') {
+			p->ptr++;
+		} else if (*p->ptr == '/' && p->ptr + 1 < p->end && p->ptr[1] == '*') {
+			p->ptr += 2;
+			while (p->ptr + 1 < p->end && !(p->ptr[0] == '*' && p->ptr[1] == '/'))
+				p->ptr++;
+			p->ptr += 2;
+		} else {
+			break;
+		}
+	}
+}
+
+/* gets the next string of the array, without its quotes */
+static Bool next_string(XPMParser *p, const char **str, int *len)
+{
+	const char *close;
+
+	skip_space(p);
+	if (p->ptr >= p->end || *p->ptr != '"')
+		return False;
+
+	p->ptr++;
+	close = memchr(p->ptr, '"', p->end - p->ptr);
+	if (!close)
+		return False;
+
+	*str = p->ptr;
+	*len = close - p->ptr;
+	p->ptr = close + 1;
+
+	return True;
+}
+
+static int hex_value(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* #rgb, #rrggbb, #rrrgggbbb or #rrrrggggbbbb, as XParseColor() takes them */
+static Bool parse_hex_color(const char *spec, int len, XPMColor *color)
+{
+	unsigned value[3];
+	int digits, i, j, v;
+
+	if (len % 3 != 0 || len < 3 || len > 12)
+		return False;
+
+	digits = len / 3;
+	for (i = 0; i < 3; i++) {
+		value[i] = 0;
+		for (j = 0; j < digits; j++) {
+			v = hex_value(spec[i * digits + j]);
+			if (v < 0)
+				return False;
+			value[i] = (value[i] << 4) | v;
+		}
+		if (digits == 1)
+			value[i] <<= 4;
+		else
+			value[i] >>= 4 * (digits - 2);
+	}
+
+	color->red = value[0];
+	color->green = value[1];
+	color->blue = value[2];
+	color->alpha = 255;
+
+	return True;
+}
+
+static int compare_rgb_name(const void *name, const void *entry)
+{
+	return strcmp(name, ((const RGBName *)entry)->name);
+}
+
+static Bool lookup_color_name(const char *spec, int len, XPMColor *color)
+{
+	char name[64];
+	const RGBName *found;
+	int i, n;
+
+	/* names are matched ignoring case and spaces, and grey is gray */
+	n = 0;
+	for (i = 0; i < len; i++) {
+		if (isspace((unsigned char)spec[i]))
+			continue;
+		if (n >= (int)sizeof(name) - 1)
+			return False;
+		name[n++] = tolower((unsigned char)spec[i]);
+	}
+	name[n] = 0;
+
+	for (i = 0; i + 4 <= n; i++) {
+		if (strncmp(&name[i], "grey", 4) == 0)
+			name[i + 2] = 'a';
+	}
+
+	found = bsearch(name, rgb_names, sizeof(rgb_names) / sizeof(rgb_names[0]),
+			sizeof(rgb_names[0]), compare_rgb_name);
+	if (!found)
+		return False;
+
+	color->red = found->red;
+	color->green = found->green;
+	color->blue = found->blue;
+	color->alpha = 255;
+
+	return True;
+}
+
+/*
+ * Parses a color definition: the pixel characters followed by pairs of a
+ * visual key (c, g, g4, m or s) and a color, which may have spaces in it.
+ */
+static Bool parse_color(const char *str, int len, int cpp, XPMColor *color)
+{
+	const char *spec[5] = { NULL, NULL, NULL, NULL, NULL };
+	int spec_len[5] = { 0, 0, 0, 0, 0 };
+	const char *word;
+	int i, key, word_len;
+
+	/* in order of preference */
+	enum { KEY_C, KEY_G, KEY_G4, KEY_M, KEY_S };
+
+	color->key = str;
+
+	key = -1;
+	i = cpp;
+	for (;;) {
+		while (i < len && isspace((unsigned char)str[i]))
+			i++;
+		if (i >= len)
+			break;
+
+		word = &str[i];
+		while (i < len && !isspace((unsigned char)str[i]))
+			i++;
+		word_len = &str[i] - word;
+
+		if (word_len == 1 && word[0] == 'c')
+			key = KEY_C;
+		else if (word_len == 1 && word[0] == 'g')
+			key = KEY_G;
+		else if (word_len == 2 && word[0] == 'g' && word[1] == '4')
+			key = KEY_G4;
+		else if (word_len == 1 && word[0] == 'm')
+			key = KEY_M;
+		else if (word_len == 1 && word[0] == 's')
+			key = KEY_S;
+		else if (key < 0)
+			return False;
+		else if (!spec[key]) {
+			spec[key] = word;
+			spec_len[key] = word_len;
+			continue;
+		} else {
+			spec_len[key] = &str[i] - spec[key];
+			continue;
+		}
+
+		spec[key] = NULL;
+	}
+
+	for (key = KEY_C; key <= KEY_S; key++) {
+		if (spec[key])
+			break;
+	}
+
+	if (key > KEY_S) {
+		/* same as the libXpm reader for colors it cannot parse */
+		color->red = color->green = color->blue = 0xbe;
+		color->alpha = 255;
+		return True;
+	}
+
+	if (spec_len[key] == 4 && strncasecmp(spec[key], "None", 4) == 0) {
+		color->red = color->green = color->blue = 0;
+		color->alpha = 0;
+		return True;
+	}
+
+	if (spec[key][0] == '#')
+		return parse_hex_color(spec[key] + 1, spec_len[key] - 1, color);
+
+	if (lookup_color_name(spec[key], spec_len[key], color))
+		return True;
+
+	/* symbolic names need not be colors at all */
+	if (key == KEY_S) {
+		color->red = color->green = color->blue = 0xbe;
+		color->alpha = 255;
+		return True;
+	}
+
+	return False;
+}
+
+static unsigned hash_key(const char *key, int cpp)
+{
+	unsigned hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < cpp; i++)
+		hash = (hash ^ (unsigned char)key[i]) * 16777619U;
+
+	return hash;
+}
+
+static RImage *parse_xpm(const char *data, size_t size)
+{
+	XPMParser parser;
+	XPMColor *colors = NULL;
+	unsigned *index = NULL;
+	unsigned index_mask = 0;
+	RImage *image = NULL;
+	unsigned char *ptr;
+	const char *str, *pixel;
+	char header[128];
+	int len, w, h, ncolors, cpp;
+	int transp;
+	int i, x, y;
+	unsigned c;
+
+	parser.ptr = data;
+	parser.end = data + size;
+
+	while (parser.ptr < parser.end && isspace((unsigned char)*parser.ptr))
+		parser.ptr++;
+	if (parser.end - parser.ptr < 9 || strncmp(parser.ptr, "/* XPM */", 9) != 0) {
+		RErrorCode = RERR_BADFORMAT;
+		return NULL;
+	}
+
+	parser.ptr = memchr(parser.ptr, '{', parser.end - parser.ptr);
+	if (!parser.ptr)
+		goto bad_file;
+	parser.ptr++;
+
+	/* "width height ncolors cpp [x_hot y_hot] [XPMEXT]" */
+	if (!next_string(&parser, &str, &len) || len >= (int)sizeof(header))
+		goto bad_file;
+	memcpy(header, str, len);
+	header[len] = 0;
+	if (sscanf(header, "%d %d %d %d", &w, &h, &ncolors, &cpp) != 4
+	    || w <= 0 || h <= 0 || ncolors <= 0 || cpp <= 0)
+		goto bad_file;
+	if (cpp > XPM_MAX_CPP || w > 0x7fffffff / cpp) {
+		RErrorCode = RERR_BADFORMAT;
+		return NULL;
+	}
+
+	colors = malloc(ncolors * sizeof(XPMColor));
+	if (!colors) {
+		RErrorCode = RERR_NOMEMORY;
+		return NULL;
+	}
+
+	transp = 0;
+	for (i = 0; i < ncolors; i++) {
+		if (!next_string(&parser, &str, &len) || len < cpp)
+			goto bad_file;
+		if (!parse_color(str, len, cpp, &colors[i])) {
+			free(colors);
+			RErrorCode = RERR_BADFORMAT;
+			return NULL;
+		}
+		if (colors[i].alpha == 0)
+			transp = 1;
+	}
+
+	/*
+	 * Pixels of one or two characters index the color table directly,
+	 * longer ones go through a hash table. Unknown pixels get the first
+	 * color, as with the previous readers.
+	 */
+	if (cpp <= 2) {
+		index = calloc(cpp == 1 ? 256 : 65536, sizeof(unsigned));
+		if (!index)
+			goto no_memory;
+		for (i = ncolors - 1; i >= 0; i--) {
+			c = (unsigned char)colors[i].key[0];
+			if (cpp == 2)
+				c |= (unsigned char)colors[i].key[1] << 8;
+			index[c] = i;
+		}
+	} else {
+		index_mask = 15;
+		while (index_mask < 2 * (unsigned)ncolors)
+			index_mask = (index_mask << 1) | 1;
+		index = calloc(index_mask + 1, sizeof(unsigned));
+		if (!index)
+			goto no_memory;
+		/* slots hold the color index + 1, 0 is free */
+		for (i = 0; i < ncolors; i++) {
+			c = hash_key(colors[i].key, cpp) & index_mask;
+			while (index[c] && memcmp(colors[index[c] - 1].key, colors[i].key, cpp) != 0)
+				c = (c + 1) & index_mask;
+			if (!index[c])
+				index[c] = i + 1;
+		}
+	}
+
+	image = RCreateImage(w, h, transp);
+	if (!image)
+		goto no_memory;
+
+	ptr = image->data;
+	for (y = 0; y < h; y++) {
+		if (!next_string(&parser, &str, &len) || len < w * cpp)
+			goto bad_file;
+
+		pixel = str;
+		for (x = 0; x < w; x++, pixel += cpp) {
+			XPMColor *color;
+
+			if (cpp == 1) {
+				color = &colors[index[(unsigned char)pixel[0]]];
+			} else if (cpp == 2) {
+				color = &colors[index[(unsigned char)pixel[0] | (unsigned char)pixel[1] << 8]];
+			} else {
+				c = hash_key(pixel, cpp) & index_mask;
+				while (index[c] && memcmp(colors[index[c] - 1].key, pixel, cpp) != 0)
+					c = (c + 1) & index_mask;
+				color = &colors[index[c] ? index[c] - 1 : 0];
+			}
+
+			*ptr++ = color->red;
+			*ptr++ = color->green;
+			*ptr++ = color->blue;
+			if (transp)
+				*ptr++ = color->alpha;
+		}
+	}
+
+	free(index);
+	free(colors);
+	return image;
+
+ no_memory:
+	RErrorCode = RERR_NOMEMORY;
+	free(index);
+	free(colors);
+	return NULL;
+
+ bad_file:
+	RErrorCode = RERR_BADIMAGEFILE;
+	if (index)
+		free(index);
+	if (colors)
+		free(colors);
+	if (image)
+		RReleaseImage(image);
+	return NULL;
+}
+
+RImage *RLoadNativeXPM(const char *file)
+{
+	RImage *image;
+	struct stat st;
+	void *data;
+	int fd;
+
+	for (;;) {
+		fd = open(file, O_RDONLY);
+		if (fd >= 0)
+			break;
+		if (errno != EINTR) {
+			RErrorCode = RERR_OPEN;
+			return NULL;
+		}
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		RErrorCode = RERR_READ;
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		RErrorCode = RERR_READ;
+		return NULL;
+	}
+
+	image = parse_xpm(data, st.st_size);
+
+	munmap(data, st.st_size);
+
+	return image;
+}
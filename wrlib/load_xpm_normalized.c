@@ -32,7 +32,8 @@
 #include "imgformat.h"
 
 /*
- * Restricted support for XPM images.
+ * Restricted support for XPM images compiled in as data; files are read
+ * by the native XPM reader.
  *
  * The images must be in the following "normalized" format:
  *
@@ -50,9 +51,6 @@
  * - no white spaces allowed at left of each line
  */
 
-#define LINEWIDTH 64
-
-
 static void free_color_symbol_table(unsigned char *color_table[],
 				     unsigned short *symbol_table)
 {
@@ -235,18 +233,7 @@ RImage *RGetImageFromXPMData(RContext * context, char **data)
 
 RImage *RLoadXPM(RContext * context, const char *file)
 {
-	RImage *image = NULL;
-	char line[LINEWIDTH + 1];
-	char *buffer = NULL;
-	unsigned char *color_table[4] = { NULL, NULL, NULL, NULL };
-	unsigned short *symbol_table = NULL;
-	unsigned char *r, *g, *b, *a;
-	int i, j, k;
-	int transp;
-	unsigned short color;
-	int bsize;
-	int w, h, ccount, csize;
-	FILE *f;
+	RImage *image;
 
 	/*
 	 * When using libXpm we need the context argument but the code here does
@@ -254,204 +241,10 @@ RImage *RLoadXPM(RContext * context, const char *file)
 	 */
 	(void) context;
 
-	f = fopen(file, "rb");
-	if (!f) {
-		RErrorCode = RERR_OPEN;
-		return NULL;
-	}
-	/* sig */
-	if (!fgets(line, LINEWIDTH, f))
-		goto bad_file;
-	/* declaration */
-	if (!fgets(line, LINEWIDTH, f))
-		goto bad_file;
-
-	/* data */
-	if (!fgets(line, LINEWIDTH, f))
-		goto bad_file;
-
-	if (line[0] == '/')
-		if (!fgets(line, LINEWIDTH, f))
-			goto bad_file;
-
-	if (sscanf(line, "\"%i %i %i %i\"", &w, &h, &ccount, &csize) != 4
-	    || w <= 0 || h <= 0 || ccount <= 0 || csize <= 0)
-		goto bad_file;
-
-	if (csize != 1 && csize != 2)
-		goto bad_format;
-
-	color_table[0] = malloc(ccount);
-	color_table[1] = malloc(ccount);
-	color_table[2] = malloc(ccount);
-	color_table[3] = malloc(ccount);
-	symbol_table = malloc(ccount * sizeof(unsigned short));
-
-	bsize = csize * w + 16;
-	buffer = malloc(bsize);
-
-	if (!color_table[0] || !color_table[1] || !color_table[2] ||
-	    !color_table[3] || !symbol_table || !bsize || !buffer) {
-		RErrorCode = RERR_NOMEMORY;
-		fclose(f);
-		free_color_symbol_table(color_table, symbol_table);
-		if (buffer)
-			free(buffer);
-		return NULL;
-	}
-
-	transp = 0;
-	/* get color table */
-	for (i = 0; i < ccount; i++) {
-		if (!fgets(line, LINEWIDTH, f))
-			goto bad_file;
-		if (line[0] == '/')
-			if (!fgets(line, LINEWIDTH, f))
-				goto bad_file;
-
-		symbol_table[i] = line[1];
-		if (csize == 2)
-			symbol_table[i] |= line[2] << 8;
-
-		j = csize + 1;
-		while (line[j] != '#' && line[j] != '"' && line[j] != 0 && line[j] != 'N')
-			j++;
-
-		if (line[j] == '#') {
-			unsigned int red, green, blue;
+	/* files are not restricted to the normalized format */
+	image = RLoadNativeXPM(file);
+	if (!image && RErrorCode == RERR_BADFORMAT)
+		RErrorCode = RERR_BADIMAGEFILE;
 
-			k = 0;
-			j++;
-			while (line[j + k] != '"' && line[j + k] != 0)
-				k++;
-			if (k == 6) {
-				if (sscanf(&(line[j]), "%2x%2x%2x", &red, &green, &blue) != 3)
-					goto bad_format;
-			} else if (k == 12) {
-				if (sscanf(&(line[j]), "%4x%4x%4x", &red, &green, &blue) != 3)
-					goto bad_format;
-				red >>= 8;
-				green >>= 8;
-				blue >>= 8;
-			} else
-				goto bad_format;
-
-			color_table[0][i] = red;
-			color_table[1][i] = green;
-			color_table[2][i] = blue;
-			color_table[3][i] = 255;
-		} else if (strncmp(&(line[j]), "None", 4) == 0 || strncmp(&(line[j]), "none", 4) == 0) {
-			color_table[3][i] = 0;
-			transp = 1;
-		} else {
-			goto bad_format;
-		}
-	}
-
-	image = RCreateImage(w, h, transp);
-	if (!image) {
-		fclose(f);
-		free_color_symbol_table(color_table, symbol_table);
-		if (buffer)
-			free(buffer);
-		return NULL;
-	}
-
-	r = image->data;
-	g = image->data + 1;
-	b = image->data + 2;
-	if (image->format == RRGBAFormat)
-		a = image->data + 3;
-	else
-		a = NULL;
-
-	for (i = 0; i < h; i++) {
-		if (!fgets(buffer, bsize, f))
-			goto bad_file;
-		if (buffer[0] == '/')
-			if (!fgets(buffer, bsize, f))
-				goto bad_file;
-
-		if (csize == 1) {
-			for (j = 1; j <= w; j++) {
-				color = buffer[j];
-
-				for (k = 0; k < ccount; k++) {
-					if (symbol_table[k] == color)
-						break;
-				}
-				if (k == ccount)
-					k = 0;
-
-				*r = color_table[0][k];
-				*g = color_table[1][k];
-				*b = color_table[2][k];
-				if (a) {
-					*a = color_table[3][k];
-					r += 4;
-					g += 4;
-					b += 4;
-					a += 4;
-				} else {
-					r += 3;
-					g += 3;
-					b += 3;
-				}
-			}
-		} else {
-			for (j = 1; j <= w * 2; j++) {
-				color = buffer[j++];
-				color |= buffer[j] << 8;
-
-				for (k = 0; k < ccount; k++) {
-					if (symbol_table[k] == color)
-						break;
-				}
-				if (k == ccount) {
-					k = 0;
-				}
-
-				*r = color_table[0][k];
-				*g = color_table[1][k];
-				*b = color_table[2][k];
-				if (a) {
-					*a = color_table[3][k];
-					r += 4;
-					g += 4;
-					b += 4;
-					a += 4;
-				} else {
-					r += 3;
-					g += 3;
-					b += 3;
-				}
-			}
-		}
-	}
-
-	fclose(f);
-	free_color_symbol_table(color_table, symbol_table);
-	if (buffer)
-		free(buffer);
 	return image;
-
- bad_format:
-	RErrorCode = RERR_BADIMAGEFILE;
-	fclose(f);
-	free_color_symbol_table(color_table, symbol_table);
-	if (buffer)
-		free(buffer);
-	if (image)
-		RReleaseImage(image);
-	return NULL;
-
- bad_file:
-	RErrorCode = RERR_BADIMAGEFILE;
-	fclose(f);
-	free_color_symbol_table(color_table, symbol_table);
-	if (buffer)
-		free(buffer);
-	if (image)
-		RReleaseImage(image);
-	return NULL;
 }
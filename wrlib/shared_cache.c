@@ -0,0 +1,476 @@
+/* shared_cache.c - decoded images shared between processes
+ *
+ * Raster graphics library
+ *
+ * Copyright (c) 2014 Window Maker Team
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <X11/Xlib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "wraster.h"
+#include "shared_cache.h"
+
+/*
+ * When RIMAGE_SHARED_CACHE names a directory, decoded images are stored
+ * there, one file per image, for all the programs using the library to
+ * pick up instead of decoding the same files again. With the directory on
+ * a tmpfs, the store lives in shared memory.
+ *
+ * Entries are keyed on the absolute name of the file, its size and
+ * modification time, and on how it was decoded.
+ *
+ * Entries are written under a temporary name and renamed into place, so
+ * readers only ever see complete files, and they are checked against the
+ * whole key when read, so hash collisions, stale or damaged entries are
+ * just misses. When the entries grow over the budget the least recently
+ * used ones are removed. Whatever fails, the image is simply decoded.
+ *
+ * Entries are trusted, so the directory must only be writable by users
+ * whose programs may provide images to each other.
+ */
+
+#define SHARED_CACHE_MAGIC		"WRIMG\002\000\000"
+#define SHARED_CACHE_SUFFIX		".rimg"
+#define SHARED_CACHE_TEMP_PREFIX	"tmp."
+
+#define SHARED_CACHE_DEFAULT_BUDGET	(32 * 1024)	/* kilobytes */
+
+/* temporary files left over for this long belong to a writer that died */
+#define SHARED_CACHE_STALE_TEMP		60
+
+/*
+ * Other processes store entries too, so the directory is also scanned
+ * after this many stores even if those of this process fit in the budget
+ */
+#define SHARED_CACHE_SCAN_INTERVAL	32
+
+/* how long entries of other users are used before we make our own copy */
+#define SHARED_CACHE_REFRESH		600
+
+typedef struct SharedCacheHeader {
+	char magic[8];
+	int64_t mtime;
+	int64_t size;
+	double gamma;			/* of the display the image was corrected for */
+	uint32_t max_width;
+	uint32_t max_height;
+	int32_t index;
+	uint32_t width;
+	uint32_t height;
+	uint32_t alpha;
+	uint32_t path_length;		/* followed by the path, then the pixels */
+	unsigned char background[4];
+} SharedCacheHeader;
+
+typedef struct SharedCacheEntry {
+	char *name;
+	struct timespec last_use;
+	off_t size;
+} SharedCacheEntry;
+
+static struct {
+	int initialized;
+	char *dir;			/* NULL when there is no shared cache */
+	unsigned long budget;		/* in bytes */
+	unsigned long usage;		/* at the last scan, plus the entries stored since */
+	int stores;			/* entries stored since the last scan */
+} shared_cache;
+
+
+static void init_shared_cache(void)
+{
+	struct stat st;
+	char *tmp;
+	int kbytes;
+
+	shared_cache.initialized = 1;
+
+	tmp = getenv("RIMAGE_SHARED_CACHE");
+	if (!tmp || !*tmp)
+		return;
+
+	if (mkdir(tmp, 0700) != 0 && errno != EEXIST)
+		return;
+	if (stat(tmp, &st) != 0 || !S_ISDIR(st.st_mode))
+		return;
+
+	shared_cache.dir = strdup(tmp);
+
+	tmp = getenv("RIMAGE_SHARED_CACHE_SIZE");
+	if (!tmp || sscanf(tmp, "%i", &kbytes) != 1 || kbytes <= 0)
+		kbytes = SHARED_CACHE_DEFAULT_BUDGET;
+	shared_cache.budget = (unsigned long)kbytes * 1024;
+
+	/* the usage is not known until the directory is scanned */
+	shared_cache.stores = SHARED_CACHE_SCAN_INTERVAL;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length)
+{
+	const unsigned char *ptr = data;
+
+	while (length-- > 0)
+		hash = (hash ^ *ptr++) * 1099511628211ULL;
+
+	return hash;
+}
+
+static char *get_entry_path(const char *file, const struct stat *st, int index,
+                            unsigned max_width, unsigned max_height, double gamma)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	int64_t mtime = st->st_mtime, size = st->st_size;
+	char *path;
+
+	hash = hash_bytes(hash, file, strlen(file));
+	hash = hash_bytes(hash, &mtime, sizeof(mtime));
+	hash = hash_bytes(hash, &size, sizeof(size));
+	hash = hash_bytes(hash, &index, sizeof(index));
+	hash = hash_bytes(hash, &max_width, sizeof(max_width));
+	hash = hash_bytes(hash, &max_height, sizeof(max_height));
+	hash = hash_bytes(hash, &gamma, sizeof(gamma));
+
+	path = malloc(strlen(shared_cache.dir) + 1 + 16 + sizeof(SHARED_CACHE_SUFFIX));
+	if (path)
+		sprintf(path, "%s/%016llx" SHARED_CACHE_SUFFIX, shared_cache.dir, (unsigned long long)hash);
+
+	return path;
+}
+
+static Bool read_fully(int fd, void *buffer, size_t length)
+{
+	char *ptr = buffer;
+	ssize_t n;
+
+	while (length > 0) {
+		n = read(fd, ptr, length);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return False;
+		ptr += n;
+		length -= n;
+	}
+
+	return True;
+}
+
+static Bool write_fully(int fd, const void *buffer, size_t length)
+{
+	const char *ptr = buffer;
+	ssize_t n;
+
+	while (length > 0) {
+		n = write(fd, ptr, length);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return False;
+		ptr += n;
+		length -= n;
+	}
+
+	return True;
+}
+
+/* relative names depend on the working directory of the process */
+static char *get_key_file(const char *file)
+{
+	if (file[0] == '/')
+		return strdup(file);
+
+	return realpath(file, NULL);
+}
+
+static RImage *read_entry(int fd, const char *file, const struct stat *st, int index,
+                          unsigned max_width, unsigned max_height, double gamma)
+{
+	SharedCacheHeader header;
+	struct stat entry_st;
+	RImage *image;
+	char *path;
+	size_t path_length, data_size;
+
+	path_length = strlen(file);
+	if (!read_fully(fd, &header, sizeof(header))
+	    || memcmp(header.magic, SHARED_CACHE_MAGIC, sizeof(header.magic)) != 0
+	    || header.mtime != (int64_t)st->st_mtime || header.size != (int64_t)st->st_size
+	    || header.index != index || header.max_width != max_width || header.max_height != max_height
+	    || header.gamma != gamma
+	    || header.path_length != path_length || header.alpha > 1
+	    || header.width == 0 || header.height == 0)
+		return NULL;
+
+	data_size = (size_t)header.width * header.height * (header.alpha ? 4 : 3);
+	if (fstat(fd, &entry_st) != 0 || entry_st.st_size != (off_t)(sizeof(header) + path_length + data_size))
+		return NULL;
+
+	path = malloc(path_length);
+	if (!path || !read_fully(fd, path, path_length) || memcmp(path, file, path_length) != 0) {
+		if (path)
+			free(path);
+		return NULL;
+	}
+	free(path);
+
+	image = RCreateImage(header.width, header.height, header.alpha);
+	if (!image)
+		return NULL;
+
+	if (!read_fully(fd, image->data, data_size)) {
+		RReleaseImage(image);
+		return NULL;
+	}
+	image->background.red = header.background[0];
+	image->background.green = header.background[1];
+	image->background.blue = header.background[2];
+	image->background.alpha = header.background[3];
+
+	return image;
+}
+
+RImage *r_shared_cache_load(const char *file, const struct stat *st, int index,
+                            unsigned max_width, unsigned max_height, double gamma)
+{
+	struct stat entry_st;
+	RImage *image;
+	char *key, *path;
+	Bool refresh = False;
+	int fd;
+
+	if (!shared_cache.initialized)
+		init_shared_cache();
+	if (!shared_cache.dir)
+		return NULL;
+
+	key = get_key_file(file);
+	if (!key)
+		return NULL;
+	path = get_entry_path(key, st, index, max_width, max_height, gamma);
+	fd = path ? open(path, O_RDONLY) : -1;
+	if (path)
+		free(path);
+	if (fd < 0) {
+		free(key);
+		return NULL;
+	}
+
+	image = read_entry(fd, key, st, index, max_width, max_height, gamma);
+
+	/*
+	 * The modification time tells the eviction which entries are in use.
+	 * Only the owner of an entry can set it, so entries of other users
+	 * that were not used for a while are replaced by a copy of our own.
+	 */
+	if (image && futimens(fd, NULL) != 0 && fstat(fd, &entry_st) == 0
+	    && time(NULL) - entry_st.st_mtime > SHARED_CACHE_REFRESH)
+		refresh = True;
+	close(fd);
+	free(key);
+
+	if (refresh)
+		r_shared_cache_store(file, st, index, max_width, max_height, gamma, image);
+
+	return image;
+}
+
+static int compare_last_use(const void *a, const void *b)
+{
+	const SharedCacheEntry *entry_a = a, *entry_b = b;
+
+	if (entry_a->last_use.tv_sec != entry_b->last_use.tv_sec)
+		return (entry_a->last_use.tv_sec < entry_b->last_use.tv_sec) ? -1 : 1;
+	if (entry_a->last_use.tv_nsec != entry_b->last_use.tv_nsec)
+		return (entry_a->last_use.tv_nsec < entry_b->last_use.tv_nsec) ? -1 : 1;
+
+	/* bigger entries first, to remove fewer of them */
+	if (entry_a->size != entry_b->size)
+		return (entry_a->size > entry_b->size) ? -1 : 1;
+	return 0;
+}
+
+/* removes the least recently used entries while they are over the budget */
+static void evict_entries(void)
+{
+	SharedCacheEntry *entries = NULL, *tmp;
+	int count = 0, allocated = 0, i;
+	unsigned long total = 0;
+	struct dirent *dent;
+	struct stat st;
+	time_t now;
+	size_t length;
+	DIR *dir;
+	int dfd;
+
+	dir = opendir(shared_cache.dir);
+	if (!dir)
+		return;
+	dfd = dirfd(dir);
+	now = time(NULL);
+
+	while ((dent = readdir(dir)) != NULL) {
+		if (fstatat(dfd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		if (strncmp(dent->d_name, SHARED_CACHE_TEMP_PREFIX, strlen(SHARED_CACHE_TEMP_PREFIX)) == 0) {
+			if (now - st.st_mtime > SHARED_CACHE_STALE_TEMP)
+				unlinkat(dfd, dent->d_name, 0);
+			continue;
+		}
+
+		length = strlen(dent->d_name);
+		if (length < strlen(SHARED_CACHE_SUFFIX)
+		    || strcmp(dent->d_name + length - strlen(SHARED_CACHE_SUFFIX), SHARED_CACHE_SUFFIX) != 0)
+			continue;
+
+		if (count == allocated) {
+			allocated = allocated ? allocated * 2 : 64;
+			tmp = realloc(entries, allocated * sizeof(SharedCacheEntry));
+			if (!tmp)
+				break;
+			entries = tmp;
+		}
+		entries[count].name = strdup(dent->d_name);
+		if (!entries[count].name)
+			break;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+		entries[count].last_use = st.st_mtim;
+#else
+		entries[count].last_use.tv_sec = st.st_mtime;
+		entries[count].last_use.tv_nsec = 0;
+#endif
+		entries[count].size = st.st_size;
+		total += st.st_size;
+		count++;
+	}
+
+	/* leave some room, so the next stores do not have to evict again */
+	if (total > shared_cache.budget) {
+		qsort(entries, count, sizeof(SharedCacheEntry), compare_last_use);
+		for (i = 0; i < count && total > shared_cache.budget / 4 * 3; i++) {
+			if (unlinkat(dfd, entries[i].name, 0) == 0)
+				total -= entries[i].size;
+		}
+	}
+
+	closedir(dir);
+
+	shared_cache.usage = total;
+	shared_cache.stores = 0;
+
+	for (i = 0; i < count; i++)
+		free(entries[i].name);
+	if (entries)
+		free(entries);
+}
+
+void r_shared_cache_store(const char *file, const struct stat *st, int index,
+                          unsigned max_width, unsigned max_height, double gamma, RImage *image)
+{
+	SharedCacheHeader header;
+	char *key, *path, *temp;
+	size_t data_size;
+	Bool written;
+	int fd;
+
+	if (!shared_cache.initialized)
+		init_shared_cache();
+	if (!shared_cache.dir)
+		return;
+
+	/* not worth pushing everything else out */
+	data_size = (size_t)image->width * image->height * (image->format == RRGBAFormat ? 4 : 3);
+	if (data_size > shared_cache.budget / 4)
+		return;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SHARED_CACHE_MAGIC, sizeof(header.magic));
+	header.mtime = st->st_mtime;
+	header.size = st->st_size;
+	header.index = index;
+	header.max_width = max_width;
+	header.max_height = max_height;
+	header.gamma = gamma;
+	header.width = image->width;
+	header.height = image->height;
+	header.alpha = (image->format == RRGBAFormat);
+	header.background[0] = image->background.red;
+	header.background[1] = image->background.green;
+	header.background[2] = image->background.blue;
+	header.background[3] = image->background.alpha;
+
+	key = get_key_file(file);
+	if (!key)
+		return;
+	header.path_length = strlen(key);
+
+	path = get_entry_path(key, st, index, max_width, max_height, gamma);
+	temp = malloc(strlen(shared_cache.dir) + sizeof("/" SHARED_CACHE_TEMP_PREFIX "XXXXXX"));
+	if (!path || !temp) {
+		if (path)
+			free(path);
+		if (temp)
+			free(temp);
+		free(key);
+		return;
+	}
+	sprintf(temp, "%s/" SHARED_CACHE_TEMP_PREFIX "XXXXXX", shared_cache.dir);
+
+	fd = mkstemp(temp);
+	if (fd < 0) {
+		free(path);
+		free(temp);
+		free(key);
+		return;
+	}
+
+	written = write_fully(fd, &header, sizeof(header))
+		&& write_fully(fd, key, header.path_length)
+		&& write_fully(fd, image->data, data_size)
+		&& fchmod(fd, 0644) == 0;
+	if (close(fd) != 0)
+		written = False;
+
+	/* readers only ever see complete entries */
+	if (written && rename(temp, path) == 0) {
+		shared_cache.usage += sizeof(header) + header.path_length + data_size;
+		shared_cache.stores++;
+	} else {
+		unlink(temp);
+	}
+
+	free(path);
+	free(temp);
+	free(key);
+
+	/* reading the whole directory is only worth it once in a while */
+	if (shared_cache.usage > shared_cache.budget || shared_cache.stores >= SHARED_CACHE_SCAN_INTERVAL)
+		evict_entries();
+}
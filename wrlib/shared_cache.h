@@ -0,0 +1,49 @@
+/*
+ * Raster graphics library
+ *
+ * Copyright (c) 2014 Window Maker Team
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ *  MA 02110-1301, USA.
+ */
+
+/*
+ * Cache of decoded images shared between processes
+ *
+ * The functions here are for WRaster library's internal use only,
+ * Please use functions in 'wraster.h' in applications
+ */
+
+#ifndef WRASTER_SHARED_CACHE_H
+#define WRASTER_SHARED_CACHE_H
+
+#include <sys/stat.h>
+
+
+/*
+ * Returns the image at index in file (as described by st) decoded for the
+ * given size box and display gamma, if some process stored it, or NULL
+ */
+RImage *r_shared_cache_load(const char *file, const struct stat *st, int index,
+                            unsigned max_width, unsigned max_height, double gamma);
+
+/*
+ * Offers a freshly decoded image to the other processes
+ */
+void r_shared_cache_store(const char *file, const struct stat *st, int index,
+                          unsigned max_width, unsigned max_height, double gamma, RImage *image);
+
+
+#endif
@@ -350,6 +350,15 @@ RImage *RCreateImageFromDrawable(RContext *context, Drawable drawable,
 
 RImage *RLoadImage(RContext *context, const char *file, int index);
 
+/*
+ * Loads an image that is going to be scaled down to fit in
+ * max_width x max_height. Formats that can be decoded at a reduced
+ * resolution are, so the image may be smaller than the file's, but never
+ * smaller than once scaled to fit in the box.
+ */
+RImage *RLoadImageForSize(RContext *context, const char *file, int index,
+                          unsigned max_width, unsigned max_height);
+
 RImage* RRetainImage(RImage *image);
 
 void RReleaseImage(RImage *image);